@@ -0,0 +1,1019 @@
+//
+//  Benchmarks for the terrain spatial index and particle systems.
+//
+
+#include "Benchmark.h"
+#include "ThreadPool.h"
+#include "SimdBox.h"
+#include "ParticleKernels.h"
+#include "TerrainChunks.h"
+
+void makeTerrainRays(const Box & bounds, int count, vector<Ray> & raysRtn) {
+	Vector3 min = bounds.parameters[0];
+	Vector3 max = bounds.parameters[1];
+	raysRtn.clear();
+	for (int i = 0; i < count; i++) {
+		Vector3 origin(ofRandom(min.x(), max.x()), max.y() + 1, ofRandom(min.z(), max.z()));
+		raysRtn.push_back(Ray(origin, Vector3(0, -1, 0)));
+	}
+}
+
+void makeTerrainBoxes(const Box & bounds, int count, float size, vector<Box> & boxesRtn) {
+	Vector3 min = bounds.parameters[0];
+	Vector3 max = bounds.parameters[1];
+	boxesRtn.clear();
+	for (int i = 0; i < count; i++) {
+		Vector3 p(ofRandom(min.x(), max.x()), ofRandom(min.y(), max.y()), ofRandom(min.z(), max.z()));
+		boxesRtn.push_back(Box(p, p + Vector3(size, size, size)));
+	}
+}
+
+void makeSensorRays(const Box & bounds, int count, vector<Ray> & raysRtn) {
+	Vector3 min = bounds.parameters[0];
+	Vector3 max = bounds.parameters[1];
+	raysRtn.clear();
+	while (raysRtn.size() < count) {
+		Vector3 origin(ofRandom(min.x(), max.x()), max.y() + 1, ofRandom(min.z(), max.z()));
+		for (int i = 0; i < 64 && raysRtn.size() < count; i++) {
+			Vector3 dir((i % 8 - 3.5f) * 0.05f, -1, (i / 8 - 3.5f) * 0.05f);
+			raysRtn.push_back(Ray(origin, dir));
+		}
+	}
+}
+
+ofMesh makeHeightFieldMesh(int numVertices) {
+	ofMesh mesh;
+	mesh.getVertices().reserve(numVertices);
+	for (int i = 0; i < numVertices; i++) {
+		float x = ofRandom(0, 200);
+		float z = ofRandom(0, 200);
+		float y = 5 * sin(x * 0.05) * cos(z * 0.07) + 2 * sin(x * 0.3 + z * 0.2);
+		mesh.addVertex(glm::vec3(x, y, z));
+	}
+	return mesh;
+}
+
+ofMesh makeTerrainGridMesh(int n) {
+	ofMesh mesh;
+	float step = 200.0f / (n - 1);
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			float x = i * step;
+			float z = j * step;
+			float y = 5 * sin(x * 0.05) * cos(z * 0.07) + 2 * sin(x * 0.3 + z * 0.2);
+			mesh.addVertex(glm::vec3(x, y, z));
+		}
+	}
+	for (int j = 0; j < n - 1; j++) {
+		for (int i = 0; i < n - 1; i++) {
+			int v = j * n + i;
+			mesh.addIndex(v); mesh.addIndex(v + n); mesh.addIndex(v + 1);
+			mesh.addIndex(v + 1); mesh.addIndex(v + n); mesh.addIndex(v + n + 1);
+		}
+	}
+	return mesh;
+}
+
+vector<Particle> makeParticles(int n) {
+	vector<Particle> particles(n);
+	for (int i = 0; i < n; i++) {
+		particles[i].position.set(ofRandom(-100, 100), ofRandom(0, 100), ofRandom(-100, 100));
+		particles[i].velocity.set(ofRandom(-10, 10), ofRandom(-10, 10), ofRandom(-10, 10));
+		particles[i].lifespan = -1;
+	}
+	return particles;
+}
+
+// frames a particle benchmark runs: about 20M particle updates, at least 5
+//
+static int particleFrames(int n) {
+	return std::max(5, 20000000 / n);
+}
+
+int octreeNodeCount(const TreeNode & node) {
+	int count = 1;
+	for (int i = 0; i < node.children.size(); i++)
+		count += octreeNodeCount(node.children[i]);
+	return count;
+}
+
+// heap memory held by a TreeNode tree (not counting the root itself)
+//
+size_t octreeMemoryBytes(const TreeNode & node) {
+	size_t bytes = node.points.capacity() * sizeof(int) + node.children.capacity() * sizeof(TreeNode);
+	for (int i = 0; i < node.children.size(); i++)
+		bytes += octreeMemoryBytes(node.children[i]);
+	return bytes;
+}
+
+// compare the TreeNode octree against the flat LinearOctree on the
+// same ray (AGL) and box (collision) queries
+//
+void benchmarkOctreeLayouts(Octree & octree, const LinearOctree & linear, int numQueries) {
+	vector<Ray> rays;
+	vector<Box> boxes;
+	makeTerrainRays(octree.root.box, numQueries, rays);
+	makeTerrainBoxes(octree.root.box, numQueries, 2.0, boxes);
+
+	cout << "--- octree layout: TreeNode vs LinearOctree (" << numQueries << " queries) ---" << endl;
+	cout << "memory:    TreeNode " << octreeMemoryBytes(octree.root) / 1024 << " KB, linear "
+		<< linear.memoryBytes() / 1024 << " KB" << endl;
+
+	// ray queries
+	//
+	int hitsTree = 0, hitsLinear = 0;
+	uint64_t start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < rays.size(); i++) {
+		TreeNode node;
+		if (octree.intersect(rays[i], octree.root, node)) hitsTree++;
+	}
+	uint64_t treeTime = ofGetElapsedTimeMicros() - start;
+
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < rays.size(); i++) {
+		int node;
+		if (linear.intersect(rays[i], node)) hitsLinear++;
+	}
+	uint64_t linearTime = ofGetElapsedTimeMicros() - start;
+
+	cout << "ray:       TreeNode " << treeTime / 1000.0 << " ms, linear " << linearTime / 1000.0
+		<< " ms (hits " << hitsTree << " / " << hitsLinear << ")" << endl;
+
+	// box queries
+	//
+	vector<Box> boxList;
+	size_t leavesTree = 0, leavesLinear = 0;
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < boxes.size(); i++) {
+		boxList.clear();
+		octree.intersect(boxes[i], octree.root, boxList);
+		leavesTree += boxList.size();
+	}
+	treeTime = ofGetElapsedTimeMicros() - start;
+
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < boxes.size(); i++) {
+		boxList.clear();
+		linear.intersect(boxes[i], boxList);
+		leavesLinear += boxList.size();
+	}
+	linearTime = ofGetElapsedTimeMicros() - start;
+
+	cout << "box:       TreeNode " << treeTime / 1000.0 << " ms, linear " << linearTime / 1000.0
+		<< " ms (leaves " << leavesTree << " / " << leavesLinear << ")" << endl;
+}
+
+// build time of the octree by thread count, recursive and partition
+// builds, checking that every parallel build matches the serial one
+//
+void benchmarkOctreeBuild(const ofMesh & mesh, int numLevels) {
+	cout << "--- octree build: " << mesh.getNumVertices() << " vertices, " << numLevels << " levels ---" << endl;
+
+	OctreeBuildType types[2] = { RecursiveBuild, PartitionBuild };
+	const char * names[2] = { "recursive", "partition" };
+	for (int b = 0; b < 2; b++) {
+		Octree serial;
+		serial.buildType = types[b];
+		uint64_t start = ofGetElapsedTimeMicros();
+		serial.create(mesh, numLevels);
+		uint64_t serialTime = ofGetElapsedTimeMicros() - start;
+		cout << names[b] << " threads 1: " << serialTime / 1000.0 << " ms" << endl;
+
+		int maxThreads = ThreadPool::hardwareThreads();
+		for (int threads = 2; threads <= maxThreads; threads *= 2) {
+			Octree parallel;
+			parallel.buildType = types[b];
+			parallel.numThreads = threads;
+			start = ofGetElapsedTimeMicros();
+			parallel.create(mesh, numLevels);
+			uint64_t time = ofGetElapsedTimeMicros() - start;
+			bool same = Octree::sameTree(serial.root, parallel.root) && serial.items == parallel.items;
+			cout << names[b] << " threads " << threads << ": " << time / 1000.0 << " ms, speedup "
+				<< (double)serialTime / time << (same ? "" : "  MISMATCH") << endl;
+			if (threads < maxThreads && threads * 2 > maxThreads) threads = maxThreads / 2;
+		}
+	}
+}
+
+// recursive vs Morton vs in place partition build time and tree memory on
+// point clouds from 100k to 10M vertices
+//
+void benchmarkOctreeStrategies(int numLevels) {
+	cout << "--- octree build strategy: recursive vs Morton vs partition, " << numLevels << " levels ---" << endl;
+	int sizes[] = { 100000, 1000000, 10000000 };
+	const char * names[] = { "recursive", "Morton", "partition" };
+	for (int s = 0; s < 3; s++) {
+		ofMesh mesh = makeHeightFieldMesh(sizes[s]);
+		uint64_t time[3];
+		int nodes[3];
+		size_t bytes[3];
+		for (int b = 0; b < 3; b++) {
+			Octree octree;
+			octree.buildType = (OctreeBuildType)b;
+			uint64_t start = ofGetElapsedTimeMicros();
+			octree.create(mesh, numLevels);
+			time[b] = ofGetElapsedTimeMicros() - start;
+			nodes[b] = octreeNodeCount(octree.root);
+			bytes[b] = octreeMemoryBytes(octree.root) + octree.items.capacity() * sizeof(int);
+		}
+		cout << sizes[s] << " vertices:";
+		for (int b = 0; b < 3; b++) {
+			cout << " " << names[b] << " " << time[b] / 1000.0 << " ms (" << nodes[b] << " nodes, "
+				<< bytes[b] / (1024 * 1024) << " MB)" << (b < 2 ? "," : "");
+		}
+		cout << endl;
+	}
+}
+
+// ray queries per second with each of the 8-wide child test kernels
+// this CPU supports
+//
+void benchmarkSimdTraversal(Octree & octree, const Octree & faceOctree, const LinearOctree & linear, int numQueries) {
+	vector<Ray> rays;
+	makeTerrainRays(octree.root.box, numQueries, rays);
+	SimdLevel detected = detectSimdLevel();
+
+	cout << "--- child box kernels: ray queries / sec (" << numQueries << " rays) ---" << endl;
+	for (int level = SimdScalar; level <= detected; level++) {
+		setSimdLevel((SimdLevel)level);
+		double qps[3];
+		double checksum = 0;
+
+		uint64_t start = ofGetElapsedTimeMicros();
+		for (int i = 0; i < rays.size(); i++) {
+			TreeNode node;
+			const int * items;
+			if (octree.intersect(rays[i], octree.root, node)) checksum += octree.getItems(node, items);
+		}
+		qps[0] = rays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		start = ofGetElapsedTimeMicros();
+		for (int i = 0; i < rays.size(); i++) {
+			RayHit hit;
+			if (faceOctree.intersect(rays[i], hit)) checksum += hit.t;
+		}
+		qps[1] = rays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		start = ofGetElapsedTimeMicros();
+		for (int i = 0; i < rays.size(); i++) {
+			int node;
+			if (linear.intersect(rays[i], node)) checksum += node;
+		}
+		qps[2] = rays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		cout << simdLevelName((SimdLevel)level) << ": octree leaf " << (int)qps[0] << ", nearest triangle " << (int)qps[1]
+			<< ", linear leaf " << (int)qps[2] << "  (checksum " << checksum << ")" << endl;
+	}
+	setSimdLevel(detected);
+}
+
+// one ray at a time vs the packet batch API, serial and on a thread pool
+//
+void benchmarkBatchQueries(const Octree & faceOctree, int numQueries) {
+	vector<Ray> rays;
+	vector<RayHit> hits;
+	vector<Box> boxes;
+	vector<vector<Box>> boxLists;
+	makeSensorRays(faceOctree.root.box, numQueries, rays);
+	makeTerrainBoxes(faceOctree.root.box, numQueries, 2.0, boxes);
+	ThreadPool pool(ThreadPool::hardwareThreads());
+
+	cout << "--- batch queries: sensor rays / sec (" << numQueries << " rays, "
+		<< pool.size() << " threads) ---" << endl;
+
+	int single = 0;
+	uint64_t start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < rays.size(); i++) {
+		RayHit hit;
+		if (faceOctree.intersect(rays[i], hit)) single++;
+	}
+	double qpsSingle = rays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	start = ofGetElapsedTimeMicros();
+	int packet = faceOctree.intersect(rays, hits);
+	double qpsPacket = rays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	start = ofGetElapsedTimeMicros();
+	int threaded = faceOctree.intersect(rays, hits, &pool);
+	double qpsThreaded = rays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	cout << "single " << (int)qpsSingle << ", packets " << (int)qpsPacket << ", packets + pool "
+		<< (int)qpsThreaded << "  (hits " << single << " / " << packet << " / " << threaded << ")" << endl;
+
+	start = ofGetElapsedTimeMicros();
+	faceOctree.intersect(boxes, boxLists, &pool);
+	uint64_t boxTime = ofGetElapsedTimeMicros() - start;
+	cout << "box batch: " << (int)(boxes.size() * 1.0e6 / (boxTime + 1)) << " boxes / sec" << endl;
+}
+
+// face octree vs SAH bvh over the same triangles: build time, memory, and
+// throughput of the two queries the game makes through TerrainIndex
+//
+void benchmarkTerrainIndexes(const ofMesh & mesh, int numLevels, int numQueries) {
+	LinearOctree octree;
+	Bvh bvh;
+	octree.bUseFaces = true;
+
+	uint64_t start = ofGetElapsedTimeMicros();
+	octree.create(mesh, numLevels);
+	uint64_t octreeBuild = ofGetElapsedTimeMicros() - start;
+	start = ofGetElapsedTimeMicros();
+	bvh.create(mesh);
+	uint64_t bvhBuild = ofGetElapsedTimeMicros() - start;
+
+	// straight down (AGL) rays, oblique rays from above, lander sized boxes
+	//
+	Box bounds = octree.getBox(0);
+	vector<Ray> downRays, obliqueRays;
+	vector<Box> boxes;
+	makeTerrainRays(bounds, numQueries, downRays);
+	makeSensorRays(bounds, numQueries, obliqueRays);
+	for (int i = 0; i < obliqueRays.size(); i++) {
+		Vector3 d = obliqueRays[i].direction;
+		obliqueRays[i] = Ray(obliqueRays[i].origin, Vector3(d.x() * 10, d.y(), d.z() * 10));
+	}
+	makeTerrainBoxes(bounds, numQueries, 2.0, boxes);
+
+	cout << "--- terrain index: face octree vs bvh (" << Octree::meshFaceCount(mesh) << " faces, "
+		<< numQueries << " queries) ---" << endl;
+	const TerrainIndex * indexes[2] = { &octree, &bvh };
+	uint64_t buildTimes[2] = { octreeBuild, bvhBuild };
+	int nodes[2] = { octree.numNodes(), bvh.numNodes() };
+	for (int i = 0; i < 2; i++) {
+		const TerrainIndex & index = *indexes[i];
+		double checksum = 0;
+		double qps[3];
+
+		start = ofGetElapsedTimeMicros();
+		for (int q = 0; q < downRays.size(); q++) {
+			RayHit hit;
+			if (index.intersect(downRays[q], hit)) checksum += hit.t;
+		}
+		qps[0] = downRays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		start = ofGetElapsedTimeMicros();
+		for (int q = 0; q < obliqueRays.size(); q++) {
+			RayHit hit;
+			if (index.intersect(obliqueRays[q], hit)) checksum += hit.t;
+		}
+		qps[1] = obliqueRays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		vector<Box> boxList;
+		start = ofGetElapsedTimeMicros();
+		for (int q = 0; q < boxes.size(); q++) {
+			boxList.clear();
+			index.intersect(boxes[q], boxList);
+			checksum += boxList.size();
+		}
+		qps[2] = boxes.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		cout << index.name() << ": build " << buildTimes[i] / 1000.0 << " ms, " << nodes[i] << " nodes, "
+			<< index.memoryBytes() / 1024 << " KB, down rays/s " << (int)qps[0] << ", oblique rays/s "
+			<< (int)qps[1] << ", boxes/s " << (int)qps[2] << "  (checksum " << checksum << ")" << endl;
+	}
+}
+
+// crater edits of three sizes on a point and a face octree: incremental
+// update() against rebuilding the whole tree
+//
+void benchmarkOctreeUpdate(int gridSize, int numLevels) {
+	ofMesh mesh = makeTerrainGridMesh(gridSize);
+	Octree points, faces;
+	faces.bUseFaces = true;
+	points.boundsMargin = 5;
+	faces.boundsMargin = 5;
+
+	uint64_t start = ofGetElapsedTimeMicros();
+	points.create(mesh, numLevels);
+	uint64_t pointsBuild = ofGetElapsedTimeMicros() - start;
+	start = ofGetElapsedTimeMicros();
+	faces.create(mesh, numLevels);
+	uint64_t facesBuild = ofGetElapsedTimeMicros() - start;
+	LinearOctree linearPoints, linearFaces;
+	linearFaces.bUseFaces = true;
+	linearPoints.boundsMargin = 5;
+	linearFaces.boundsMargin = 5;
+	linearPoints.create(mesh, numLevels);
+	linearFaces.create(mesh, numLevels);
+
+	cout << "--- octree update: " << mesh.getNumVertices() << " vertices, full rebuild points "
+		<< pointsBuild / 1000.0 << " ms, faces " << facesBuild / 1000.0 << " ms ---" << endl;
+
+	const char * names[3] = { "small", "medium", "large" };
+	float radius[3] = { 2, 10, 40 };
+	const int numEdits = 20;
+	for (int s = 0; s < 3; s++) {
+		uint64_t pointsTime = 0, facesTime = 0, linearTime = 0;
+		int numVerts = 0, touched = 0, rebuilds = 0;
+		for (int e = 0; e < numEdits; e++) {
+			ofVec3f center(ofRandom(radius[s], 200 - radius[s]), 0, ofRandom(radius[s], 200 - radius[s]));
+			vector<int> vertices;
+			vector<glm::vec3> positions;
+			points.craterEdit(center, radius[s], 0.5, vertices, positions);
+			numVerts += (int)vertices.size();
+
+			start = ofGetElapsedTimeMicros();
+			int nodes = points.update(vertices, positions);
+			if (nodes < 0) rebuilds++;
+			else touched += nodes;
+			pointsTime += ofGetElapsedTimeMicros() - start;
+			start = ofGetElapsedTimeMicros();
+			faces.update(vertices, positions);
+			facesTime += ofGetElapsedTimeMicros() - start;
+			start = ofGetElapsedTimeMicros();
+			linearPoints.update(vertices, positions);
+			linearFaces.update(vertices, positions);
+			linearTime += ofGetElapsedTimeMicros() - start;
+		}
+		cout << names[s] << " (radius " << radius[s] << ", " << numVerts / numEdits << " vertices): points "
+			<< pointsTime / 1000.0 / numEdits << " ms, faces " << facesTime / 1000.0 / numEdits << " ms, linear points + faces "
+			<< linearTime / 1000.0 / numEdits << " ms, " << touched / numEdits << " nodes, " << rebuilds << " full rebuilds" << endl;
+	}
+}
+
+// AGL (straight down) and shallow ray queries: the triangle octree against
+// the height field pyramid
+//
+void benchmarkHeightField(const LinearOctree & faceOctree, const HeightField & heightField, int numQueries) {
+	Box bounds = faceOctree.getBox(0);
+	Vector3 min = bounds.parameters[0];
+	Vector3 max = bounds.parameters[1];
+	vector<Ray> downRays, shallowRays;
+	makeTerrainRays(bounds, numQueries, downRays);
+	for (int i = 0; i < numQueries; i++) {
+		Vector3 origin(ofRandom(min.x(), max.x()), max.y() + 1, ofRandom(min.z(), max.z()));
+		Vector3 dir(ofRandom(-1, 1), ofRandom(-0.2, -0.02), ofRandom(-1, 1));
+		shallowRays.push_back(Ray(origin, dir));
+	}
+
+	cout << "--- height field: " << heightField.getResolution() << " cells, " << heightField.memoryBytes() / 1024
+		<< " KB vs face octree " << faceOctree.memoryBytes() / 1024 << " KB (" << numQueries << " queries) ---" << endl;
+
+	double sumT[2] = { 0, 0 };
+	uint64_t start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < downRays.size(); i++) {
+		RayHit hit;
+		if (faceOctree.intersect(downRays[i], hit)) sumT[0] += hit.t;
+	}
+	double octreeAgl = downRays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < downRays.size(); i++) {
+		float agl;
+		Vector3 o = downRays[i].origin;
+		if (heightField.agl(ofVec3f(o.x(), o.y(), o.z()), agl)) sumT[1] += agl;
+	}
+	double fieldAgl = downRays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	cout << "AGL / sec: octree " << (int)octreeAgl << ", height field " << (int)fieldAgl
+		<< "  (mean difference " << fabs(sumT[0] - sumT[1]) / numQueries << ")" << endl;
+
+	int hits[2] = { 0, 0 };
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < shallowRays.size(); i++) {
+		RayHit hit;
+		if (faceOctree.intersect(shallowRays[i], hit)) hits[0]++;
+	}
+	double octreeRays = shallowRays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < shallowRays.size(); i++) {
+		RayHit hit;
+		if (heightField.intersect(shallowRays[i], hit)) hits[1]++;
+	}
+	double fieldRays = shallowRays.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	cout << "shallow rays / sec: octree " << (int)octreeRays << ", height field " << (int)fieldRays
+		<< "  (hits " << hits[0] << " / " << hits[1] << ")" << endl;
+}
+
+// tree shape and per query cost of the face octree (AGL rays and lander
+// sized collision boxes) for a range of numLevels, as JSON
+//
+void benchmarkOctreeLevels(const ofMesh & mesh, int numQueries) {
+	cout << "--- octree levels: tree stats and query cost percentiles (" << numQueries << " queries) ---" << endl;
+	for (int levels = 4; levels <= 12; levels += 2) {
+		Octree octree;
+		QueryStats queryStats;
+		octree.bUseFaces = true;
+		octree.create(mesh, levels);
+		octree.queryStats = &queryStats;
+
+		vector<Ray> rays;
+		vector<Box> boxes;
+		makeTerrainRays(octree.root.box, numQueries, rays);
+		makeTerrainBoxes(octree.root.box, numQueries, 2.0, boxes);
+		const TreeNode * leaves[256];
+		for (int i = 0; i < numQueries; i++) {
+			RayHit hit;
+			octree.intersect(rays[i], hit);
+			octree.intersect(boxes[i], leaves, 256);
+		}
+
+		cout << "{\"numLevels\": " << levels << ", \"tree\": " << octree.stats().toJson()
+			<< ", \"queries\": " << queryStats.toJson() << "}" << endl;
+	}
+}
+
+// closest terrain point and 8 nearest faces from points just above the
+// ground (where the lander collides), checked against a brute force scan
+// of every face for the first 100 queries
+//
+void benchmarkNearestQueries(const Octree & faceOctree, const LinearOctree & linearFaceOctree, int numQueries) {
+	vector<Ray> rays;
+	makeTerrainRays(faceOctree.root.box, numQueries, rays);
+	vector<ofVec3f> points;
+	for (int i = 0; i < rays.size(); i++) {
+		RayHit hit;
+		if (faceOctree.intersect(rays[i], hit)) points.push_back(hit.point + ofVec3f(0, ofRandom(0, 3), 0));
+	}
+
+	cout << "--- nearest queries: " << points.size() << " points near the terrain ---" << endl;
+	int numFaces = Octree::meshFaceCount(faceOctree.mesh);
+	int mismatches = 0;
+	for (int i = 0; i < points.size() && i < 100; i++) {
+		NearestPoint best, found;
+		for (int f = 0; f < numFaces; f++) {
+			NearestPoint candidate;
+			Octree::itemDistance(faceOctree.mesh, true, f, points[i], candidate);
+			if (candidate.distance < best.distance) best = candidate;
+		}
+		faceOctree.closestPoint(points[i], found);
+		if (fabs(found.distance - best.distance) > 1e-4) mismatches++;
+	}
+
+	vector<NearestPoint> nearest;
+	double sum = 0;
+	uint64_t start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < points.size(); i++) {
+		NearestPoint found;
+		if (faceOctree.closestPoint(points[i], found)) sum += found.distance;
+	}
+	double closestQps = points.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < points.size(); i++) {
+		NearestPoint found;
+		if (linearFaceOctree.closestPoint(points[i], found)) sum += found.distance;
+	}
+	double linearQps = points.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	start = ofGetElapsedTimeMicros();
+	for (int i = 0; i < points.size(); i++)
+		sum += faceOctree.nearest(points[i], 8, nearest);
+	double knnQps = points.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+	cout << "closest point / sec: octree " << (int)closestQps << ", linear " << (int)linearQps
+		<< "; 8 nearest / sec: " << (int)knnQps << "  (brute force mismatches " << mismatches << ")" << endl;
+}
+
+// lander sized boxes 0 - 3 units above the ground taking one step down,
+// a frame's worth (0.5 units) and a long one (20 units, a frame rate drop
+// or the explosion impulse).  The discrete box query at the end position
+// (as checkCollisions() does) against the swept query over the whole step,
+// and how many contacts the discrete test misses.
+//
+void benchmarkSweepQueries(const LinearOctree & linearOctree, const LinearOctree & linearFaceOctree, int numQueries) {
+	Box bounds = linearFaceOctree.getBox(0);
+	vector<Ray> rays;
+	vector<Box> boxes;
+	makeTerrainRays(bounds, numQueries, rays);
+	for (int i = 0; i < rays.size(); i++) {
+		RayHit hit;
+		if (!linearFaceOctree.intersect(rays[i], hit)) continue;
+		Vector3 bottom(hit.point.x, hit.point.y + ofRandom(0, 3), hit.point.z);
+		boxes.push_back(Box(bottom - Vector3(1, 0, 1), bottom + Vector3(1, 2, 1)));
+	}
+
+	cout << "--- swept box queries: " << boxes.size() << " lander boxes stepping down ---" << endl;
+	float steps[] = { 0.5, 20 };
+	for (int s = 0; s < 2; s++) {
+		Vector3 move(0, -steps[s], 0);
+		int leaves[256];
+		int discreteHits = 0;
+		uint64_t start = ofGetElapsedTimeMicros();
+		for (int i = 0; i < boxes.size(); i++) {
+			Box end(boxes[i].parameters[0] + move, boxes[i].parameters[1] + move);
+			if (linearOctree.intersect(end, leaves, 256) > 0) discreteHits++;
+		}
+		double discreteQps = boxes.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		int sweepHits = 0;
+		start = ofGetElapsedTimeMicros();
+		for (int i = 0; i < boxes.size(); i++) {
+			SweepHit hit;
+			if (linearFaceOctree.sweep(boxes[i], ofVec3f(0, -steps[s], 0), hit)) sweepHits++;
+		}
+		double sweepQps = boxes.size() * 1.0e6 / (ofGetElapsedTimeMicros() - start + 1);
+
+		cout << "step " << steps[s] << ": queries / sec discrete " << (int)discreteQps << ", swept " << (int)sweepQps
+			<< "  (contacts " << discreteHits << " / " << sweepHits << ")" << endl;
+	}
+}
+
+// frustum culling of the terrain chunks on a grid mesh, no GL needed:
+// cameras looking straight down on the whole terrain, up at the sky, from
+// far away (beyond the far plane) and down on one corner.  The chunk
+// counts must be as expected and visible() must give the same chunks as
+// testing every chunk's bounds on its own.  Returns false if any case fails.
+//
+bool checkTerrainChunks() {
+	ofMesh mesh = makeTerrainGridMesh(65);
+	LinearOctree faceOctree;
+	faceOctree.bUseFaces = true;
+	faceOctree.create(mesh, 5);
+	TerrainChunks chunks;
+	chunks.create(faceOctree, 3);
+	int all = chunks.numChunks();
+	cout << "--- terrain chunks: " << all << " chunks of a 64 x 64 grid ---" << endl;
+
+	struct View {
+		const char * name;
+		glm::vec3 eye, target, up;
+		float fov;
+		int minChunks, maxChunks;
+	};
+	View views[] = {
+		{ "straight down", glm::vec3(100, 400, 100), glm::vec3(100, 0, 100), glm::vec3(0, 0, -1), 60, all, all },
+		{ "at the sky", glm::vec3(100, 50, 100), glm::vec3(100, 1000, 100), glm::vec3(0, 0, 1), 60, 0, 0 },
+		{ "far away", glm::vec3(5000, 50, 5000), glm::vec3(100, 0, 100), glm::vec3(0, 1, 0), 60, 0, 0 },
+		{ "one corner", glm::vec3(25, 60, 25), glm::vec3(25, 0, 25), glm::vec3(0, 0, -1), 40, 1, all - 1 },
+	};
+
+	bool passed = all > 1;
+	for (int v = 0; v < 4; v++) {
+		const View & view = views[v];
+		Frustum frustum;
+		frustum.set(glm::perspective(glm::radians(view.fov), 1.0f, 1.0f, 1000.0f) * glm::lookAt(view.eye, view.target, view.up));
+
+		vector<int> visible;
+		chunks.visible(frustum, visible);
+		sort(visible.begin(), visible.end());
+		vector<int> each;
+		for (int c = 0; c < all; c++) {
+			if (frustum.test(chunks.getBounds(c)) != FrustumOutside) each.push_back(c);
+		}
+
+		bool ok = visible == each && visible.size() >= view.minChunks && visible.size() <= view.maxChunks;
+		passed = passed && ok;
+		cout << view.name << ": " << visible.size() << " chunks (expected " << view.minChunks;
+		if (view.maxChunks != view.minChunks) cout << " - " << view.maxChunks;
+		cout << ", per chunk test " << each.size() << ")" << (ok ? "" : "  FAILED") << endl;
+	}
+	return passed;
+}
+
+// number of nodes of levels minLevel to maxLevel, or of the leaves
+//
+static int countLineBoxes(const TreeNode & node, int level, int minLevel, int maxLevel, bool leavesOnly) {
+	if (level > maxLevel) return 0;
+	int count = level >= minLevel && (!leavesOnly || node.children.empty()) ? 1 : 0;
+	for (int i = 0; i < node.children.size(); i++)
+		count += countLineBoxes(node.children[i], level + 1, minLevel, maxLevel, leavesOnly);
+	return count;
+}
+
+static bool sameLineMesh(const ofMesh & a, const ofMesh & b) {
+	if (a.getNumVertices() != b.getNumVertices() || a.getIndices() != b.getIndices()) return false;
+	for (int i = 0; i < a.getNumVertices(); i++) {
+		if (a.getVertex(i) != b.getVertex(i) || a.getColor(i) != b.getColor(i)) return false;
+	}
+	return true;
+}
+
+// the cached box line meshes of point and face trees on a grid mesh: 8
+// vertices and 24 indices per box for every level range and for the
+// leaves, the same leaf mesh from Octree and LinearOctree, and no rebuild
+// when a tree is drawn again with the same levels.  Returns false if any
+// case fails.
+//
+bool checkOctreeLineMeshes() {
+	ofMesh mesh = makeTerrainGridMesh(33);
+	int numLevels = 5;
+	cout << "--- octree line meshes: 32 x 32 grid, " << numLevels << " levels ---" << endl;
+
+	bool passed = true;
+	for (int faces = 0; faces < 2; faces++) {
+		Octree octree;
+		LinearOctree linear;
+		octree.bUseFaces = linear.bUseFaces = faces != 0;
+		if (!faces) octree.buildType = PartitionBuild;
+		octree.create(mesh, numLevels);
+		linear.create(mesh, numLevels);
+		const char * name = faces ? "faces" : "points";
+
+		int bad = 0;
+		ofMesh lines;
+		for (int minLevel = 0; minLevel <= numLevels + 1; minLevel++) {
+			for (int maxLevel = minLevel; maxLevel <= numLevels + 1; maxLevel++) {
+				int boxes = countLineBoxes(octree.root, 0, minLevel, maxLevel, false);
+				octree.buildLineMesh(lines, minLevel, maxLevel, false);
+				if (lines.getNumVertices() != 8 * boxes || lines.getNumIndices() != 24 * boxes) bad++;
+				linear.buildLineMesh(lines, minLevel, maxLevel, false);
+				if (lines.getNumVertices() != 8 * boxes || lines.getNumIndices() != 24 * boxes) bad++;
+			}
+		}
+
+		int leaves = countLineBoxes(octree.root, 0, 0, INT_MAX, true);
+		ofMesh leafLines;
+		octree.buildLineMesh(leafLines, 0, INT_MAX, true);
+		linear.buildLineMesh(lines, 0, INT_MAX, true);
+		if (leafLines.getNumVertices() != 8 * leaves || leafLines.getNumIndices() != 24 * leaves) bad++;
+		bool sameLeaves = sameLineMesh(leafLines, lines);
+
+		// drawn twice with the same levels, then with other levels
+		//
+		octree.draw(numLevels, 0);
+		octree.draw(numLevels, 0);
+		linear.draw(numLevels);
+		linear.draw(numLevels);
+		linear.drawLeafNodes();
+		linear.drawLeafNodes();
+		bool cached = octree.lines.builds == 1 && linear.getLines(false).builds == 1 && linear.getLines(true).builds == 1;
+		octree.draw(numLevels - 1, 0);
+		linear.draw(numLevels - 1);
+		bool rebuilt = octree.lines.builds == 2 && linear.getLines(false).builds == 2;
+
+		bool ok = bad == 0 && sameLeaves && cached && rebuilt;
+		passed = passed && ok;
+		cout << name << ": " << leaves << " leaves, " << bad << " bad box counts, leaf meshes "
+			<< (sameLeaves ? "match" : "differ") << ", redraw " << (cached ? "cached" : "rebuilt")
+			<< (ok ? "" : "  FAILED") << endl;
+	}
+	return passed;
+}
+
+// items held by the leaves (and by every node of a face tree), and how
+// many of them are held a second time
+//
+static void octreeItemCounts(const LinearOctree & tree, int & itemsRtn, int & duplicatesRtn) {
+	vector<int> items;
+	for (int n = 0; n < tree.numNodes(); n++) {
+		if (tree.isLeaf(n) || tree.bUseFaces)
+			items.insert(items.end(), tree.points + tree.pointStart[n], tree.points + tree.pointStart[n] + tree.pointCount[n]);
+	}
+	itemsRtn = (int)items.size();
+	sort(items.begin(), items.end());
+	duplicatesRtn = itemsRtn - (int)(unique(items.begin(), items.end()) - items.begin());
+}
+
+// LinearOctree::update() against create() on a grid mesh, where many
+// vertices lie on the split planes: craters dug in the middle of the grid
+// and on the planes of the top levels.  Item count, duplicates and node
+// count must match a tree built from the edited mesh.  Cases where the
+// edit moved the mesh bounds (so create() picks another root box) are
+// skipped.  Returns false if any case fails.
+//
+bool checkOctreeUpdate() {
+	cout << "--- octree update vs create on a 64 x 64 grid ---" << endl;
+	ofVec3f centers[] = { ofVec3f(100, 0, 100), ofVec3f(50, 0, 100), ofVec3f(150, 0, 50), ofVec3f(75, 0, 125) };
+	float radii[] = { 3, 12 };
+	bool passed = true;
+	for (int faces = 0; faces < 2; faces++) {
+		int compared = 0, bad = 0;
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 2; r++) {
+				LinearOctree tree;
+				tree.bUseFaces = faces;
+				tree.create(makeTerrainGridMesh(65), 6);
+				vector<int> vertices;
+				vector<glm::vec3> positions;
+				tree.craterEdit(centers[c], radii[r], 1, vertices, positions);
+				if (tree.update(vertices, positions) < 0) continue;
+
+				LinearOctree fresh;
+				fresh.bUseFaces = faces;
+				fresh.create(tree.mesh, 6);
+				Box a = tree.getBox(0), b = fresh.getBox(0);
+				if (a.parameters[0] != b.parameters[0] || a.parameters[1] != b.parameters[1]) continue;
+				compared++;
+				int items, duplicates, freshItems, freshDuplicates;
+				octreeItemCounts(tree, items, duplicates);
+				octreeItemCounts(fresh, freshItems, freshDuplicates);
+				if (items != freshItems || duplicates != freshDuplicates || tree.numNodes() != fresh.numNodes()) bad++;
+			}
+		}
+		bool ok = compared > 0 && bad == 0;
+		passed = passed && ok;
+		cout << (faces ? "face tree" : "point tree") << ": " << compared << " edits compared, " << bad << " differ"
+			<< (ok ? "" : "  FAILED") << endl;
+	}
+	return passed;
+}
+
+// update cost per particle of the old vector<Particle> layout (forces
+// per particle, then Particle::integrate()) against ParticleSystem's
+// arrays, for gravity alone and for the thrust emitter's gravity +
+// turbulence.  Particles never expire, so only the force and integration
+// passes are timed.  Both sides draw the turbulence from a ParticleRandom
+// and the arrays run scalar on one thread, so only the layout differs.
+//
+void benchmarkParticleLayouts(const vector<int> & counts) {
+	SimClock clock;                  // never advanced: fixed dt, and the particles never expire
+	cout << "--- particle layouts: update ns / particle, Particle " << sizeof(Particle)
+		<< " bytes vs arrays 60 bytes ---" << endl;
+	ofVec3f tmin(-50, -100, -50), tmax(50, -50, 50);
+	GravityForce gravity(ofVec3f(0, -1.625, 0));
+	TurbulenceForce turbulence(tmin, tmax);
+	vector<ParticleForce *> forceSets[2] = { { &gravity }, { &gravity, &turbulence } };
+	const char * setNames[2] = { "gravity", "gravity + turbulence" };
+	SimdLevel simdLevel = getSimdLevel();
+
+	for (int s = 0; s < 2; s++) {
+		for (int c = 0; c < counts.size(); c++) {
+			int n = counts[c];
+			int frames = particleFrames(n);
+			vector<Particle> records = makeParticles(n);
+			ParticleSystem sys;
+			sys.forces = forceSets[s];
+			sys.particles.reserve(n);
+			for (int i = 0; i < n; i++) sys.add(records[i]);
+
+			ParticleRandom random(1, s);
+			uint64_t start = ofGetElapsedTimeMicros();
+			for (int f = 0; f < frames; f++) {
+				for (int i = 0; i < n; i++) {
+					gravity.updateForce(&records[i]);
+					if (s == 0) continue;
+					records[i].forces.x += random.uniform(tmin.x, tmax.x);
+					records[i].forces.y += random.uniform(tmin.y, tmax.y);
+					records[i].forces.z += random.uniform(tmin.z, tmax.z);
+				}
+				for (int i = 0; i < n; i++)
+					records[i].integrate(clock.dt());
+			}
+			double recordNs = (ofGetElapsedTimeMicros() - start) * 1000.0 / ((double)n * frames);
+
+			setSimdLevel(SimdScalar);
+			start = ofGetElapsedTimeMicros();
+			for (int f = 0; f < frames; f++)
+				sys.update(clock);
+			double arrayNs = (ofGetElapsedTimeMicros() - start) * 1000.0 / ((double)n * frames);
+			setSimdLevel(simdLevel);
+
+			cout << setNames[s] << ", " << n << " particles: records " << recordNs << " ns, arrays " << arrayNs
+				<< " ns (" << recordNs / arrayNs << "x)" << endl;
+		}
+	}
+}
+
+// parallel particle update with gravity + turbulence on 1, 2, 4 ... maxThreads
+// threads.  Every run starts from the same particles and seed, and the end
+// positions are compared with the single thread run.
+//
+void benchmarkParticleThreads(const vector<int> & counts, int maxThreads) {
+	SimClock clock;
+	cout << "--- particle threads: update ns / particle and speedup over 1 thread ---" << endl;
+	GravityForce gravity(ofVec3f(0, -1.625, 0));
+	TurbulenceForce turbulence(ofVec3f(-50, -100, -50), ofVec3f(50, -50, 50));
+
+	for (int c = 0; c < counts.size(); c++) {
+		int n = counts[c];
+		int frames = particleFrames(n);
+		vector<Particle> start = makeParticles(n);
+
+		vector<int> threadCounts;
+		for (int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+		threadCounts.push_back(std::max(maxThreads, 1));
+
+		double singleNs = 0;
+		FloatArray singleX;
+		for (int t = 0; t < threadCounts.size(); t++) {
+			int threads = threadCounts[t];
+			ThreadPool pool(threads);
+			ParticleSystem sys;
+			sys.addForce(&gravity);
+			sys.addForce(&turbulence);
+			sys.threadPool = &pool;
+			for (int i = 0; i < n; i++) sys.add(start[i]);
+
+			uint64_t startTime = ofGetElapsedTimeMicros();
+			for (int f = 0; f < frames; f++)
+				sys.update(clock);
+			double ns = (ofGetElapsedTimeMicros() - startTime) * 1000.0 / ((double)n * frames);
+
+			if (threads == 1) {
+				singleNs = ns;
+				singleX = sys.particles.px;
+			}
+			cout << n << " particles, " << threads << " threads: " << ns << " ns (" << singleNs / ns << "x)"
+				<< (sys.particles.px == singleX ? "" : "  RESULTS DIFFER") << endl;
+		}
+	}
+}
+
+// one force set through ParticleForce pointers against the same forces
+// fused at compile time, single threaded, from the same particles
+//
+template <typename... Forces>
+static void compareParticleFusion(const char * name, const vector<int> & counts,
+	const vector<ParticleForce *> & forces, const Forces &... fused) {
+	SimClock clock;
+	for (int c = 0; c < counts.size(); c++) {
+		int n = counts[c];
+		int frames = particleFrames(n);
+		vector<Particle> start = makeParticles(n);
+		ParticleSystem virtualSys;
+		virtualSys.forces = forces;
+		virtualSys.reset();
+		FusedParticleSystem<Forces...> fusedSys(fused...);
+		for (int i = 0; i < n; i++) {
+			virtualSys.add(start[i]);
+			fusedSys.add(start[i]);
+		}
+
+		uint64_t t0 = ofGetElapsedTimeMicros();
+		for (int f = 0; f < frames; f++)
+			virtualSys.update(clock);
+		double virtualNs = (ofGetElapsedTimeMicros() - t0) * 1000.0 / ((double)n * frames);
+
+		t0 = ofGetElapsedTimeMicros();
+		for (int f = 0; f < frames; f++)
+			fusedSys.update(clock);
+		double fusedNs = (ofGetElapsedTimeMicros() - t0) * 1000.0 / ((double)n * frames);
+
+		bool same = virtualSys.particles.px == fusedSys.particles.px && virtualSys.particles.vy == fusedSys.particles.vy;
+		cout << name << ", " << n << " particles: virtual " << virtualNs << " ns, fused " << fusedNs << " ns ("
+			<< virtualNs / fusedNs << "x)" << (same ? "" : "  RESULTS DIFFER") << endl;
+	}
+}
+
+// the land emitter's forces (a one shot ring, gravity, turbulence), where
+// the first step also checks the one shot forces give the same result,
+// and the thrust emitter's (gravity, turbulence), which the fused system
+// runs through the SIMD kernels
+//
+void benchmarkParticleFusion(const vector<int> & counts) {
+	cout << "--- particle forces: update ns / particle, virtual vs fused ---" << endl;
+	ofVec3f g(0, -1.625, 0);
+	ofVec3f tmin(-50, -100, -50), tmax(50, -50, 50);
+	RingForce ring(500);
+	GravityForce gravity(g);
+	TurbulenceForce turbulence(tmin, tmax);
+
+	compareParticleFusion("ring + gravity + turbulence", counts, { &ring, &gravity, &turbulence },
+		StaticRingForce(500), StaticGravityForce(g), StaticTurbulenceForce(tmin, tmax));
+	compareParticleFusion("gravity + turbulence", counts, { &gravity, &turbulence },
+		StaticGravityForce(g), StaticTurbulenceForce(tmin, tmax));
+}
+
+// the particle kernels at each SIMD level the CPU has: millions of
+// particles / second for integrate, gravity and turbulence, and the
+// speedup over scalar.  Every level starts from the same particles and
+// random stream and its results are compared with the scalar ones.
+//
+void benchmarkParticleKernels(const vector<int> & counts) {
+	SimClock clock;
+	float dt = clock.dt();
+	ofVec3f g(0, -1.625, 0);
+	ofVec3f tmin(-50, -100, -50), tmax(50, -50, 50);
+	const char * kernelNames[3] = { "integrate", "gravity", "turbulence" };
+	SimdLevel detected = detectSimdLevel();
+	cout << "--- particle kernels: M particles / s (speedup over scalar) ---" << endl;
+
+	for (int c = 0; c < counts.size(); c++) {
+		int n = counts[c];
+		int frames = particleFrames(n);
+		vector<Particle> records = makeParticles(n);
+		ParticleStore start;
+		start.reserve(n);
+		for (int i = 0; i < n; i++) {
+			records[i].forces.set(ofRandom(-10, 10), ofRandom(-10, 10), ofRandom(-10, 10));
+			records[i].mass = ofRandom(0.5, 2);
+			start.add(records[i]);
+		}
+
+		double scalarRate[3] = { 0, 0, 0 };
+		ParticleStore reference[3];
+		for (int level = SimdScalar; level <= detected; level++) {
+			setSimdLevel((SimdLevel)level);
+			cout << simdLevelName((SimdLevel)level) << ", " << n << " particles:";
+			for (int k = 0; k < 3; k++) {
+				ParticleStore particles = start;
+				ParticleRandom random(1, k);
+				uint64_t t0 = ofGetElapsedTimeMicros();
+				for (int f = 0; f < frames; f++) {
+					if (k == 0) integrateParticles(particles, 0, n, dt);
+					else if (k == 1) addGravityForce(particles, 0, n, g);
+					else addTurbulenceForce(particles, 0, n, tmin, tmax, random);
+				}
+				double seconds = std::max<uint64_t>(1, ofGetElapsedTimeMicros() - t0) / 1e6;
+				double rate = (double)n * frames / seconds;
+
+				bool same = true;
+				if (level == SimdScalar) {
+					scalarRate[k] = rate;
+					reference[k] = particles;
+				}
+				else {
+					same = particles.px == reference[k].px && particles.vy == reference[k].vy &&
+						particles.fx == reference[k].fx && particles.fz == reference[k].fz;
+				}
+				cout << " " << kernelNames[k] << " " << rate / 1e6 << " (" << rate / scalarRate[k] << "x)"
+					<< (same ? "" : " RESULTS DIFFER");
+			}
+			cout << endl;
+		}
+		setSimdLevel(detected);
+	}
+}
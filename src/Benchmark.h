@@ -0,0 +1,60 @@
+#pragma once
+//
+//  Benchmarks for the terrain spatial index and particle systems.
+//  Results are printed to the console (run from ofApp with the 'P' key).
+//
+
+#include "ofMain.h"
+#include "Octree.h"
+#include "LinearOctree.h"
+#include "Bvh.h"
+#include "HeightField.h"
+#include "ParticleSystem.h"
+#include "FusedParticleSystem.h"
+
+// random straight down rays and lander sized boxes spread over the terrain
+//
+void makeTerrainRays(const Box & bounds, int count, vector<Ray> & raysRtn);
+void makeTerrainBoxes(const Box & bounds, int count, float size, vector<Box> & boxesRtn);
+
+// fans of 64 rays (an 8 x 8 cone) cast down from random points above the terrain
+//
+void makeSensorRays(const Box & bounds, int count, vector<Ray> & raysRtn);
+
+// random height field point cloud over a 200 x 200 area
+//
+ofMesh makeHeightFieldMesh(int numVertices);
+
+// the same height field as an indexed n x n grid of triangles
+//
+ofMesh makeTerrainGridMesh(int n);
+
+// n particles with random positions and velocities over the same area,
+// that never expire
+//
+vector<Particle> makeParticles(int n);
+
+size_t octreeMemoryBytes(const TreeNode & node);
+int octreeNodeCount(const TreeNode & node);
+
+void benchmarkOctreeBuild(const ofMesh & mesh, int numLevels);
+void benchmarkOctreeStrategies(int numLevels);
+void benchmarkSimdTraversal(Octree & octree, const Octree & faceOctree, const LinearOctree & linear, int numQueries);
+void benchmarkBatchQueries(const Octree & faceOctree, int numQueries);
+void benchmarkTerrainIndexes(const ofMesh & mesh, int numLevels, int numQueries);
+void benchmarkOctreeUpdate(int gridSize, int numLevels);
+void benchmarkOctreeLevels(const ofMesh & mesh, int numQueries);
+void benchmarkNearestQueries(const Octree & faceOctree, const LinearOctree & linearFaceOctree, int numQueries);
+void benchmarkSweepQueries(const LinearOctree & linearOctree, const LinearOctree & linearFaceOctree, int numQueries);
+
+// headless correctness checks, false if any case fails
+//
+bool checkTerrainChunks();
+bool checkOctreeLineMeshes();
+bool checkOctreeUpdate();
+void benchmarkHeightField(const LinearOctree & faceOctree, const HeightField & heightField, int numQueries);
+void benchmarkOctreeLayouts(Octree & octree, const LinearOctree & linear, int numQueries);
+void benchmarkParticleLayouts(const vector<int> & counts);
+void benchmarkParticleThreads(const vector<int> & counts, int maxThreads);
+void benchmarkParticleFusion(const vector<int> & counts);
+void benchmarkParticleKernels(const vector<int> & counts);
@@ -0,0 +1,342 @@
+//--------------------------------------------------------------
+//
+//  Bounding volume hierarchy over the terrain triangles.
+//
+//  See Bvh.h
+//
+
+#include "Bvh.h"
+#include <algorithm>
+
+// relative cost of visiting a node vs testing one triangle
+//
+static const float TRAVERSAL_COST = 1.0f;
+
+static float surfaceArea(const Vector3 & min, const Vector3 & max) {
+	Vector3 d = max - min;
+	return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+static Vector3 minOf(const Vector3 & a, const Vector3 & b) {
+	return Vector3(std::min(a.x(), b.x()), std::min(a.y(), b.y()), std::min(a.z(), b.z()));
+}
+
+static Vector3 maxOf(const Vector3 & a, const Vector3 & b) {
+	return Vector3(std::max(a.x(), b.x()), std::max(a.y(), b.y()), std::max(a.z(), b.z()));
+}
+
+static void growBounds(Vector3 & min, Vector3 & max, const Box & b) {
+	min = minOf(min, b.parameters[0]);
+	max = maxOf(max, b.parameters[1]);
+}
+
+void Bvh::clear() {
+	nodes.clear();
+	faces.clear();
+	depth = 0;
+	parents.clear();
+	faceLeaf.clear();
+	vertexFaceStart.clear();
+	vertexFaces.clear();
+}
+
+void Bvh::create(const ofMesh & geo) {
+	float startTime = ofGetElapsedTimeMillis();
+
+	clear();
+	mesh = geo;
+	int numFaces = Octree::meshFaceCount(mesh);
+	if (numFaces == 0) return;
+
+	// bounds and centroid of every triangle, indexed by face
+	//
+	vector<Box> faceBounds(numFaces);
+	vector<Vector3> centroids(numFaces);
+	for (int f = 0; f < numFaces; f++) {
+		Vector3 p[3];
+		Octree::getFaceVertices(mesh, f, p);
+		Vector3 min = minOf(p[0], minOf(p[1], p[2]));
+		Vector3 max = maxOf(p[0], maxOf(p[1], p[2]));
+		faceBounds[f] = Box(min, max);
+		centroids[f] = (min + max) * 0.5;
+		faces.push_back(f);
+	}
+
+	// a guess: a binary tree with MAX_LEAF_FACES faces per leaf has about
+	// 2n / MAX_LEAF_FACES nodes.  SAH leaves can hold fewer faces, and the
+	// array simply grows past the guess then.
+	//
+	nodes.reserve(2 * numFaces / MAX_LEAF_FACES + 1);
+	nodes.push_back(BvhNode());
+	nodes[0].first = 0;
+	nodes[0].count = numFaces;
+	subdivide(0, faceBounds, centroids, 0);
+	nodes.shrink_to_fit();
+
+	float totalTime = ofGetElapsedTimeMillis() - startTime;
+	cout << "Time to build bvh: " << totalTime << " ms (" << numNodes() << " nodes, depth " << depth << ")" << endl;
+}
+
+void Bvh::setBounds(int n, const vector<Box> & faceBounds) {
+	BvhNode & node = nodes[n];
+	Vector3 min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = node.first; i < node.first + node.count; i++)
+		growBounds(min, max, faceBounds[faces[i]]);
+	for (int a = 0; a < 3; a++) {
+		node.min[a] = min[a];
+		node.max[a] = max[a];
+	}
+}
+
+// split a leaf in two at the cheapest of the NUM_BINS - 1 bin boundaries
+// on each axis, or keep it a leaf if no split is cheaper than testing
+// all of its faces.
+//
+void Bvh::subdivide(int n, vector<Box> & faceBounds, vector<Vector3> & centroids, int level) {
+	setBounds(n, faceBounds);
+	if (level > depth) depth = level;
+
+	int first = nodes[n].first;
+	int count = nodes[n].count;
+	if (count <= MAX_LEAF_FACES || level >= MAX_DEPTH - 1) return;
+
+	// centroid bounds, the bins span these
+	//
+	Vector3 cMin(FLT_MAX, FLT_MAX, FLT_MAX), cMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = first; i < first + count; i++) {
+		cMin = minOf(cMin, centroids[faces[i]]);
+		cMax = maxOf(cMax, centroids[faces[i]]);
+	}
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestSplit = 0;
+	for (int a = 0; a < 3; a++) {
+		float extent = cMax[a] - cMin[a];
+		if (extent <= 0) continue;
+
+		int binCount[NUM_BINS] = { 0 };
+		Vector3 binMin[NUM_BINS], binMax[NUM_BINS];
+		for (int b = 0; b < NUM_BINS; b++) {
+			binMin[b] = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+			binMax[b] = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		}
+		float scale = NUM_BINS / extent;
+		for (int i = first; i < first + count; i++) {
+			int f = faces[i];
+			int b = std::min(NUM_BINS - 1, (int)((centroids[f][a] - cMin[a]) * scale));
+			binCount[b]++;
+			growBounds(binMin[b], binMax[b], faceBounds[f]);
+		}
+
+		// sweep from the right to get the cost of everything above each
+		// boundary, then from the left to evaluate each split
+		//
+		float rightArea[NUM_BINS];
+		int rightCount[NUM_BINS];
+		Vector3 min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		int sum = 0;
+		for (int b = NUM_BINS - 1; b > 0; b--) {
+			if (binCount[b]) growBounds(min, max, Box(binMin[b], binMax[b]));
+			sum += binCount[b];
+			rightCount[b] = sum;
+			rightArea[b] = sum ? surfaceArea(min, max) : 0;
+		}
+		min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+		max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		sum = 0;
+		for (int b = 0; b < NUM_BINS - 1; b++) {
+			if (binCount[b]) growBounds(min, max, Box(binMin[b], binMax[b]));
+			sum += binCount[b];
+			if (sum == 0 || rightCount[b + 1] == 0) continue;
+			float cost = sum * surfaceArea(min, max) + rightCount[b + 1] * rightArea[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = a;
+				bestSplit = b + 1;
+			}
+		}
+	}
+
+	// compare against leaving the faces in a leaf (both in units of the
+	// node's surface area)
+	//
+	const BvhNode & node = nodes[n];
+	float area = surfaceArea(Vector3(node.min[0], node.min[1], node.min[2]),
+		Vector3(node.max[0], node.max[1], node.max[2]));
+	if (bestAxis < 0 || TRAVERSAL_COST * area + bestCost >= count * area) return;
+
+	float scale = NUM_BINS / (cMax[bestAxis] - cMin[bestAxis]);
+	float axisMin = cMin[bestAxis];
+	int * mid = std::partition(&faces[first], &faces[first] + count, [&](int f) {
+		return std::min(NUM_BINS - 1, (int)((centroids[f][bestAxis] - axisMin) * scale)) < bestSplit;
+	});
+	int leftCount = (int)(mid - &faces[first]);
+
+	int left = (int)nodes.size();
+	nodes.push_back(BvhNode());
+	nodes.push_back(BvhNode());
+	nodes[left].first = first;
+	nodes[left].count = leftCount;
+	nodes[left + 1].first = first + leftCount;
+	nodes[left + 1].count = count - leftCount;
+	nodes[n].first = left;
+	nodes[n].count = 0;
+
+	subdivide(left, faceBounds, centroids, level + 1);
+	subdivide(left + 1, faceBounds, centroids, level + 1);
+}
+
+// children always come after their parent, so going through the nodes
+// to refit from the back sees every child before its parent
+//
+void Bvh::refit(const vector<int> & vertices, const vector<glm::vec3> & positions) {
+	for (int i = 0; i < vertices.size(); i++)
+		mesh.setVertex(vertices[i], positions[i]);
+	if (nodes.empty()) return;
+
+	if (parents.empty()) {
+		parents.assign(nodes.size(), -1);
+		faceLeaf.assign(Octree::meshFaceCount(mesh), -1);
+		for (int n = 0; n < nodes.size(); n++) {
+			if (nodes[n].count > 0) {
+				for (int i = nodes[n].first; i < nodes[n].first + nodes[n].count; i++) faceLeaf[faces[i]] = n;
+			}
+			else parents[nodes[n].first] = parents[nodes[n].first + 1] = n;
+		}
+		Octree::vertexFaceTable(mesh, vertexFaceStart, vertexFaces);
+	}
+
+	// the leaves of the moved faces and everything above them
+	//
+	vector<int> refitNodes;
+	for (int i = 0; i < vertices.size(); i++) {
+		int v = vertices[i];
+		for (int k = vertexFaceStart[v]; k < vertexFaceStart[v + 1]; k++) {
+			for (int n = faceLeaf[vertexFaces[k]]; n >= 0; n = parents[n]) refitNodes.push_back(n);
+		}
+	}
+	sort(refitNodes.begin(), refitNodes.end(), std::greater<int>());
+	refitNodes.erase(unique(refitNodes.begin(), refitNodes.end()), refitNodes.end());
+
+	for (int r = 0; r < refitNodes.size(); r++) {
+		int n = refitNodes[r];
+		BvhNode & node = nodes[n];
+		Vector3 min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				Vector3 p[3];
+				Octree::getFaceVertices(mesh, faces[i], p);
+				min = minOf(min, minOf(p[0], minOf(p[1], p[2])));
+				max = maxOf(max, maxOf(p[0], maxOf(p[1], p[2])));
+			}
+		}
+		else {
+			for (int c = node.first; c < node.first + 2; c++)
+				growBounds(min, max, getBox(c));
+		}
+		for (int a = 0; a < 3; a++) {
+			node.min[a] = min[a];
+			node.max[a] = max[a];
+		}
+	}
+}
+
+Box Bvh::getBox(int n) const {
+	const BvhNode & node = nodes[n];
+	return Box(Vector3(node.min[0], node.min[1], node.min[2]), Vector3(node.max[0], node.max[1], node.max[2]));
+}
+
+void Bvh::getItems(int n, const int *& itemsRtn, int & countRtn) const {
+	itemsRtn = faces.data() + nodes[n].first;
+	countRtn = nodes[n].count;
+}
+
+size_t Bvh::memoryBytes() const {
+	return nodes.capacity() * sizeof(BvhNode) + faces.capacity() * sizeof(int);
+}
+
+// slab test, returns the entry distance or FLT_MAX on a miss
+//
+float Bvh::rayHitsNode(const Ray & r, int n, float t1) const {
+	const BvhNode & node = nodes[n];
+	float tmin = 0;
+	float tmax = t1;
+	for (int a = 0; a < 3; a++) {
+		float tNear = ((r.sign[a] ? node.max[a] : node.min[a]) - r.origin[a]) * r.inv_direction[a];
+		float tFar = ((r.sign[a] ? node.min[a] : node.max[a]) - r.origin[a]) * r.inv_direction[a];
+		if (tNear > tmin) tmin = tNear;
+		if (tFar < tmax) tmax = tFar;
+		if (tmin > tmax) return FLT_MAX;
+	}
+	return tmin;
+}
+
+// closest triangle along the ray.  The nearer child is visited first and
+// a child is skipped once a hit closer than its entry distance is found.
+//
+bool Bvh::intersect(const Ray & ray, RayHit & hitRtn) const {
+	hitRtn = RayHit();
+	if (nodes.empty() || rayHitsNode(ray, 0, FLT_MAX) == FLT_MAX) return false;
+
+	int stack[MAX_DEPTH];
+	float stackNear[MAX_DEPTH];
+	int top = 0;
+	stack[top] = 0;
+	stackNear[top++] = 0;
+
+	while (top > 0) {
+		top--;
+		int n = stack[top];
+		if (stackNear[top] >= hitRtn.t) continue;
+
+		const BvhNode & node = nodes[n];
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				Vector3 p[3];
+				float t;
+				Octree::getFaceVertices(mesh, faces[i], p);
+				if (Octree::rayIntersectTriangle(ray, p, t) && t < hitRtn.t) {
+					Vector3 hit = ray.origin + ray.direction * t;
+					hitRtn.t = t;
+					hitRtn.index = faces[i];
+					hitRtn.point = ofVec3f(hit.x(), hit.y(), hit.z());
+				}
+			}
+			continue;
+		}
+
+		int left = node.first;
+		float tLeft = rayHitsNode(ray, left, hitRtn.t);
+		float tRight = rayHitsNode(ray, left + 1, hitRtn.t);
+		if (tLeft > tRight) {
+			std::swap(tLeft, tRight);
+			left++;
+			assert(top + 2 <= MAX_DEPTH);
+			if (tRight != FLT_MAX) { stack[top] = left - 1; stackNear[top++] = tRight; }
+			if (tLeft != FLT_MAX) { stack[top] = left; stackNear[top++] = tLeft; }
+		}
+		else {
+			assert(top + 2 <= MAX_DEPTH);
+			if (tRight != FLT_MAX) { stack[top] = left + 1; stackNear[top++] = tRight; }
+			if (tLeft != FLT_MAX) { stack[top] = left; stackNear[top++] = tLeft; }
+		}
+	}
+	return hitRtn.index >= 0;
+}
+
+bool Bvh::intersect(const Box & box, vector<Box> & boxListRtn) const {
+	if (nodes.empty() || !getBox(0).overlap(box)) return false;
+
+	visitLeaves(box, [&](int leaf) { boxListRtn.push_back(getBox(leaf)); });
+	return true;
+}
+
+int Bvh::intersect(const Box & box, int * leavesRtn, int maxLeaves) const {
+	int count = 0;
+	visitLeaves(box, [&](int leaf) {
+		if (count < maxLeaves) leavesRtn[count] = leaf;
+		count++;
+	});
+	return count;
+}
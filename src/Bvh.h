@@ -0,0 +1,109 @@
+//--------------------------------------------------------------
+//
+//  Bounding volume hierarchy over the terrain triangles.
+//
+//  Unlike the octree, which splits space into eight equal boxes
+//  whether there is anything in them or not, each BVH node splits its
+//  triangles in two along the plane with the lowest surface area
+//  heuristic (SAH) cost, so the boxes hug the terrain surface and no
+//  nodes are spent on the empty sky above it.  Split planes are found
+//  by binning triangle centroids into NUM_BINS slots per axis.
+//
+//  Nodes live in one array with the two children of a node adjacent.
+//
+#pragma once
+#include "ofMain.h"
+#include "box.h"
+#include "ray.h"
+#include "Octree.h"
+#include "TerrainIndex.h"
+
+struct BvhNode {
+	float min[3];
+	float max[3];
+	int first;          // leaf: index of first face in faces[], interior: index of left child
+	int count;          // number of faces, 0 for an interior node
+};
+
+class Bvh : public TerrainIndex {
+public:
+	static const int NUM_BINS = 16;
+	static const int MAX_LEAF_FACES = 4;
+
+	// deepest tree we build and can walk with the fixed size traversal stack
+	//
+	static const int MAX_DEPTH = 64;
+
+	void create(const ofMesh & mesh);
+	void clear();
+
+	// terrain edits: move mesh vertices and refit the node boxes around
+	// the faces.  The tree keeps its shape (no faces change leaves), which
+	// is fine for edits as small as a crater.  Only the leaves holding a
+	// face of a moved vertex and their ancestors are refit.
+	//
+	void refit(const vector<int> & vertices, const vector<glm::vec3> & positions);
+
+	bool intersect(const Ray &, RayHit & hitRtn) const override;
+	bool intersect(const Box &, vector<Box> & boxListRtn) const override;
+	int intersect(const Box &, int * leavesRtn, int maxLeaves) const override;
+
+	// call visit(node) for every leaf that overlaps the box, nothing is allocated
+	//
+	template <typename Visitor> void visitLeaves(const Box &, Visitor && visit) const;
+	size_t memoryBytes() const override;
+	const char * name() const override { return "bvh"; }
+
+	int numNodes() const { return (int)nodes.size(); }
+	int maxDepth() const { return depth; }
+	Box getBox(int node) const override;
+	void getItems(int node, const int *& itemsRtn, int & countRtn) const override;
+	const ofMesh & getMesh() const override { return mesh; }
+	bool itemsAreFaces() const override { return true; }
+
+	vector<BvhNode> nodes;
+	vector<int> faces;      // face indices, each leaf owns a range
+	ofMesh mesh;
+
+private:
+	void subdivide(int node, vector<Box> & faceBounds, vector<Vector3> & centroids, int level);
+	void setBounds(int node, const vector<Box> & faceBounds);
+	float rayHitsNode(const Ray &, int node, float t1) const;
+
+	int depth = 0;
+
+	// for refit(), built on the first one: parent of each node, leaf of
+	// each face and the faces using each vertex
+	//
+	vector<int> parents;
+	vector<int> faceLeaf;
+	vector<int> vertexFaceStart;
+	vector<int> vertexFaces;
+};
+
+template <typename Visitor>
+void Bvh::visitLeaves(const Box & box, Visitor && visit) const {
+	if (nodes.empty() || !getBox(0).overlap(box)) return;
+
+	int stack[MAX_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int n = stack[--top];
+		const BvhNode & node = nodes[n];
+		if (node.count > 0) {
+			visit(n);
+			continue;
+		}
+		for (int c = node.first + 1; c >= node.first; c--) {
+			const BvhNode & child = nodes[c];
+			if (child.min[0] <= box.parameters[1].x() && child.max[0] >= box.parameters[0].x() &&
+				child.min[1] <= box.parameters[1].y() && child.max[1] >= box.parameters[0].y() &&
+				child.min[2] <= box.parameters[1].z() && child.max[2] >= box.parameters[0].z()) {
+				assert(top < MAX_DEPTH);
+				stack[top++] = c;
+			}
+		}
+	}
+}
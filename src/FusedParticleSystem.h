@@ -0,0 +1,243 @@
+#pragma once
+//
+//  Particle system with its forces fixed at compile time.
+//
+//  FusedParticleSystem<Forces...> keeps a tuple of static force types
+//  (StaticGravityForce and friends below) instead of ParticleForce
+//  pointers.  Their apply() calls are inlined into one loop that sums
+//  every force of a particle and integrates it, so a chunk is one pass
+//  over the arrays with no virtual calls.
+//
+//  Everything else is ParticleSystem: emitters, pools, expiry, chunks
+//  and threads work the same, and ParticleForce objects can still be
+//  added with addForce() for forces only known at run time (they are
+//  applied before the static ones).  The static forces draw random
+//  numbers from the same streams as their ParticleForce versions would
+//  in the same position, so both give the same result.
+//
+//  The random numbers of a block of particles are drawn before the loop
+//  over it (draws per particle is a constant of each force), and the one
+//  shot forces are only compiled into the loop used for the step they
+//  fire in, so the loop of every other step has no branches and no calls.
+//
+//  Forces with a SIMD kernel in ParticleKernels.h (kernel = true) have an
+//  applyChunk() that calls it.  When the one shot forces have fired and
+//  all the others have a kernel, a chunk runs the kernels one after the
+//  other and then integrateParticles(), which is the same float
+//  operations in the same order as the fused loop, so it gives the same
+//  result at the SIMD width instead of one particle at a time.
+//
+
+#include "ParticleSystem.h"
+#include "ParticleKernels.h"
+#include <tuple>
+#include <utility>
+
+// f = mg
+//
+class StaticGravityForce {
+public:
+	StaticGravityForce(const ofVec3f & gravity = ofVec3f(0, 0, 0)) : gravity(gravity) {}
+	void apply(float mass, const ParticleRandomBlock &, int, float & fx, float & fy, float & fz) const {
+		fx += gravity.x * mass;
+		fy += gravity.y * mass;
+		fz += gravity.z * mass;
+	}
+	void applyChunk(ParticleStore & particles, int begin, int end, ParticleRandom &) const {
+		addGravityForce(particles, begin, end, gravity);
+	}
+	static constexpr bool applyOnce = false;
+	static constexpr int draws = 0;
+	static constexpr bool kernel = true;
+	bool applied = false;
+	ofVec3f gravity;
+};
+
+// random force in [tmin, tmax)
+//
+class StaticTurbulenceForce {
+public:
+	StaticTurbulenceForce(const ofVec3f & min = ofVec3f(0, 0, 0), const ofVec3f & max = ofVec3f(0, 0, 0)) : tmin(min), tmax(max) {}
+	void apply(float, const ParticleRandomBlock & random, int j, float & fx, float & fy, float & fz) const {
+		fx += random.uniform(0, j, tmin.x, tmax.x);
+		fy += random.uniform(1, j, tmin.y, tmax.y);
+		fz += random.uniform(2, j, tmin.z, tmax.z);
+	}
+	void applyChunk(ParticleStore & particles, int begin, int end, ParticleRandom & random) const {
+		addTurbulenceForce(particles, begin, end, tmin, tmax, random);
+	}
+	static constexpr bool applyOnce = false;
+	static constexpr int draws = 3;
+	static constexpr bool kernel = true;
+	bool applied = false;
+	ofVec3f tmin, tmax;
+};
+
+// one shot push of magnitude in a random direction
+//
+class StaticImpulseRadialForce {
+public:
+	StaticImpulseRadialForce(float magnitude = 0) : magnitude(magnitude) {}
+	void apply(float, const ParticleRandomBlock & random, int j, float & fx, float & fy, float & fz) const {
+		float x = random.uniform(0, j, -1, 1);
+		float y = random.uniform(1, j, -1, 1);
+		float z = random.uniform(2, j, -1, 1);
+		ofVec3f dir = ofVec3f(x, y, z).getNormalized() * magnitude;
+		fx += dir.x;
+		fy += dir.y;
+		fz += dir.z;
+	}
+	static constexpr bool applyOnce = true;
+	static constexpr int draws = 3;
+	static constexpr bool kernel = false;
+	bool applied = false;
+	float magnitude;
+};
+
+// one shot radial push with the vertical force clamped to magnitude / 5
+//
+class StaticRingForce {
+public:
+	StaticRingForce(float magnitude = 0) : magnitude(magnitude) {}
+	void apply(float, const ParticleRandomBlock & random, int j, float & fx, float & fy, float & fz) const {
+		float x = random.uniform(0, j, -1, 1);
+		float y = random.uniform(1, j, -1, 1);
+		float z = random.uniform(2, j, -1, 1);
+		ofVec3f dir = ofVec3f(x, y, z).getNormalized() * magnitude;
+		fx += dir.x;
+		fy += dir.y;
+		fz += dir.z;
+		fy = ofClamp(fy, -magnitude / 5, magnitude / 5);
+	}
+	static constexpr bool applyOnce = true;
+	static constexpr int draws = 3;
+	static constexpr bool kernel = false;
+	bool applied = false;
+	float magnitude;
+};
+
+template <typename... Forces>
+class FusedParticleSystem : public ParticleSystem {
+	static_assert(sizeof...(Forces) > 0, "FusedParticleSystem needs at least one static force");
+public:
+	FusedParticleSystem() {}
+	FusedParticleSystem(const Forces &... forces) : staticForces(forces...) {}
+
+	void reset() override {
+		ParticleSystem::reset();
+		resetStatic(std::index_sequence_for<Forces...>());
+	}
+
+	std::tuple<Forces...> staticForces;
+
+protected:
+	void updateChunk(int chunk, float dt) override;
+	void markApplied() override {
+		ParticleSystem::markApplied();
+		markStatic(std::index_sequence_for<Forces...>());
+	}
+
+private:
+	template <bool OneShots, size_t... I> void fusedChunk(int chunk, float dt, std::index_sequence<I...>);
+	template <size_t I> void kernelForce(int chunk, int begin, int end);
+	template <size_t... I> void kernelForces(int chunk, int begin, int end, std::index_sequence<I...>) {
+		(kernelForce<I>(chunk, begin, end), ...);
+	}
+	static constexpr bool kernels = ((Forces::applyOnce || Forces::kernel) && ...);
+	template <size_t... I> bool steady(std::index_sequence<I...>) const {
+		return ((std::get<I>(staticForces).applied == Forces::applyOnce) && ...);
+	}
+	template <size_t... I> void resetStatic(std::index_sequence<I...>) {
+		((std::get<I>(staticForces).applied = false), ...);
+	}
+	template <size_t... I> void markStatic(std::index_sequence<I...>) {
+		((std::get<I>(staticForces).applied = std::get<I>(staticForces).applied || Forces::applyOnce), ...);
+	}
+};
+
+// run time forces first (the thread safe ones, the rest went over all
+// particles before the chunks), then the kernels or the fused loop
+//
+template <typename... Forces>
+void FusedParticleSystem<Forces...>::updateChunk(int chunk, float dt) {
+	int begin = chunk * CHUNK_SIZE;
+	int end = std::min(begin + CHUNK_SIZE, particles.size());
+	for (int k = 0; k < forces.size(); k++) {
+		if (!forces[k]->applied && forces[k]->threadSafe) {
+			ParticleRandom random(seed, ParticleRandom::streamId(step, k, chunk));
+			forces[k]->updateForces(particles, begin, end, random);
+		}
+	}
+	bool settled = steady(std::index_sequence_for<Forces...>());
+	if (kernels && settled) {
+		kernelForces(chunk, begin, end, std::index_sequence_for<Forces...>());
+		integrate(dt, begin, end);
+	}
+	else if (settled)
+		fusedChunk<false>(chunk, dt, std::index_sequence_for<Forces...>());
+	else
+		fusedChunk<true>(chunk, dt, std::index_sequence_for<Forces...>());
+}
+
+// the static forces take the stream ids after the run time forces, and
+// the integration is the same as ParticleSystem::integrate().
+//
+// OneShots is false once every one shot force has fired and no other
+// force is switched off (steady()): then only the other forces are in
+// the loop, with no test of applied.  Otherwise each force is tested.
+//
+template <typename... Forces>
+template <bool OneShots, size_t... I>
+void FusedParticleSystem<Forces...>::fusedChunk(int chunk, float dt, std::index_sequence<I...>) {
+	static_assert(((Forces::draws <= ParticleRandomBlock::MAX_DRAWS) && ...), "force draws too many random numbers");
+	constexpr bool inLoop[] = { (OneShots || !Forces::applyOnce)... };
+	int begin = chunk * CHUNK_SIZE;
+	int end = std::min(begin + CHUNK_SIZE, particles.size());
+	int first = (int)forces.size();
+	ParticleRandom random[] = { ParticleRandom(seed, ParticleRandom::streamId(step, first + (int)I, chunk))... };
+	bool active[] = { (inLoop[I] && !std::get<I>(staticForces).applied)... };
+	ParticleRandomBlock blocks[sizeof...(Forces)];
+
+	float * px = particles.px.data(), * py = particles.py.data(), * pz = particles.pz.data();
+	float * vx = particles.vx.data(), * vy = particles.vy.data(), * vz = particles.vz.data();
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	const float * mass = particles.mass.data();
+	const float * damping = particles.damping.data();
+	for (int b = begin; b < end; b += ParticleRandomBlock::SIZE) {
+		int n = std::min(ParticleRandomBlock::SIZE, end - b);
+		((active[I] && Forces::draws > 0 ? blocks[I].draw(random[I], n, Forces::draws) : (void)0), ...);
+
+		for (int j = 0; j < n; j++) {
+			int i = b + j;
+			float x = fx[i], y = fy[i], z = fz[i];
+			if constexpr (OneShots)
+				((active[I] ? std::get<I>(staticForces).apply(mass[i], blocks[I], j, x, y, z) : (void)0), ...);
+			else
+				((inLoop[I] ? std::get<I>(staticForces).apply(mass[i], blocks[I], j, x, y, z) : (void)0), ...);
+
+			px[i] += vx[i] * dt;
+			py[i] += vy[i] * dt;
+			pz[i] += vz[i] * dt;
+			float invMass = 1.0f / mass[i];
+			vx[i] = (vx[i] + x * invMass * dt) * damping[i];
+			vy[i] = (vy[i] + y * invMass * dt) * damping[i];
+			vz[i] = (vz[i] + z * invMass * dt) * damping[i];
+			fx[i] = 0;
+			fy[i] = 0;
+			fz[i] = 0;
+		}
+	}
+}
+
+// one force of the kernel path, on the same stream as in the fused loop
+// (the one shot forces have fired, so they are skipped)
+//
+template <typename... Forces>
+template <size_t I>
+void FusedParticleSystem<Forces...>::kernelForce(int chunk, int begin, int end) {
+	using Force = std::tuple_element_t<I, std::tuple<Forces...>>;
+	if constexpr (!Force::applyOnce) {
+		ParticleRandom random(seed, ParticleRandom::streamId(step, (int)forces.size() + (int)I, chunk));
+		std::get<I>(staticForces).applyChunk(particles, begin, end, random);
+	}
+}
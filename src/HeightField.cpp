@@ -0,0 +1,400 @@
+//--------------------------------------------------------------
+//
+//  Height field with a min/max mip pyramid.
+//
+//  See HeightField.h
+//
+
+#include "HeightField.h"
+
+void HeightField::clear() {
+	heights.clear();
+	minHeights.clear();
+	maxHeights.clear();
+	resolution = 0;
+	numBuckets = 0;
+	bucketStart.clear();
+	bucketFaces.clear();
+	filled.clear();
+	vertexFaceStart.clear();
+	vertexFaces.clear();
+}
+
+// corners of a face in samples, its signed area and the samples it may
+// cover (i0 i1 j0 j1).  False for a vertical or degenerate face.
+//
+bool HeightField::faceSamples(const Vector3 p[3], float u[3], float v[3], float & area, int range[4]) const {
+	for (int k = 0; k < 3; k++) {
+		u[k] = (p[k].x() - minX) / cellX;
+		v[k] = (p[k].z() - minZ) / cellZ;
+	}
+	area = (u[1] - u[0]) * (v[2] - v[0]) - (u[2] - u[0]) * (v[1] - v[0]);
+	if (fabs(area) < 1e-12) return false;
+	range[0] = max(0, (int)ceil(min(u[0], min(u[1], u[2]))));
+	range[1] = min(resolution, (int)floor(max(u[0], max(u[1], u[2]))));
+	range[2] = max(0, (int)ceil(min(v[0], min(v[1], v[2]))));
+	range[3] = min(resolution, (int)floor(max(v[0], max(v[1], v[2]))));
+	return true;
+}
+
+// raise the samples of clip (i0 i1 j0 j1) the face covers to its height
+//
+void HeightField::rasterize(const ofMesh & mesh, int f, const int clip[4]) {
+	Vector3 p[3];
+	Octree::getFaceVertices(mesh, f, p);
+	float u[3], v[3], area;
+	int range[4];
+	if (!faceSamples(p, u, v, area, range)) return;
+
+	int n = resolution + 1;
+	const float eps = -1e-5f;
+	for (int j = max(range[2], clip[2]); j <= min(range[3], clip[3]); j++) {
+		for (int i = max(range[0], clip[0]); i <= min(range[1], clip[1]); i++) {
+			float w1 = ((i - u[0]) * (v[2] - v[0]) - (u[2] - u[0]) * (j - v[0])) / area;
+			float w2 = ((u[1] - u[0]) * (j - v[0]) - (i - u[0]) * (v[1] - v[0])) / area;
+			float w0 = 1 - w1 - w2;
+			if (w0 < eps || w1 < eps || w2 < eps) continue;
+			float y = w0 * p[0].y() + w1 * p[1].y() + w2 * p[2].y();
+			if (y > heights[j * n + i]) heights[j * n + i] = y;
+		}
+	}
+}
+
+// min / max of pyramid node i, j of a level: the four corners of a cell on
+// level 0, the 2 x 2 nodes below above that
+//
+void HeightField::reduce(int level, int i, int j) {
+	int size = resolution >> level;
+	if (level == 0) {
+		float a = sample(i, j), b = sample(i + 1, j), c = sample(i, j + 1), d = sample(i + 1, j + 1);
+		minHeights[0][j * size + i] = min(min(a, b), min(c, d));
+		maxHeights[0][j * size + i] = max(max(a, b), max(c, d));
+		return;
+	}
+	const vector<float> & lo = minHeights[level - 1];
+	const vector<float> & hi = maxHeights[level - 1];
+	int c = 2 * j * (2 * size) + 2 * i;
+	minHeights[level][j * size + i] = min(min(lo[c], lo[c + 1]), min(lo[c + 2 * size], lo[c + 2 * size + 1]));
+	maxHeights[level][j * size + i] = max(max(hi[c], hi[c + 1]), max(hi[c + 2 * size], hi[c + 2 * size + 1]));
+}
+
+void HeightField::create(const ofMesh & mesh, int res) {
+	float startTime = ofGetElapsedTimeMillis();
+
+	clear();
+	resolution = 1;
+	while (resolution < res) resolution *= 2;
+
+	Box bounds = Octree::meshBounds(mesh);
+	minX = bounds.parameters[0].x();
+	minZ = bounds.parameters[0].z();
+	cellX = (bounds.parameters[1].x() - minX) / resolution;
+	cellZ = (bounds.parameters[1].z() - minZ) / resolution;
+	if (cellX <= 0) cellX = 1;
+	if (cellZ <= 0) cellZ = 1;
+
+	// rasterize every triangle onto the samples it covers in XZ, keeping
+	// the highest surface, and file it in the buckets of those samples
+	//
+	int n = resolution + 1;
+	heights.assign(n * n, -FLT_MAX);
+	int numFaces = Octree::meshFaceCount(mesh);
+	int all[4] = { 0, resolution, 0, resolution };
+	numBuckets = resolution / BUCKET_SAMPLES + 1;
+	bucketStart.assign(numBuckets * numBuckets + 1, 0);
+	vector<int> faceRanges(4 * numFaces, 0);
+	for (int f = 0; f < numFaces; f++) {
+		rasterize(mesh, f, all);
+		Vector3 p[3];
+		Octree::getFaceVertices(mesh, f, p);
+		float u[3], v[3], area;
+		int * range = &faceRanges[4 * f];
+		if (!faceSamples(p, u, v, area, range) || range[0] > range[1] || range[2] > range[3]) {
+			range[0] = range[2] = 1;
+			range[1] = range[3] = 0;
+			continue;
+		}
+		for (int bj = range[2] / BUCKET_SAMPLES; bj <= range[3] / BUCKET_SAMPLES; bj++)
+			for (int bi = range[0] / BUCKET_SAMPLES; bi <= range[1] / BUCKET_SAMPLES; bi++) bucketStart[bj * numBuckets + bi + 1]++;
+	}
+	for (int b = 0; b < numBuckets * numBuckets; b++) bucketStart[b + 1] += bucketStart[b];
+	bucketFaces.resize(bucketStart.back());
+	vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+	for (int f = 0; f < numFaces; f++) {
+		const int * range = &faceRanges[4 * f];
+		if (range[0] > range[1]) continue;
+		for (int bj = range[2] / BUCKET_SAMPLES; bj <= range[3] / BUCKET_SAMPLES; bj++)
+			for (int bi = range[0] / BUCKET_SAMPLES; bi <= range[1] / BUCKET_SAMPLES; bi++) bucketFaces[fill[bj * numBuckets + bi]++] = f;
+	}
+
+	// a mesh without faces: splat its vertices onto the nearest sample
+	//
+	if (numFaces == 0) {
+		for (int k = 0; k < mesh.getNumVertices(); k++) {
+			glm::vec3 p = mesh.getVertex(k);
+			int i = (int)((p.x - minX) / cellX + 0.5f);
+			int j = (int)((p.z - minZ) / cellZ + 0.5f);
+			if (i >= 0 && i < n && j >= 0 && j < n && p.y > heights[j * n + i]) heights[j * n + i] = p.y;
+		}
+	}
+
+	// samples no triangle covers (holes, the corners of a round terrain)
+	// take the height of a covered neighbour, growing in from the edges
+	//
+	filled.assign(n * n, 0);
+	for (int k = 0; k < heights.size(); k++) filled[k] = heights[k] == -FLT_MAX;
+	for (bool missing = true; missing; ) {
+		missing = false;
+		vector<float> filled = heights;
+		bool changed = false;
+		for (int j = 0; j < n; j++) {
+			for (int i = 0; i < n; i++) {
+				if (heights[j * n + i] != -FLT_MAX) continue;
+				float sum = 0;
+				int count = 0;
+				if (i > 0 && heights[j * n + i - 1] != -FLT_MAX) { sum += heights[j * n + i - 1]; count++; }
+				if (i < n - 1 && heights[j * n + i + 1] != -FLT_MAX) { sum += heights[j * n + i + 1]; count++; }
+				if (j > 0 && heights[(j - 1) * n + i] != -FLT_MAX) { sum += heights[(j - 1) * n + i]; count++; }
+				if (j < n - 1 && heights[(j + 1) * n + i] != -FLT_MAX) { sum += heights[(j + 1) * n + i]; count++; }
+				if (count) {
+					filled[j * n + i] = sum / count;
+					changed = true;
+				}
+				else missing = true;
+			}
+		}
+		heights.swap(filled);
+		if (!changed) {
+			// nothing to grow from, flat at the bottom of the mesh
+			//
+			for (int k = 0; k < heights.size(); k++)
+				if (heights[k] == -FLT_MAX) heights[k] = bounds.parameters[0].y();
+			break;
+		}
+	}
+
+	// pyramid: cell min / max from its four corners, then 2 x 2 reduction
+	//
+	for (int size = resolution, level = 0; size >= 1; size /= 2, level++) {
+		minHeights.push_back(vector<float>(size * size));
+		maxHeights.push_back(vector<float>(size * size));
+		for (int j = 0; j < size; j++)
+			for (int i = 0; i < size; i++) reduce(level, i, j);
+	}
+
+	float totalTime = ofGetElapsedTimeMillis() - startTime;
+	cout << "Time to build height field: " << totalTime << " ms (" << n << " x " << n << ", "
+		<< numLevels() << " levels)" << endl;
+}
+
+void HeightField::update(const ofMesh & mesh, const vector<int> & vertices) {
+	if (heights.empty() || vertices.empty()) return;
+	if (bucketFaces.empty()) {
+		create(mesh, resolution);
+		return;
+	}
+	if (vertexFaceStart.empty()) Octree::vertexFaceTable(mesh, vertexFaceStart, vertexFaces);
+
+	// the samples under the faces using the vertices
+	//
+	int region[4] = { resolution + 1, -1, resolution + 1, -1 };
+	for (int k = 0; k < vertices.size(); k++) {
+		int v = vertices[k];
+		for (int i = vertexFaceStart[v]; i < vertexFaceStart[v + 1]; i++) {
+			Vector3 p[3];
+			Octree::getFaceVertices(mesh, vertexFaces[i], p);
+			float u[3], w[3], area;
+			int range[4];
+			if (!faceSamples(p, u, w, area, range)) continue;
+			region[0] = min(region[0], range[0]);
+			region[1] = max(region[1], range[1]);
+			region[2] = min(region[2], range[2]);
+			region[3] = max(region[3], range[3]);
+		}
+	}
+	if (region[0] > region[1] || region[2] > region[3]) return;
+
+	// a filled in sample next to the region may take its height from it
+	//
+	int n = resolution + 1;
+	for (int j = max(0, region[2] - 1); j <= min(resolution, region[3] + 1); j++) {
+		for (int i = max(0, region[0] - 1); i <= min(resolution, region[1] + 1); i++) {
+			if (filled[j * n + i]) {
+				create(mesh, resolution);
+				return;
+			}
+		}
+	}
+
+	for (int j = region[2]; j <= region[3]; j++)
+		for (int i = region[0]; i <= region[1]; i++) heights[j * n + i] = -FLT_MAX;
+	for (int bj = region[2] / BUCKET_SAMPLES; bj <= region[3] / BUCKET_SAMPLES; bj++) {
+		for (int bi = region[0] / BUCKET_SAMPLES; bi <= region[1] / BUCKET_SAMPLES; bi++) {
+			int b = bj * numBuckets + bi;
+			for (int k = bucketStart[b]; k < bucketStart[b + 1]; k++) rasterize(mesh, bucketFaces[k], region);
+		}
+	}
+	for (int j = region[2]; j <= region[3]; j++) {
+		for (int i = region[0]; i <= region[1]; i++) {
+			if (heights[j * n + i] == -FLT_MAX) {
+				create(mesh, resolution);
+				return;
+			}
+		}
+	}
+
+	// the cells with a corner in the region, then their ancestors
+	//
+	int i0 = max(0, region[0] - 1), i1 = min(resolution - 1, region[1]);
+	int j0 = max(0, region[2] - 1), j1 = min(resolution - 1, region[3]);
+	for (int level = 0; level < numLevels(); level++) {
+		for (int j = j0; j <= j1; j++)
+			for (int i = i0; i <= i1; i++) reduce(level, i, j);
+		i0 /= 2; i1 /= 2; j0 /= 2; j1 /= 2;
+	}
+}
+
+size_t HeightField::memoryBytes() const {
+	size_t bytes = heights.size() * sizeof(float);
+	for (int l = 0; l < minHeights.size(); l++)
+		bytes += (minHeights[l].size() + maxHeights[l].size()) * sizeof(float);
+	return bytes;
+}
+
+bool HeightField::heightAt(float x, float z, float & heightRtn) const {
+	if (heights.empty()) return false;
+	float u = (x - minX) / cellX;
+	float v = (z - minZ) / cellZ;
+	if (u < 0 || v < 0 || u > resolution || v > resolution) return false;
+	int i = min((int)u, resolution - 1);
+	int j = min((int)v, resolution - 1);
+	float fu = u - i;
+	float fv = v - j;
+	heightRtn = (sample(i, j) * (1 - fu) + sample(i + 1, j) * fu) * (1 - fv) +
+		(sample(i, j + 1) * (1 - fu) + sample(i + 1, j + 1) * fu) * fv;
+	return true;
+}
+
+bool HeightField::agl(const ofVec3f & p, float & aglRtn) const {
+	float h;
+	if (!heightAt(p.x, p.z, h)) return false;
+	aglRtn = p.y - h;
+	return true;
+}
+
+// t range over which the ray is inside a node's XZ footprint
+//
+bool HeightField::nodeRange(const Ray & ray, int level, int x, int z, float & t0, float & t1) const {
+	float lo[2] = { minX + (x << level) * cellX, minZ + (z << level) * cellZ };
+	float hi[2] = { lo[0] + (1 << level) * cellX, lo[1] + (1 << level) * cellZ };
+	int axis[2] = { 0, 2 };
+	for (int a = 0; a < 2; a++) {
+		float o = ray.origin[axis[a]];
+		float d = ray.direction[axis[a]];
+		if (d == 0) {
+			if (o < lo[a] || o > hi[a]) return false;
+			continue;
+		}
+		float ta = (lo[a] - o) / d;
+		float tb = (hi[a] - o) / d;
+		if (ta > tb) swap(ta, tb);
+		if (ta > t0) t0 = ta;
+		if (tb < t1) t1 = tb;
+	}
+	return t0 <= t1;
+}
+
+// exact hit with one cell's bilinear patch.  Along the ray the patch height
+// is quadratic in t, so the crossing is a root of a*t^2 + b*t + c.
+//
+bool HeightField::hitCell(const Ray & ray, int x, int z, float t0, float t1, RayHit & hitRtn) const {
+	float h00 = sample(x, z), h10 = sample(x + 1, z), h01 = sample(x, z + 1), h11 = sample(x + 1, z + 1);
+	float u0 = (ray.origin.x() - minX) / cellX - x, du = ray.direction.x() / cellX;
+	float v0 = (ray.origin.z() - minZ) / cellZ - z, dv = ray.direction.z() / cellZ;
+
+	// h(u, v) = h00 + (h10 - h00) u + (h01 - h00) v + k u v
+	//
+	float k = h00 - h10 - h01 + h11;
+	float hu = h10 - h00, hv = h01 - h00;
+	float a = k * du * dv;
+	float b = hu * du + hv * dv + k * (u0 * dv + v0 * du) - ray.direction.y();
+	float c = h00 + hu * u0 + hv * v0 + k * u0 * v0 - ray.origin.y();
+	auto f = [&](float t) { return (a * t + b) * t + c; };     // surface minus ray height
+
+	float t;
+	if (f(t0) >= 0) t = t0;          // already at or below the surface entering the cell
+	else {
+		float roots[2];
+		int count = 0;
+		if (fabs(a) < 1e-12f) {
+			if (b != 0) roots[count++] = -c / b;
+		}
+		else {
+			float disc = b * b - 4 * a * c;
+			if (disc < 0) return false;
+			float s = sqrt(disc);
+			float q = -0.5f * (b + (b < 0 ? -s : s));     // stable form
+			roots[count++] = q / a;
+			if (q != 0) roots[count++] = c / q;
+			if (count == 2 && roots[1] < roots[0]) swap(roots[0], roots[1]);
+		}
+		t = FLT_MAX;
+		for (int r = 0; r < count; r++) {
+			if (roots[r] >= t0 && roots[r] <= t1) {
+				t = roots[r];
+				break;
+			}
+		}
+		if (t == FLT_MAX) return false;
+	}
+	if (t >= hitRtn.t) return false;
+
+	Vector3 hit = ray.origin + ray.direction * t;
+	hitRtn.t = t;
+	hitRtn.index = z * resolution + x;
+	hitRtn.point = ofVec3f(hit.x(), hit.y(), hit.z());
+	return true;
+}
+
+// descend the pyramid front to back.  A node is skipped when the ray stays
+// above its max height over the node's footprint.
+//
+bool HeightField::march(const Ray & ray, int level, int x, int z, float t0, float t1, RayHit & hitRtn) const {
+	if (!nodeRange(ray, level, x, z, t0, t1)) return false;
+
+	int size = resolution >> level;
+	float y0 = ray.origin.y() + ray.direction.y() * t0;
+	float y1 = ray.origin.y() + ray.direction.y() * t1;
+	if (min(y0, y1) > maxHeights[level][z * size + x]) return false;
+	if (level == 0) return hitCell(ray, x, z, t0, t1, hitRtn);
+
+	// children nearest the ray origin first.  A ray crosses at most three
+	// of the four, and never both of the middle ones.
+	//
+	int firstX = ray.direction.x() < 0 ? 1 : 0;
+	int firstZ = ray.direction.z() < 0 ? 1 : 0;
+	int order[4][2] = { { firstX, firstZ }, { 1 - firstX, firstZ }, { firstX, 1 - firstZ }, { 1 - firstX, 1 - firstZ } };
+	for (int c = 0; c < 4; c++) {
+		if (march(ray, level - 1, 2 * x + order[c][0], 2 * z + order[c][1], t0, t1, hitRtn)) return true;
+	}
+	return false;
+}
+
+bool HeightField::intersect(const Ray & ray, RayHit & hitRtn) const {
+	hitRtn = RayHit();
+	if (heights.empty()) return false;
+
+	// straight down, one lookup
+	//
+	if (ray.direction.x() == 0 && ray.direction.z() == 0) {
+		float h;
+		if (ray.direction.y() >= 0 || !heightAt(ray.origin.x(), ray.origin.z(), h) || ray.origin.y() < h) return false;
+		hitRtn.t = (ray.origin.y() - h) / -ray.direction.y();
+		int i = min((int)((ray.origin.x() - minX) / cellX), resolution - 1);
+		int j = min((int)((ray.origin.z() - minZ) / cellZ), resolution - 1);
+		hitRtn.index = j * resolution + i;
+		hitRtn.point = ofVec3f(ray.origin.x(), h, ray.origin.z());
+		return true;
+	}
+	return march(ray, numLevels() - 1, 0, 0, 0, FLT_MAX, hitRtn);
+}
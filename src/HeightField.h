@@ -0,0 +1,83 @@
+//--------------------------------------------------------------
+//
+//  Height field with a min/max mip pyramid.
+//
+//  The terrain is resampled into a regular grid of heights over XZ
+//  (the highest surface at each sample), and the surface between
+//  samples is the bilinear patch through the four corners of a cell.
+//  Level 0 of the pyramid holds the min and max height of each cell,
+//  every level above the min and max of 2 x 2 nodes below it, so a
+//  ray can skip any node it passes over entirely and only descends
+//  where it comes close to the ground.
+//
+#pragma once
+#include "ofMain.h"
+#include "box.h"
+#include "ray.h"
+#include "Octree.h"
+
+class HeightField {
+public:
+
+	// resample the mesh into (resolution + 1) x (resolution + 1) heights,
+	// resolution is rounded up to a power of two
+	//
+	void create(const ofMesh & mesh, int resolution);
+	void clear();
+
+	// the mesh vertices moved up or down (not in XZ): rasterize the
+	// samples under the faces using them again, and the pyramid nodes above
+	// those.  Only the faces filed in the buckets there are looked at.
+	// Falls back to create() near samples no triangle covers.
+	//
+	void update(const ofMesh & mesh, const vector<int> & vertices);
+	bool isEmpty() const { return heights.empty(); }
+
+	// bilinear height of the surface at x, z.  False outside the grid.
+	//
+	bool heightAt(float x, float z, float & heightRtn) const;
+
+	// height of p above the surface straight below it
+	//
+	bool agl(const ofVec3f & p, float & aglRtn) const;
+
+	// first hit of a ray with the surface (index is the cell hit)
+	//
+	bool intersect(const Ray &, RayHit & hitRtn) const;
+
+	int getResolution() const { return resolution; }
+	int numLevels() const { return (int)minHeights.size(); }
+	size_t memoryBytes() const;
+
+	float minX = 0, minZ = 0;
+	float cellX = 1, cellZ = 1;         // size of a cell
+	vector<float> heights;              // (resolution + 1)^2, row major in z
+
+	// per level min / max height of each node, level 0 is the cells
+	//
+	vector<vector<float>> minHeights;
+	vector<vector<float>> maxHeights;
+
+private:
+	float sample(int i, int j) const { return heights[j * (resolution + 1) + i]; }
+	bool faceSamples(const Vector3 p[3], float u[3], float v[3], float & area, int range[4]) const;
+	void rasterize(const ofMesh & mesh, int face, const int clip[4]);
+	void reduce(int level, int i, int j);
+	bool march(const Ray &, int level, int x, int z, float t0, float t1, RayHit & hitRtn) const;
+	bool nodeRange(const Ray &, int level, int x, int z, float & t0, float & t1) const;
+	bool hitCell(const Ray &, int x, int z, float t0, float t1, RayHit & hitRtn) const;
+
+	int resolution = 0;
+
+	// faces filed by the BUCKET_SAMPLES x BUCKET_SAMPLES blocks of samples
+	// they cover, samples that were filled in from their neighbours, and
+	// the faces using each vertex, for update()
+	//
+	static const int BUCKET_SAMPLES = 16;
+	int numBuckets = 0;
+	vector<int> bucketStart;
+	vector<int> bucketFaces;
+	vector<unsigned char> filled;
+	vector<int> vertexFaceStart;
+	vector<int> vertexFaces;
+};
@@ -0,0 +1,1139 @@
+//--------------------------------------------------------------
+//
+//  Linear Octree
+//
+//  See LinearOctree.h
+//
+
+#include "LinearOctree.h"
+#include <queue>
+#include "SimdBox.h"
+
+// which of the eight subDivideBox8() slots a child box occupies
+//
+//   slot 0-3 is the ground floor (x,z) = (0,0) (1,0) (1,1) (0,1)
+//   slot 4-7 is the same again one story up in y
+//
+// Compare the centers: a child's center is a quarter of the parent's size
+// away from the parent's, while its corners can be off by a rounding step
+// from the parent's (subDivideBox8() adds and takes away half sizes).
+//
+static int octantOf(const Box & parent, const Box & child) {
+	static const int floorSlot[2][2] = { { 0, 3 }, { 1, 2 } };   // [x][z]
+	Vector3 p = parent.parameters[0] + parent.parameters[1];
+	Vector3 c = child.parameters[0] + child.parameters[1];
+	int x = c.x() > p.x() ? 1 : 0;
+	int y = c.y() > p.y() ? 1 : 0;
+	int z = c.z() > p.z() ? 1 : 0;
+	return floorSlot[x][z] + 4 * y;
+}
+
+// arrays in the block are aligned so the SIMD loads never straddle a line
+//
+static const size_t BLOCK_ALIGN = 64;
+static const char BLOCK_MAGIC[8] = "LOCTREE";
+
+static size_t alignUp(size_t n) {
+	return (n + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+}
+
+LinearOctree::LinearOctree(const LinearOctree & other) {
+	*this = other;
+}
+
+// the copy shares a mapped block, or gets its own copy of a built one
+//
+LinearOctree & LinearOctree::operator=(const LinearOctree & other) {
+	if (this == &other) return *this;
+	storage = other.storage;
+	mapping = other.mapping;
+	mesh = other.mesh;
+	colors = other.colors;
+	numThreads = other.numThreads;
+	boundsMargin = other.boundsMargin;
+	vertexFaceStart.clear();
+	vertexFaces.clear();
+	if (mapping) bind(mapping->data(), mapping->size(), mesh);
+	else if (!storage.empty()) bind((const char *)storage.data(), other.blockBytes, mesh);
+	else clear();
+	return *this;
+}
+
+// the node pointers point into storage's heap buffer or the mapping,
+// which both stay where they are when their owners are swapped
+//
+void LinearOctree::swap(LinearOctree & other) {
+	std::swap(minX, other.minX);
+	std::swap(minY, other.minY);
+	std::swap(minZ, other.minZ);
+	std::swap(maxX, other.maxX);
+	std::swap(maxY, other.maxY);
+	std::swap(maxZ, other.maxZ);
+	std::swap(firstChild, other.firstChild);
+	std::swap(childMask, other.childMask);
+	std::swap(pointStart, other.pointStart);
+	std::swap(pointCount, other.pointCount);
+	std::swap(points, other.points);
+	std::swap(bUseFaces, other.bUseFaces);
+	std::swap(numThreads, other.numThreads);
+	std::swap(boundsMargin, other.boundsMargin);
+	std::swap(nodeCount, other.nodeCount);
+	std::swap(pointTotal, other.pointTotal);
+	std::swap(builtLevels, other.builtLevels);
+	std::swap(blockBytes, other.blockBytes);
+	std::swap(mesh, other.mesh);
+	vertexFaceStart.swap(other.vertexFaceStart);
+	vertexFaces.swap(other.vertexFaces);
+	storage.swap(other.storage);
+	mapping.swap(other.mapping);
+	version++;
+	other.version++;
+}
+
+void LinearOctree::clear() {
+	minX = minY = minZ = nullptr;
+	maxX = maxY = maxZ = nullptr;
+	firstChild = nullptr;
+	childMask = nullptr;
+	pointStart = nullptr;
+	pointCount = nullptr;
+	points = nullptr;
+	nodeCount = 0;
+	pointTotal = 0;
+	builtLevels = 0;
+	blockBytes = 0;
+	version++;
+	storage.clear();
+	mapping.reset();
+	vertexFaceStart.clear();
+	vertexFaces.clear();
+}
+
+// point the node arrays into a block, after checking that it is complete
+// and every index in it stays in range: children come after their parent
+// (so there are no cycles) and no deeper than MAX_DEPTH (so the traversal
+// stacks can't overflow), and every item is a vertex or face of geo.
+//
+bool LinearOctree::bind(const char * block, size_t size, const ofMesh & geo) {
+	const LinearOctreeHeader * header = (const LinearOctreeHeader *)block;
+	if (size < sizeof(LinearOctreeHeader) || memcmp(header->magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) != 0 ||
+		header->version != FORMAT_VERSION || header->byteOrder != 0x01020304 || header->totalBytes != size ||
+		header->numNodes <= 0 || header->numPoints < 0 || header->numLevels < 0 || header->numLevels > MAX_DEPTH) {
+		return false;
+	}
+	size_t n = header->numNodes;
+	size_t sizes[11] = { 4 * n, 4 * n, 4 * n, 4 * n, 4 * n, 4 * n, 4 * n, n, 4 * n, 4 * n,
+		4 * (size_t)header->numPoints };
+	for (int i = 0; i < 11; i++) {
+		if (header->offsets[i] % BLOCK_ALIGN != 0 || header->offsets[i] + sizes[i] > size) return false;
+	}
+
+	const float * bx[6];
+	for (int i = 0; i < 6; i++) bx[i] = (const float *)(block + header->offsets[i]);
+	const int * first = (const int *)(block + header->offsets[6]);
+	const unsigned char * mask = (const unsigned char *)(block + header->offsets[7]);
+	const int * start = (const int *)(block + header->offsets[8]);
+	const int * count = (const int *)(block + header->offsets[9]);
+	vector<unsigned char> depth(n, 0);
+	for (size_t i = 0; i < n; i++) {
+		int kids = 0;
+		for (unsigned char m = mask[i]; m; m &= m - 1) kids++;
+		if ((kids > 0) != (first[i] >= 0) || (kids > 0 && first[i] <= (int)i) || first[i] + kids > header->numNodes ||
+			start[i] < 0 || count[i] < 0 || start[i] + count[i] > header->numPoints) {
+			return false;
+		}
+		for (int c = 0; c < kids; c++) {
+			if (depth[i] + 1 > MAX_DEPTH) return false;
+			depth[first[i] + c] = std::max(depth[first[i] + c], (unsigned char)(depth[i] + 1));
+		}
+	}
+	const int * items = (const int *)(block + header->offsets[10]);
+	int itemCount = header->bUseFaces ? Octree::meshFaceCount(geo) : (int)geo.getNumVertices();
+	for (int i = 0; i < header->numPoints; i++) {
+		if (items[i] < 0 || items[i] >= itemCount) return false;
+	}
+
+	minX = bx[0]; minY = bx[1]; minZ = bx[2];
+	maxX = bx[3]; maxY = bx[4]; maxZ = bx[5];
+	firstChild = first;
+	childMask = mask;
+	pointStart = start;
+	pointCount = count;
+	points = items;
+	nodeCount = header->numNodes;
+	pointTotal = header->numPoints;
+	builtLevels = header->numLevels;
+	bUseFaces = header->bUseFaces != 0;
+	blockBytes = size;
+	version++;
+	return true;
+}
+
+void LinearOctree::create(const ofMesh & geo, int numLevels) {
+	Octree octree;
+	octree.bUseFaces = bUseFaces;
+	octree.numThreads = numThreads;
+	octree.boundsMargin = boundsMargin;
+	if (!bUseFaces) octree.buildType = PartitionBuild;
+	octree.create(geo, numLevels);
+	create(octree);
+}
+
+// flatten an Octree breadth first, so that siblings always end up
+// next to each other in the node arrays, then pack the arrays into
+// one block.
+//
+void LinearOctree::create(const Octree & octree) {
+	float startTime = ofGetElapsedTimeMillis();
+
+	clear();
+	mesh = octree.mesh;
+	bUseFaces = octree.bUseFaces;
+
+	NodeArrays arrays;
+	vector<const TreeNode *> queue;
+	queue.push_back(&octree.root);
+	arrays.addNode(octree.root.box);
+
+	for (int n = 0; n < queue.size(); n++) {
+		const TreeNode & node = *queue[n];
+
+		// face trees keep the faces owned by interior nodes too
+		//
+		if (node.children.empty() || bUseFaces) {
+			const int * items;
+			arrays.start[n] = (int)arrays.pts.size();
+			arrays.count[n] = octree.getItems(node, items);
+			arrays.pts.insert(arrays.pts.end(), items, items + arrays.count[n]);
+		}
+		if (node.children.empty()) continue;
+
+		arrays.first[n] = (int)arrays.first.size();
+		for (int i = 0; i < node.children.size(); i++) {
+			arrays.mask[n] |= 1 << octantOf(node.box, node.children[i].box);
+			arrays.addNode(node.children[i].box);
+			queue.push_back(&node.children[i]);
+		}
+	}
+	pack(arrays, octree.builtLevels);
+
+	float totalTime = ofGetElapsedTimeMillis() - startTime;
+	cout << "Time to flatten octree: " << totalTime << " ms (" << numNodes() << " nodes)" << endl;
+}
+
+void LinearOctree::NodeArrays::reserve(int nodes, int items) {
+	for (int a = 0; a < 6; a++) bounds[a].reserve(nodes);
+	first.reserve(nodes);
+	mask.reserve(nodes);
+	start.reserve(nodes);
+	count.reserve(nodes);
+	pts.reserve(items);
+}
+
+void LinearOctree::NodeArrays::addNode(const Box & box) {
+	for (int a = 0; a < 3; a++) {
+		bounds[a].push_back(box.parameters[0][a]);
+		bounds[3 + a].push_back(box.parameters[1][a]);
+	}
+	first.push_back(-1);
+	mask.push_back(0);
+	start.push_back(0);
+	count.push_back(0);
+}
+
+// lay out the block: header, then each array on its own aligned offset,
+// and bind the tree to it.  A block that does not bind is a bug in the
+// layout; the tree is cleared rather than left pointing into it.
+//
+bool LinearOctree::pack(const NodeArrays & arrays, int numLevels) {
+	const void * data[11] = { arrays.bounds[0].data(), arrays.bounds[1].data(), arrays.bounds[2].data(),
+		arrays.bounds[3].data(), arrays.bounds[4].data(), arrays.bounds[5].data(), arrays.first.data(),
+		arrays.mask.data(), arrays.start.data(), arrays.count.data(), arrays.pts.data() };
+	size_t n = arrays.first.size();
+	size_t sizes[11] = { 4 * n, 4 * n, 4 * n, 4 * n, 4 * n, 4 * n, 4 * n, n, 4 * n, 4 * n, 4 * arrays.pts.size() };
+
+	LinearOctreeHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+	header.version = FORMAT_VERSION;
+	header.byteOrder = 0x01020304;
+	header.numNodes = (int)n;
+	header.numPoints = (int)arrays.pts.size();
+	header.numLevels = numLevels;
+	header.bUseFaces = bUseFaces;
+	size_t offset = alignUp(sizeof(header));
+	for (int i = 0; i < 11; i++) {
+		header.offsets[i] = offset;
+		offset = alignUp(offset + sizes[i]);
+	}
+	header.totalBytes = offset;
+
+	storage.assign(offset / sizeof(uint64_t), 0);
+	char * block = (char *)storage.data();
+	memcpy(block, &header, sizeof(header));
+	for (int i = 0; i < 11; i++) {
+		if (sizes[i]) memcpy(block + header.offsets[i], data[i], sizes[i]);
+	}
+	mapping.reset();
+	bool ok = bind(block, offset, mesh);
+	assert(ok);
+	if (!ok) clear();
+	return ok;
+}
+
+// FNV-1a over everything the tree is built from
+//
+uint64_t LinearOctree::cacheKey(const ofMesh & mesh, int numLevels, bool bUseFaces, float boundsMargin) {
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](const void * data, size_t bytes) {
+		const unsigned char * p = (const unsigned char *)data;
+		for (size_t i = 0; i < bytes; i++) {
+			hash ^= p[i];
+			hash *= 1099511628211ULL;
+		}
+	};
+	int numVerts = (int)mesh.getNumVertices();
+	int numIndices = (int)mesh.getNumIndices();
+	int faces = bUseFaces;
+	add(&numVerts, sizeof(numVerts));
+	add(&numLevels, sizeof(numLevels));
+	add(&faces, sizeof(faces));
+	if (boundsMargin != 0) add(&boundsMargin, sizeof(boundsMargin));
+	if (numVerts > 0) add(&mesh.getVertices()[0], numVerts * sizeof(mesh.getVertices()[0]));
+	if (bUseFaces && numIndices > 0) {
+		add(&numIndices, sizeof(numIndices));
+		add(&mesh.getIndices()[0], numIndices * sizeof(mesh.getIndices()[0]));
+	}
+	return hash;
+}
+
+// write the block with the key filled in.  Written to a temporary file
+// first so a crash never leaves a half written cache behind.
+//
+bool LinearOctree::save(const string & path, uint64_t key) const {
+	if (numNodes() == 0) return false;
+	const char * block = isMapped() ? mapping->data() : (const char *)storage.data();
+	LinearOctreeHeader header = *(const LinearOctreeHeader *)block;
+	header.key = key;
+
+	string tmpPath = path + ".tmp";
+	FILE * f = fopen(tmpPath.c_str(), "wb");
+	if (!f) return false;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(block + sizeof(header), blockBytes - sizeof(header), 1, f) == 1;
+	ok = (fclose(f) == 0) && ok;
+
+	// rename() replaces the old file in one step on POSIX, Windows needs
+	// it out of the way first
+	//
+#ifdef _WIN32
+	remove(path.c_str());
+#endif
+	if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool LinearOctree::load(const string & path, uint64_t key, const ofMesh & geo) {
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->open(path) || file->size() < sizeof(LinearOctreeHeader) ||
+		((const LinearOctreeHeader *)file->data())->key != key) {
+		return false;
+	}
+	clear();
+	if (!bind(file->data(), file->size(), geo)) return false;
+	mapping = file;
+	mesh = geo;
+	return true;
+}
+
+bool LinearOctree::createCached(const string & path, const ofMesh & geo, int numLevels) {
+	float startTime = ofGetElapsedTimeMillis();
+	uint64_t key = cacheKey(geo, numLevels, bUseFaces, boundsMargin);
+	if (load(path, key, geo)) {
+		cout << "Loaded octree cache " << path << " in " << ofGetElapsedTimeMillis() - startTime << " ms ("
+			<< numNodes() << " nodes)" << endl;
+		return true;
+	}
+	create(geo, numLevels);
+	if (!save(path, key)) cout << "Could not write octree cache " << path << endl;
+	return false;
+}
+
+int LinearOctree::numChildren(int node) const {
+	int count = 0;
+	for (unsigned char m = childMask[node]; m; m &= m - 1) count++;
+	return count;
+}
+
+Box LinearOctree::getBox(int node) const {
+	return Box(Vector3(minX[node], minY[node], minZ[node]), Vector3(maxX[node], maxY[node], maxZ[node]));
+}
+
+void LinearOctree::getItems(int node, const int *& itemsRtn, int & countRtn) const {
+	itemsRtn = points + pointStart[node];
+	countRtn = pointCount[node];
+}
+
+// same slab test as Box::intersect(), reading the bounds straight out of
+// the node arrays.
+//
+bool LinearOctree::rayHitsNode(const Ray & r, int n, float t0, float t1) const {
+	const float * lo[3] = { &minX[n], &minY[n], &minZ[n] };
+	const float * hi[3] = { &maxX[n], &maxY[n], &maxZ[n] };
+	float tmin = -FLT_MAX;
+	float tmax = FLT_MAX;
+	for (int a = 0; a < 3; a++) {
+		float tNear = ((r.sign[a] ? *hi[a] : *lo[a]) - r.origin[a]) * r.inv_direction[a];
+		float tFar = ((r.sign[a] ? *lo[a] : *hi[a]) - r.origin[a]) * r.inv_direction[a];
+		if (tmin > tFar || tNear > tmax) return false;
+		if (tNear > tmin) tmin = tNear;
+		if (tFar < tmax) tmax = tFar;
+	}
+	return (tmin < t1) && (tmax > t0);
+}
+
+bool LinearOctree::boxOverlapsNode(const Box & b, int n) const {
+	return (minX[n] <= b.parameters[1].x()) && (maxX[n] >= b.parameters[0].x()) &&
+		(minY[n] <= b.parameters[1].y()) && (maxY[n] >= b.parameters[0].y()) &&
+		(minZ[n] <= b.parameters[1].z()) && (maxZ[n] >= b.parameters[0].z());
+}
+
+// copy the bounds of a node's children (adjacent in the arrays) into a Box8
+//
+void LinearOctree::loadChildBoxes(int node, Box8 & boxes) const {
+	int first = firstChild[node];
+	int count = numChildren(node);
+	boxes.count = count;
+	for (int i = 0; i < count; i++) {
+		boxes.minX[i] = minX[first + i];
+		boxes.minY[i] = minY[first + i];
+		boxes.minZ[i] = minZ[first + i];
+		boxes.maxX[i] = maxX[first + i];
+		boxes.maxY[i] = maxY[first + i];
+		boxes.maxZ[i] = maxZ[first + i];
+	}
+}
+
+// Octree::childOctant() of each child of a node
+//
+void LinearOctree::childOctants(int node, int octants[8]) const {
+	int first = firstChild[node];
+	for (int i = 0; i < numChildren(node); i++) {
+		int c = first + i;
+		octants[i] = (minX[c] + maxX[c] > minX[node] + maxX[node] ? 1 : 0) |
+			(minY[c] + maxY[c] > minY[node] + maxY[node] ? 2 : 0) |
+			(minZ[c] + maxZ[c] > minZ[node] + maxZ[node] ? 4 : 0);
+	}
+}
+
+// return the first leaf hit by the ray, the same leaf Octree::intersect()
+// returns.  Children are tested 8 at a time and the ones hit are pushed in
+// reverse so the first child is popped first.
+//
+bool LinearOctree::intersect(const Ray & ray, int & nodeRtn) const {
+	if (numNodes() == 0 || !rayHitsNode(ray, 0, 0, FLT_MAX)) return false;
+
+	int stack[MAX_DEPTH * 8];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int n = stack[--top];
+		if (isLeaf(n)) {
+			nodeRtn = n;
+			return true;
+		}
+
+		Box8 boxes;
+		float tNear[8];
+		loadChildBoxes(n, boxes);
+		int mask = rayIntersectBox8(boxes, ray, 0, FLT_MAX, tNear);
+		for (int i = boxes.count - 1; i >= 0; i--) {
+			if (mask & (1 << i)) {
+				assert(top < MAX_DEPTH * 8);
+				stack[top++] = firstChild[n] + i;
+			}
+		}
+	}
+	return false;
+}
+
+// nearest hit along the ray, with the same rules as Octree::intersect(Ray, RayHit).
+// Children are pushed in reverse Octree::rayOrder() with their entry
+// distance, and skipped when popped if a closer hit has been found in the
+// meantime.
+//
+bool LinearOctree::intersect(const Ray & ray, RayHit & hitRtn) const {
+	QueryCounters counters;
+	counters.boxesTested = 1;
+	hitRtn = RayHit();
+	if (numNodes() == 0 || !rayHitsNode(ray, 0, 0, FLT_MAX)) {
+		if (queryStats && numNodes() > 0) queryStats->add(RayQuery, counters);
+		return false;
+	}
+
+	int stack[MAX_DEPTH * 8];
+	float stackNear[MAX_DEPTH * 8];
+	int top = 0;
+	stack[top] = 0;
+	stackNear[top++] = 0;
+
+	while (top > 0) {
+		top--;
+		int n = stack[top];
+		if (stackNear[top] >= hitRtn.t) continue;
+		if (queryStats) {
+			counters.nodesVisited++;
+			if (isLeaf(n)) counters.leavesReturned++;
+		}
+
+		if (bUseFaces) {
+			for (int i = pointStart[n]; i < pointStart[n] + pointCount[n]; i++) {
+				Vector3 p[3];
+				float t;
+				Octree::getFaceVertices(mesh, points[i], p);
+				if (Octree::rayIntersectTriangle(ray, p, t) && t < hitRtn.t) {
+					Vector3 hit = ray.origin + ray.direction * t;
+					hitRtn.t = t;
+					hitRtn.index = points[i];
+					hitRtn.point = ofVec3f(hit.x(), hit.y(), hit.z());
+				}
+			}
+		}
+		else if (isLeaf(n)) {
+			float best = FLT_MAX;
+			for (int i = pointStart[n]; i < pointStart[n] + pointCount[n]; i++) {
+				ofVec3f v = mesh.getVertex(points[i]);
+				Vector3 d = Vector3(v.x, v.y, v.z) - ray.origin;
+				float dirLen2 = ray.direction * ray.direction;
+				float t = (d * ray.direction) / dirLen2;
+				float dist2 = d * d - t * t * dirLen2;     // squared distance to the ray
+				if (dist2 < best) {
+					best = dist2;
+					hitRtn.t = t;
+					hitRtn.index = points[i];
+					hitRtn.point = v;
+				}
+			}
+			break;
+		}
+		if (isLeaf(n)) continue;
+
+		Box8 boxes;
+		float tNear[8];
+		int octants[8];
+		int order[8];
+		loadChildBoxes(n, boxes);
+		childOctants(n, octants);
+		counters.boxesTested += boxes.count;
+		int count = Octree::rayOrder(ray, rayIntersectBox8(boxes, ray, 0, hitRtn.t, tNear), octants, order);
+		assert(top + count <= MAX_DEPTH * 8);
+		for (int j = count - 1; j >= 0; j--) {
+			stack[top] = firstChild[n] + order[j];
+			stackNear[top++] = tNear[order[j]];
+		}
+	}
+	if (queryStats) queryStats->add(RayQuery, counters);
+	return hitRtn.index >= 0;
+}
+
+bool LinearOctree::closestPoint(const ofVec3f & p, NearestPoint & nearestRtn, float maxDistance) const {
+	vector<NearestPoint> nearestList;
+	nearestRtn = NearestPoint();
+	if (nearest(p, 1, nearestList, maxDistance) == 0) return false;
+	nearestRtn = nearestList[0];
+	return true;
+}
+
+// best first, with the same rules as Octree::nearest()
+//
+int LinearOctree::nearest(const ofVec3f & p, int k, vector<NearestPoint> & nearestRtn, float maxDistance) const {
+	nearestRtn.clear();
+	if (k <= 0 || numNodes() == 0) return 0;
+
+	glm::vec3 q = p;
+	auto bound = [&]() { return nearestRtn.size() == k ? std::min(nearestRtn.back().distance, maxDistance) : maxDistance; };
+
+	QueryCounters counters;
+	counters.boxesTested = 1;
+	typedef pair<float, int> Entry;
+	priority_queue<Entry, vector<Entry>, greater<Entry>> queue;
+	queue.push(Entry(Octree::boxDistance(getBox(0), q), 0));
+	while (!queue.empty()) {
+		Entry entry = queue.top();
+		queue.pop();
+		if (entry.first > bound()) break;
+		int n = entry.second;
+		if (queryStats) {
+			counters.nodesVisited++;
+			if (isLeaf(n)) counters.leavesReturned++;
+			counters.boxesTested += numChildren(n);
+		}
+
+		for (int i = pointStart[n]; i < pointStart[n] + pointCount[n]; i++) {
+			NearestPoint candidate;
+			Octree::itemDistance(mesh, bUseFaces, points[i], q, candidate);
+			if (candidate.distance <= maxDistance) Octree::keepNearest(nearestRtn, k, candidate);
+		}
+		for (int i = 0; i < numChildren(n); i++) {
+			float d = Octree::boxDistance(getBox(firstChild[n] + i), q);
+			if (d <= bound()) queue.push(Entry(d, firstChild[n] + i));
+		}
+	}
+	if (queryStats) queryStats->add(NearestQuery, counters);
+	return (int)nearestRtn.size();
+}
+
+// front to back like intersect(Ray, RayHit), with the ray from the box
+// center and the node boxes grown by its half size
+//
+bool LinearOctree::sweep(const Box & box, const ofVec3f & motion, SweepHit & hitRtn) const {
+	hitRtn = SweepHit();
+	if (numNodes() == 0) return false;
+
+	Vector3 center = (box.parameters[0] + box.parameters[1]) / 2;
+	Ray ray(center, Vector3(motion.x, motion.y, motion.z));
+	glm::vec3 move = motion;
+	QueryCounters counters;
+	counters.boxesTested = 1;
+	Box8 boxes;
+	float tNear[8];
+	int order[8];
+	boxes.count = 1;
+	boxes.set(0, getBox(0));
+	Octree::growBox8(boxes, box);
+	if (!rayIntersectBox8(boxes, ray, 0, 1, tNear)) {
+		if (queryStats) queryStats->add(SweepQuery, counters);
+		return false;
+	}
+
+	int stack[MAX_DEPTH * 8];
+	float stackNear[MAX_DEPTH * 8];
+	int top = 0;
+	stack[top] = 0;
+	stackNear[top++] = tNear[0];
+
+	while (top > 0) {
+		top--;
+		int n = stack[top];
+		if (stackNear[top] > hitRtn.t) continue;
+		if (queryStats) {
+			counters.nodesVisited++;
+			if (isLeaf(n)) counters.leavesReturned++;
+		}
+
+		for (int i = pointStart[n]; i < pointStart[n] + pointCount[n]; i++) {
+			float t;
+			if (Octree::sweepItem(mesh, bUseFaces, points[i], box, move, hitRtn.t, t) && t < hitRtn.t) {
+				hitRtn.t = t;
+				hitRtn.index = points[i];
+				hitRtn.leafBox = getBox(n);
+			}
+		}
+		if (isLeaf(n)) continue;
+
+		loadChildBoxes(n, boxes);
+		Octree::growBox8(boxes, box);
+		counters.boxesTested += boxes.count;
+		int count = sortHitsBox8(rayIntersectBox8(boxes, ray, 0, std::min(hitRtn.t, 1.0f), tNear), tNear, order);
+		assert(top + count <= MAX_DEPTH * 8);
+		for (int j = count - 1; j >= 0; j--) {
+			stack[top] = firstChild[n] + order[j];
+			stackNear[top++] = tNear[order[j]];
+		}
+	}
+	if (queryStats) queryStats->add(SweepQuery, counters);
+	return hitRtn.index >= 0;
+}
+
+// add the box of every leaf that overlaps the query box to boxListRtn
+//
+// all items handed to a node: its own and everything below it
+//
+void LinearOctree::subtreeItems(int node, vector<int> & itemsRtn) const {
+	vector<int> stack(1, node);
+	while (!stack.empty()) {
+		int n = stack.back();
+		stack.pop_back();
+		itemsRtn.insert(itemsRtn.end(), points + pointStart[n], points + pointStart[n] + pointCount[n]);
+		for (int i = numChildren(n) - 1; i >= 0; i--) stack.push_back(firstChild[n] + i);
+	}
+	if (bUseFaces) {
+		sort(itemsRtn.begin(), itemsRtn.end());
+		itemsRtn.erase(unique(itemsRtn.begin(), itemsRtn.end()), itemsRtn.end());
+	}
+}
+
+// the items handed to a node after the edit: the ones it had, less the
+// edits handed to it before, plus the ones handed to it now
+//
+void LinearOctree::editedItems(int node, const vector<OctreeEdit> & edits, const vector<int> & before,
+	const vector<int> & after, vector<int> & itemsRtn) const {
+	vector<int> removed, added;
+	for (int i = 0; i < before.size(); i++) removed.push_back(edits[before[i]].item);
+	for (int i = 0; i < after.size(); i++) added.push_back(edits[after[i]].item);
+	sort(removed.begin(), removed.end());
+	if (node >= 0) subtreeItems(node, itemsRtn);
+	itemsRtn.erase(remove_if(itemsRtn.begin(), itemsRtn.end(),
+		[&](int item) { return binary_search(removed.begin(), removed.end(), item); }), itemsRtn.end());
+	itemsRtn.insert(itemsRtn.end(), added.begin(), added.end());
+	sort(itemsRtn.begin(), itemsRtn.end());
+}
+
+// the subtrees an edit has to rebuild.  before / after index the edits
+// handed to the node before the edit and handed to it now, routed down
+// with the rules of Octree::updateNode(); only children receiving an edit
+// on either side are visited, and a new child is built from the edits it
+// receives.  A node is rebuilt whole when it owns a moved face itself,
+// when it is a leaf that may need splitting, or when it may be down to
+// one item and so has to become a leaf.
+//
+void LinearOctree::findRebuilds(int node, Rebuild & self, Octree & rules, const vector<OctreeEdit> & edits,
+	const vector<int> & before, const vector<int> & after, vector<Rebuild> & rebuildsRtn) const {
+	auto rebuildWhole = [&]() {
+		editedItems(node, edits, before, after, self.items);
+		rebuildsRtn.push_back(self);
+	};
+	if (isLeaf(node)) {
+		if (before != after || pointCount[node] > 1) rebuildWhole();
+		return;
+	}
+
+	vector<Box> subBoxes;
+	rules.subDivideBox8(getBox(node), subBoxes);
+	vector<int> childBefore[8], childAfter[8];
+	for (int side = 0; side < 2; side++) {
+		const vector<int> & which = side ? after : before;
+		for (int i = 0; i < which.size(); i++) {
+			bool keep;
+			int mask = rules.routeEdit(side ? edits[which[i]].after : edits[which[i]].before, subBoxes, keep);
+			if (keep) {
+				rebuildWhole();
+				return;
+			}
+			for (int c = 0; c < 8; c++) {
+				if (mask & (1 << c)) (side ? childAfter : childBefore)[c].push_back(which[i]);
+			}
+		}
+	}
+
+	// a node that lost items: look for two that are still there
+	//
+	if (node != 0 && before != after) {
+		vector<int> removed, added, kept;
+		for (int i = 0; i < before.size(); i++) removed.push_back(edits[before[i]].item);
+		for (int i = 0; i < after.size(); i++) added.push_back(edits[after[i]].item);
+		sort(removed.begin(), removed.end());
+		kept = added;
+		vector<int> stack(1, node);
+		while (!stack.empty() && kept.size() < 2) {
+			int n = stack.back();
+			stack.pop_back();
+			for (int i = pointStart[n]; i < pointStart[n] + pointCount[n] && kept.size() < 2; i++) {
+				if (!binary_search(removed.begin(), removed.end(), points[i]) &&
+					find(kept.begin(), kept.end(), points[i]) == kept.end()) kept.push_back(points[i]);
+			}
+			for (int i = numChildren(n) - 1; i >= 0; i--) stack.push_back(firstChild[n] + i);
+		}
+		if (kept.size() < 2) {
+			rebuildWhole();
+			return;
+		}
+	}
+
+	for (int c = 0, child = firstChild[node]; c < 8; c++) {
+		bool exists = childMask[node] & (1 << c);
+		if (!childBefore[c].empty() || !childAfter[c].empty()) {
+			Rebuild rebuild;
+			rebuild.parent = node;
+			rebuild.slot = c;
+			rebuild.level = self.level + 1;
+			rebuild.box = exists ? getBox(child) : subBoxes[c];
+			if (exists) findRebuilds(child, rebuild, rules, edits, childBefore[c], childAfter[c], rebuildsRtn);
+			else {
+				editedItems(-1, edits, childBefore[c], childAfter[c], rebuild.items);
+				rebuildsRtn.push_back(rebuild);
+			}
+		}
+		if (exists) child++;
+	}
+}
+
+// the rebuilt subtrees, when each has the same children and item counts
+// node for node as the subtree it replaces: write their items over the old
+// ones in the block.  Nothing is written if any differs, or if the block is
+// a mapped cache file.
+//
+bool LinearOctree::patchItems(const vector<Rebuild> & rebuilds, const vector<Octree> & rebuilt, int & touchedRtn) {
+	if (isMapped()) return false;
+	struct Match {
+		int node;
+		const TreeNode * rebuilt;
+		int tree;
+	};
+	vector<Match> matches;
+	for (int r = 0; r < rebuilds.size(); r++) {
+		const Rebuild & rebuild = rebuilds[r];
+		int node = 0;
+		if (rebuild.parent >= 0) {
+			if (!(childMask[rebuild.parent] & (1 << rebuild.slot)) || rebuild.items.empty()) return false;
+			node = firstChild[rebuild.parent];
+			for (int c = 0; c < rebuild.slot; c++)
+				if (childMask[rebuild.parent] & (1 << c)) node++;
+		}
+		vector<Match> stack(1, Match{ node, &rebuilt[r].root, r });
+		while (!stack.empty()) {
+			Match m = stack.back();
+			stack.pop_back();
+			const TreeNode & t = *m.rebuilt;
+			int mask = 0;
+			for (int i = 0; i < t.children.size(); i++) mask |= 1 << octantOf(t.box, t.children[i].box);
+			if (mask != childMask[m.node]) return false;
+			if (isLeaf(m.node) || bUseFaces) {
+				const int * items;
+				if (rebuilt[r].getItems(t, items) != pointCount[m.node]) return false;
+			}
+			matches.push_back(m);
+			for (int i = 0; i < t.children.size(); i++)
+				stack.push_back(Match{ firstChild[m.node] + i, &t.children[i], r });
+		}
+	}
+
+	// points points into storage, which this tree owns
+	//
+	int * items = const_cast<int *>(points);
+	for (int i = 0; i < matches.size(); i++) {
+		const Match & m = matches[i];
+		if (!isLeaf(m.node) && !bUseFaces) continue;
+		const int * from;
+		int count = rebuilt[m.tree].getItems(*m.rebuilt, from);
+		std::copy(from, from + count, items + pointStart[m.node]);
+	}
+	touchedRtn = (int)matches.size();
+	return true;
+}
+
+int LinearOctree::update(const vector<int> & vertices, const vector<glm::vec3> & positions) {
+	return applyEdit(vertices, positions, true);
+}
+
+bool LinearOctree::patch(const vector<int> & vertices, const vector<glm::vec3> & positions) {
+	return applyEdit(vertices, positions, false) >= 0;
+}
+
+// update(), or with relayout false patch(): -1 with the mesh put back if
+// the block would have to be laid out again
+//
+int LinearOctree::applyEdit(const vector<int> & vertices, const vector<glm::vec3> & positions, bool relayout) {
+	float startTime = ofGetElapsedTimeMillis();
+	if (numNodes() == 0 || vertices.empty()) return 0;
+
+	// the edited items: the vertices themselves, or every face using one
+	//
+	vector<int> items;
+	if (!bUseFaces) items = vertices;
+	else {
+		if (vertexFaceStart.empty()) Octree::vertexFaceTable(mesh, vertexFaceStart, vertexFaces);
+		for (int i = 0; i < vertices.size(); i++) {
+			int v = vertices[i];
+			items.insert(items.end(), vertexFaces.begin() + vertexFaceStart[v], vertexFaces.begin() + vertexFaceStart[v + 1]);
+		}
+	}
+	sort(items.begin(), items.end());
+	items.erase(unique(items.begin(), items.end()), items.end());
+
+	vector<OctreeEdit> edits(items.size());
+	for (int i = 0; i < items.size(); i++) {
+		edits[i].item = items[i];
+		if (bUseFaces) Octree::getFaceVertices(mesh, items[i], edits[i].before);
+		else edits[i].before[0] = Vector3(mesh.getVertex(items[i]).x, mesh.getVertex(items[i]).y, mesh.getVertex(items[i]).z);
+	}
+	vector<glm::vec3> old(vertices.size());
+	for (int i = 0; i < vertices.size(); i++) {
+		old[i] = mesh.getVertex(vertices[i]);
+		mesh.setVertex(vertices[i], positions[i]);
+	}
+	auto restore = [&]() {
+		for (int i = (int)vertices.size() - 1; i >= 0; i--)
+			mesh.setVertex(vertices[i], old[i]);
+		return -1;
+	};
+
+	Box rootBox = getBox(0);
+	bool outside = false;
+	for (int i = 0; i < edits.size(); i++) {
+		if (bUseFaces) Octree::getFaceVertices(mesh, items[i], edits[i].after);
+		else edits[i].after[0] = Vector3(mesh.getVertex(items[i]).x, mesh.getVertex(items[i]).y, mesh.getVertex(items[i]).z);
+		if (!rootBox.inside(edits[i].after, bUseFaces ? 3 : 1)) outside = true;
+	}
+	if (outside) {
+		if (!relayout) return restore();
+		ofMesh geo = mesh;
+		create(geo, builtLevels);
+		return -1;
+	}
+
+	// the subtrees to rebuild, each rebuilt with the Octree rules from its
+	// new items
+	//
+	vector<int> all(edits.size());
+	for (int i = 0; i < all.size(); i++) all[i] = i;
+	Octree rules;
+	rules.bUseFaces = bUseFaces;
+	if (!bUseFaces) rules.buildType = PartitionBuild;
+	Rebuild whole;
+	whole.box = rootBox;
+	vector<Rebuild> rebuilds;
+	findRebuilds(0, whole, rules, edits, all, all, rebuilds);
+	sort(rebuilds.begin(), rebuilds.end(),
+		[](const Rebuild & a, const Rebuild & b) { return a.parent * 8 + a.slot < b.parent * 8 + b.slot; });
+
+	vector<Octree> rebuilt(rebuilds.size());
+	for (int r = 0; r < rebuilds.size(); r++) {
+		const Rebuild & rebuild = rebuilds[r];
+		Octree & sub = rebuilt[r];
+		sub.bUseFaces = bUseFaces;
+		sub.root.box = rebuild.box;
+		if (bUseFaces) {
+			sub.root.points = rebuild.items;
+			sort(sub.root.points.begin(), sub.root.points.end());
+			if (rebuild.parent < 0 || sub.root.points.size() > 1) sub.subdivide(mesh, sub.root, builtLevels, rebuild.level);
+		}
+		else {
+			sub.items = rebuild.items;
+			sub.root.end = (int)sub.items.size();
+			if (rebuild.parent < 0 || sub.root.end > 1) sub.subdividePartition(mesh, sub.root, builtLevels, rebuild.level);
+		}
+	}
+
+	int touched = 0;
+	if (patchItems(rebuilds, rebuilt, touched)) {
+		if (bTimingInfo)
+			cout << "Time to patch linear octree: " << ofGetElapsedTimeMillis() - startTime << " ms (" << touched << " nodes)" << endl;
+		return touched;
+	}
+	if (!relayout) return restore();
+
+	// the rebuilt subtree in a slot of a node, if there is one
+	//
+	auto findRebuilt = [&](int parent, int slot) {
+		int key = parent * 8 + slot;
+		int lo = 0, hi = (int)rebuilds.size();
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (rebuilds[mid].parent * 8 + rebuilds[mid].slot < key) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo < rebuilds.size() && rebuilds[lo].parent * 8 + rebuilds[lo].slot == key ? lo : -1;
+	};
+
+	// lay the tree out again breadth first, taking the rebuilt subtrees in
+	// place of the old ones
+	//
+	struct Source {
+		int node;                  // node of this tree, or -1
+		const TreeNode * rebuilt;  // or node of rebuilt[tree]
+		int tree;
+	};
+	vector<bool> hasRebuilds(numNodes(), false);
+	for (int r = 0; r < rebuilds.size(); r++) {
+		if (rebuilds[r].parent >= 0) hasRebuilds[rebuilds[r].parent] = true;
+	}
+	NodeArrays arrays;
+	arrays.reserve(numNodes(), numPoints());
+	vector<Source> queue;
+	queue.reserve(numNodes());
+	int root = findRebuilt(-1, 0);
+	queue.push_back(root < 0 ? Source{ 0, nullptr, -1 } : Source{ -1, &rebuilt[root].root, root });
+	arrays.addNode(rootBox);
+	for (int n = 0; n < queue.size(); n++) {
+		Source from = queue[n];
+		if (from.rebuilt) {
+			const TreeNode & node = *from.rebuilt;
+			touched++;
+			if (node.children.empty() || bUseFaces) {
+				const int * nodeItems;
+				arrays.start[n] = (int)arrays.pts.size();
+				arrays.count[n] = rebuilt[from.tree].getItems(node, nodeItems);
+				arrays.pts.insert(arrays.pts.end(), nodeItems, nodeItems + arrays.count[n]);
+			}
+			if (node.children.empty()) continue;
+			arrays.first[n] = (int)arrays.first.size();
+			for (int i = 0; i < node.children.size(); i++) {
+				arrays.mask[n] |= 1 << octantOf(node.box, node.children[i].box);
+				arrays.addNode(node.children[i].box);
+				queue.push_back(Source{ -1, &node.children[i], from.tree });
+			}
+			continue;
+		}
+
+		int node = from.node;
+		if (isLeaf(node) || bUseFaces) {
+			arrays.start[n] = (int)arrays.pts.size();
+			arrays.count[n] = pointCount[node];
+			arrays.pts.insert(arrays.pts.end(), points + pointStart[node], points + pointStart[node] + pointCount[node]);
+		}
+		if (isLeaf(node)) continue;
+		if (!hasRebuilds[node]) {
+			arrays.first[n] = (int)arrays.first.size();
+			arrays.mask[n] = childMask[node];
+			for (int i = 0; i < numChildren(node); i++) {
+				arrays.addNode(getBox(firstChild[node] + i));
+				queue.push_back(Source{ firstChild[node] + i, nullptr, -1 });
+			}
+			continue;
+		}
+		// first is only set once a child survives, a node whose children
+		// were all dropped is left a leaf
+		//
+		for (int c = 0, child = firstChild[node]; c < 8; c++) {
+			bool exists = childMask[node] & (1 << c);
+			int tree = findRebuilt(node, c);
+			if ((tree >= 0 && !rebuilds[tree].items.empty()) || (tree < 0 && exists)) {
+				if (arrays.first[n] < 0) arrays.first[n] = (int)arrays.first.size();
+			}
+			if (tree >= 0 && !rebuilds[tree].items.empty()) {
+				arrays.mask[n] |= 1 << c;
+				arrays.addNode(rebuilds[tree].box);
+				queue.push_back(Source{ -1, &rebuilt[tree].root, tree });
+			}
+			else if (tree < 0 && exists) {
+				arrays.mask[n] |= 1 << c;
+				arrays.addNode(getBox(child));
+				queue.push_back(Source{ child, nullptr, -1 });
+			}
+			if (exists) child++;
+		}
+	}
+	int levels = builtLevels;
+	if (!pack(arrays, levels)) {
+		ofMesh geo = mesh;
+		create(geo, levels);
+		return -1;
+	}
+
+	if (bTimingInfo)
+		cout << "Time to update linear octree: " << ofGetElapsedTimeMillis() - startTime << " ms (" << touched << " nodes)" << endl;
+	return touched;
+}
+
+// points within the crater radius, pushed down into a bowl
+//
+void LinearOctree::craterEdit(const ofVec3f & center, float radius, float depth,
+	vector<int> & verticesRtn, vector<glm::vec3> & positionsRtn) const {
+	verticesRtn.clear();
+	positionsRtn.clear();
+	if (numNodes() == 0) return;
+	Box region(Vector3(center.x - radius, minY[0], center.z - radius),
+		Vector3(center.x + radius, maxY[0], center.z + radius));
+
+	// the corners of the faces of a face tree, each vertex is shared by
+	// several faces
+	//
+	visitLeaves(region, [&](int leaf) {
+		for (int i = pointStart[leaf]; i < pointStart[leaf] + pointCount[leaf]; i++) {
+			int corners[3] = { points[i], -1, -1 };
+			if (bUseFaces) {
+				bool indexed = mesh.getNumIndices() > 0;
+				for (int k = 0; k < 3; k++) corners[k] = indexed ? mesh.getIndex(3 * points[i] + k) : 3 * points[i] + k;
+			}
+			for (int k = 0; k < 3 && corners[k] >= 0; k++) {
+				glm::vec3 v = mesh.getVertex(corners[k]);
+				float dx = v.x - center.x;
+				float dz = v.z - center.z;
+				float d2 = (dx * dx + dz * dz) / (radius * radius);
+				if (d2 >= 1) continue;
+				verticesRtn.push_back(corners[k]);
+				positionsRtn.push_back(glm::vec3(v.x, v.y - depth * (1 - d2), v.z));
+			}
+		}
+	});
+
+	vector<int> order(verticesRtn.size());
+	for (int i = 0; i < order.size(); i++) order[i] = i;
+	sort(order.begin(), order.end(), [&](int a, int b) { return verticesRtn[a] < verticesRtn[b]; });
+	vector<int> vertices;
+	vector<glm::vec3> positions;
+	for (int i = 0; i < order.size(); i++) {
+		if (i > 0 && verticesRtn[order[i]] == verticesRtn[order[i - 1]]) continue;
+		vertices.push_back(verticesRtn[order[i]]);
+		positions.push_back(positionsRtn[order[i]]);
+	}
+	verticesRtn.swap(vertices);
+	positionsRtn.swap(positions);
+}
+
+bool LinearOctree::intersect(const Box & box, vector<Box> & boxListRtn) const {
+	if (numNodes() == 0 || !boxOverlapsNode(box, 0)) return false;
+
+	QueryCounters counters;
+	counters.boxesTested = 1;
+	visitLeaves(box, [&](int leaf) { boxListRtn.push_back(getBox(leaf)); }, queryStats ? &counters : nullptr);
+	if (queryStats) queryStats->add(BoxQuery, counters);
+	return true;
+}
+
+int LinearOctree::intersect(const Box & box, int * leavesRtn, int maxLeaves) const {
+	QueryCounters counters;
+	counters.boxesTested = 1;
+	int count = 0;
+	visitLeaves(box, [&](int leaf) {
+		if (count < maxLeaves) leavesRtn[count] = leaf;
+		count++;
+	}, queryStats ? &counters : nullptr);
+	if (queryStats && numNodes() > 0) queryStats->add(BoxQuery, counters);
+	return count;
+}
+
+void LinearOctree::draw(int node, int numLevels, int level) const {
+	if (level > numLevels || node >= numNodes()) return;
+
+	// set each level to different color and draw the box
+	//
+	ofSetColor(colors[level % colors.size()]);
+	Octree::drawBox(getBox(node));
+
+	for (int i = 0; i < numChildren(node); i++) {
+		draw(firstChild[node] + i, numLevels, level + 1);
+	}
+}
+
+void LinearOctree::draw(int numLevels) const {
+	if (!lines.matches(version, 0, numLevels, false)) {
+		buildLineMesh(lines.mesh, 0, numLevels, false);
+		lines.setKey(version, 0, numLevels, false);
+	}
+	lines.mesh.draw();
+}
+
+void LinearOctree::drawLeafNodes() const {
+	if (!leafLines.matches(version, 0, INT_MAX, true)) {
+		buildLineMesh(leafLines.mesh, 0, INT_MAX, true);
+		leafLines.setKey(version, 0, INT_MAX, true);
+	}
+	leafLines.mesh.draw();
+}
+
+// same boxes and colors as Octree::buildLineMesh()
+//
+void LinearOctree::buildLineMesh(ofMesh & meshRtn, int minLevel, int maxLevel, bool leavesOnly) const {
+	meshRtn.clear();
+	meshRtn.setMode(OF_PRIMITIVE_LINES);
+	if (numNodes() == 0) return;
+
+	vector<pair<int, int>> stack = { { 0, 0 } };
+	while (!stack.empty()) {
+		int node = stack.back().first;
+		int level = stack.back().second;
+		stack.pop_back();
+		if (level > maxLevel) continue;
+		bool leaf = isLeaf(node);
+		if (level >= minLevel && (!leavesOnly || leaf))
+			OctreeLineMesh::addBox(meshRtn, getBox(node), leavesOnly ? colors.back() : colors[level % colors.size()]);
+		for (int i = numChildren(node) - 1; i >= 0; i--)
+			stack.push_back({ firstChild[node] + i, level + 1 });
+	}
+}
@@ -0,0 +1,253 @@
+//--------------------------------------------------------------
+//
+//  Linear Octree
+//
+//  Flat, pointer-free layout of an Octree.  All nodes live in one
+//  contiguous array in breadth-first order, so the children of a
+//  node are always adjacent and can be found from the index of the
+//  first child and an 8 bit mask of which octants are occupied.
+//  Node bounds are kept in structure-of-arrays form so a traversal
+//  only touches the data it actually tests.
+//
+//  Everything lives in a single relocatable block (a header followed
+//  by the arrays, addressed by offset), which is also the on-disk
+//  cache format: save() writes the block as is and load() memory maps
+//  it and uses it in place.
+//
+#pragma once
+#include "ofMain.h"
+#include "box.h"
+#include "ray.h"
+#include "Octree.h"
+#include "MappedFile.h"
+#include "TerrainIndex.h"
+#include "SimdBox.h"
+#include "OctreeStats.h"
+#include <memory>
+
+// start of the block.  Offsets are in bytes from the start of the block.
+//
+struct LinearOctreeHeader {
+	char magic[8];              // "LOCTREE"
+	uint32_t version;           // LinearOctree::FORMAT_VERSION
+	uint32_t byteOrder;         // 0x01020304 as written by the saving machine
+	uint64_t key;               // LinearOctree::cacheKey() of the source mesh
+	uint64_t totalBytes;
+	int32_t numNodes;
+	int32_t numPoints;
+	int32_t bUseFaces;
+	int32_t numLevels;          // levels the tree was built with (for update())
+	uint64_t offsets[11];       // minX minY minZ maxX maxY maxZ firstChild childMask pointStart pointCount points
+};
+
+class LinearOctree : public TerrainIndex {
+public:
+	LinearOctree() {}
+	LinearOctree(const LinearOctree &);
+	LinearOctree & operator=(const LinearOctree &);
+
+	// exchange trees without copying the block or the mesh, so a tree
+	// built on another thread can be swapped in between frames
+	//
+	void swap(LinearOctree & other);
+
+	// bump when the block layout or the Octree subdivision rules change,
+	// so old cache files are rebuilt
+	//
+	static const uint32_t FORMAT_VERSION = 6;
+
+	// deepest tree we can walk with the fixed size traversal stack
+	//
+	static const int MAX_DEPTH = 32;
+
+	// build a tree with the same subdivision rules as Octree::create()
+	// (set bUseFaces and numThreads first; point trees use PartitionBuild),
+	// or flatten a tree that has already been built.
+	//
+	void create(const ofMesh & mesh, int numLevels);
+	void create(const Octree & octree);
+	void clear();
+
+	// on-disk cache.  load() maps the file and fails if it was written by
+	// another format version or for a different mesh / level count (key).
+	// createCached() loads the cache, or builds the tree and rewrites the
+	// cache file; it returns true if the cache was used.
+	//
+	static uint64_t cacheKey(const ofMesh & mesh, int numLevels, bool bUseFaces, float boundsMargin = 0);
+	bool save(const string & path, uint64_t key) const;
+	bool load(const string & path, uint64_t key, const ofMesh & mesh);
+	bool createCached(const string & path, const ofMesh & mesh, int numLevels);
+
+	// same queries as Octree::intersect(), but nodes are returned as indices.
+	// Children are tested 8 at a time with the SimdBox kernels.
+	//
+	bool intersect(const Ray &, int & nodeRtn) const;
+	bool intersect(const Ray &, RayHit & hitRtn) const override;
+	bool intersect(const Box &, vector<Box> & boxListRtn) const override;
+	int intersect(const Box &, int * leavesRtn, int maxLeaves) const override;
+
+	// closest point and k nearest queries, same as Octree::closestPoint() and Octree::nearest()
+	//
+	bool closestPoint(const ofVec3f & p, NearestPoint & nearestRtn, float maxDistance = FLT_MAX) const;
+	int nearest(const ofVec3f & p, int k, vector<NearestPoint> & nearestRtn, float maxDistance = FLT_MAX) const;
+
+	// first contact of box moved along motion, same as Octree::sweep()
+	//
+	bool sweep(const Box & box, const ofVec3f & motion, SweepHit & hitRtn) const;
+
+	// terrain edits, same as Octree::update() and Octree::craterEdit().  The
+	// children whose items change are rebuilt with the Octree rules and
+	// spliced into a new block in place of the old subtrees, which gives
+	// the same nodes and items as rebuilding the whole tree.  Returns the
+	// number of nodes rebuilt, or -1 if an item left the root box and the
+	// whole tree was rebuilt.
+	//
+	// When the rebuilt subtrees have the same nodes as the old ones (only
+	// items moved between leaves, the usual case for a small edit) their
+	// items are written over the old ones in the block instead, which
+	// costs the size of the subtrees.  patch() only does that: it returns
+	// false and leaves the tree and mesh alone if the edit needs the
+	// block laid out again, so the caller can do that with update() later.
+	//
+	int update(const vector<int> & vertices, const vector<glm::vec3> & positions);
+	bool patch(const vector<int> & vertices, const vector<glm::vec3> & positions);
+	void craterEdit(const ofVec3f & center, float radius, float depth,
+		vector<int> & verticesRtn, vector<glm::vec3> & positionsRtn) const;
+
+	// call visit(node) for every leaf that overlaps the box, nothing is allocated
+	//
+	template <typename Visitor> void visitLeaves(const Box &, Visitor && visit,
+		QueryCounters * counters = nullptr) const;
+
+	// while set, the ray (RayHit), box, nearest and sweep queries add their
+	// counters to it, like Octree::queryStats.  Costs a branch per node
+	// when not set.
+	//
+	QueryStats * queryStats = nullptr;
+
+	// the boxes of levels 0 to numLevels, or the leaves, drawn from a line
+	// mesh that is only rebuilt when the tree or the levels change
+	//
+	void draw(int numLevels) const;
+	void draw(int node, int numLevels, int level) const;
+	void drawLeafNodes() const;
+	void buildLineMesh(ofMesh & meshRtn, int minLevel, int maxLevel, bool leavesOnly) const;
+	const OctreeLineMesh & getLines(bool leavesOnly) const { return leavesOnly ? leafLines : lines; }
+
+	int numNodes() const { return nodeCount; }
+	int numPoints() const { return pointTotal; }
+	int numLevels() const { return builtLevels; }
+	bool isLeaf(int node) const { return childMask[node] == 0; }
+	int numChildren(int node) const;
+	Box getBox(int node) const override;
+	void getItems(int node, const int *& itemsRtn, int & countRtn) const override;
+	const ofMesh & getMesh() const override { return mesh; }
+	bool itemsAreFaces() const override { return bUseFaces; }
+	size_t memoryBytes() const override { return blockBytes; }
+	const char * name() const override { return "octree"; }
+	bool isMapped() const { return mapping != nullptr; }
+
+	// node data (one entry per node), pointing into the block
+	//
+	const float * minX = nullptr;
+	const float * minY = nullptr;
+	const float * minZ = nullptr;
+	const float * maxX = nullptr;
+	const float * maxY = nullptr;
+	const float * maxZ = nullptr;
+	const int * firstChild = nullptr;            // index of first child, -1 for a leaf
+	const unsigned char * childMask = nullptr;   // bit i set if octant i of subDivideBox8() is occupied
+	const int * pointStart = nullptr;            // range into points[] (leaves, or any node owning faces)
+	const int * pointCount = nullptr;
+
+	// mesh vertex indices of all leaf nodes (face indices with bUseFaces),
+	// packed back to back
+	//
+	const int * points = nullptr;
+	bool bUseFaces = false;
+	int numThreads = 1;
+	float boundsMargin = 0;          // room around the mesh for edits, see Octree::boundsMargin
+	bool bTimingInfo = false;        // print how long each update() took
+
+	ofMesh mesh;
+	vector<ofColor> colors{ ofColor::red, ofColor::orange, ofColor::yellow, ofColor::green, ofColor::blue, ofColor::purple };
+
+private:
+	// node arrays being laid out breadth first, before they are packed
+	//
+	struct NodeArrays {
+		vector<float> bounds[6];
+		vector<int> first, start, count, pts;
+		vector<unsigned char> mask;
+		void reserve(int nodes, int items);
+		void addNode(const Box & box);
+	};
+	bool pack(const NodeArrays & arrays, int numLevels);
+	bool bind(const char * block, size_t size, const ofMesh & geo);
+	bool rayHitsNode(const Ray &, int node, float t0, float t1) const;
+	bool boxOverlapsNode(const Box &, int node) const;
+	void loadChildBoxes(int node, Box8 & boxes) const;
+	void childOctants(int node, int octants[8]) const;
+
+	// a subtree update() rebuilds: the child in slot of parent (-1 for the
+	// root) with box at level, rebuilt from items (dropped if empty)
+	//
+	struct Rebuild {
+		int parent = -1;
+		int slot = 0;
+		int level = 0;
+		Box box;
+		vector<int> items;
+	};
+	void subtreeItems(int node, vector<int> & itemsRtn) const;
+	void editedItems(int node, const vector<OctreeEdit> & edits, const vector<int> & before,
+		const vector<int> & after, vector<int> & itemsRtn) const;
+	void findRebuilds(int node, Rebuild & self, Octree & rules, const vector<OctreeEdit> & edits,
+		const vector<int> & before, const vector<int> & after, vector<Rebuild> & rebuildsRtn) const;
+	bool patchItems(const vector<Rebuild> & rebuilds, const vector<Octree> & rebuilt, int & touchedRtn);
+	int applyEdit(const vector<int> & vertices, const vector<glm::vec3> & positions, bool relayout);
+
+	int nodeCount = 0;
+	int pointTotal = 0;
+	int builtLevels = 0;
+	size_t blockBytes = 0;
+	int version = 0;                 // bumped every time a block is bound or cleared
+	mutable OctreeLineMesh lines, leafLines;
+	vector<int> vertexFaceStart;     // faces using each vertex (face trees, built on first update)
+	vector<int> vertexFaces;
+
+	// the block is either built in memory or mapped from a cache file
+	//
+	vector<uint64_t> storage;
+	std::shared_ptr<MappedFile> mapping;
+};
+
+template <typename Visitor>
+void LinearOctree::visitLeaves(const Box & box, Visitor && visit, QueryCounters * counters) const {
+	if (numNodes() == 0 || !boxOverlapsNode(box, 0)) return;
+
+	int stack[MAX_DEPTH * 8];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int n = stack[--top];
+		if (counters) counters->nodesVisited++;
+		if (isLeaf(n)) {
+			if (counters) counters->leavesReturned++;
+			visit(n);
+			continue;
+		}
+
+		Box8 boxes;
+		loadChildBoxes(n, boxes);
+		if (counters) counters->boxesTested += boxes.count;
+		int mask = boxOverlapBox8(boxes, box);
+		for (int i = boxes.count - 1; i >= 0; i--) {
+			if (mask & (1 << i)) {
+				assert(top < MAX_DEPTH * 8);
+				stack[top++] = firstChild[n] + i;
+			}
+		}
+	}
+}
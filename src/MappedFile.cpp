@@ -0,0 +1,83 @@
+//
+//  Read only memory mapped file.
+//
+//  See MappedFile.h
+//
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+bool MappedFile::open(const std::string & path) {
+	close();
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(f);
+		return false;
+	}
+	HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m == NULL) {
+		CloseHandle(f);
+		return false;
+	}
+	void * view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		CloseHandle(m);
+		CloseHandle(f);
+		return false;
+	}
+	file = f;
+	mapping = m;
+	base = (const char *)view;
+	length = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (base) UnmapViewOfFile(base);
+	if (mapping) CloseHandle((HANDLE)mapping);
+	if (file) CloseHandle((HANDLE)file);
+	base = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	length = 0;
+}
+
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool MappedFile::open(const std::string & path) {
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void * view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);     // the mapping keeps its own reference to the file
+	if (view == MAP_FAILED) return false;
+
+	base = (const char *)view;
+	length = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (base) munmap((void *)base, length);
+	base = nullptr;
+	length = 0;
+}
+#endif
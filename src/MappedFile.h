@@ -0,0 +1,33 @@
+#pragma once
+//
+//  Read only memory mapped file.
+//
+//  The mapping stays valid until close() or the destructor.  Pages are
+//  read from disk by the OS on first touch, so opening a large file is
+//  cheap and nothing is copied onto the heap.
+//
+
+#include <string>
+#include <cstddef>
+
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	bool open(const std::string & path);
+	void close();
+
+	const char * data() const { return base; }
+	size_t size() const { return length; }
+
+private:
+	const char * base = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void * file = nullptr;
+	void * mapping = nullptr;
+#endif
+};
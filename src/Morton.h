@@ -0,0 +1,57 @@
+#pragma once
+//
+//  Morton (Z-order) codes for octree construction.
+//
+//  A Morton code interleaves the bits of three quantized coordinates
+//  (x in the high bit of each triple, then y, then z) so that sorting
+//  points by code groups them octant by octant at every level of an
+//  octree.  The 30 bit form packs 10 bits per axis, the 63 bit form 21.
+//
+
+#include <stdint.h>
+
+struct MortonTable {
+	uint64_t spread[256];
+};
+
+// spread the 8 bits of b out so there are two zero bits between each
+//
+constexpr uint64_t mortonSpreadByte(uint64_t b) {
+	uint64_t r = 0;
+	for (int i = 0; i < 8; i++)
+		r |= ((b >> i) & 1) << (3 * i);
+	return r;
+}
+
+constexpr MortonTable makeMortonTable() {
+	MortonTable t = {};
+	for (int i = 0; i < 256; i++)
+		t.spread[i] = mortonSpreadByte(i);
+	return t;
+}
+
+static constexpr MortonTable mortonTable = makeMortonTable();
+
+// 10 bits per axis
+//
+inline uint32_t mortonSpread10(uint32_t v) {
+	return (uint32_t)(mortonTable.spread[v & 0xff] | (mortonTable.spread[(v >> 8) & 0x03] << 24));
+}
+
+inline uint32_t mortonEncode30(uint32_t x, uint32_t y, uint32_t z) {
+	return (mortonSpread10(x) << 2) | (mortonSpread10(y) << 1) | mortonSpread10(z);
+}
+
+// 21 bits per axis
+//
+inline uint64_t mortonSpread21(uint64_t v) {
+	return mortonTable.spread[v & 0xff] |
+		(mortonTable.spread[(v >> 8) & 0xff] << 24) |
+		(mortonTable.spread[(v >> 16) & 0x1f] << 48);
+}
+
+inline uint64_t mortonEncode63(uint64_t x, uint64_t y, uint64_t z) {
+	return (mortonSpread21(x) << 2) | (mortonSpread21(y) << 1) | mortonSpread21(z);
+}
+
+static_assert(mortonSpreadByte(0xff) == 0x249249, "morton table");
@@ -11,6 +11,10 @@
 
 
 #include "Octree.h"
+#include "ThreadPool.h"
+#include "Morton.h"
+#include "SimdBox.h"
+#include <queue>
  
 
 
@@ -77,15 +81,8 @@ int Octree::getMeshFacesInBox(const ofMesh & mesh, const vector<int>& faces,
 {
 	int count = 0;
 	for (int i = 0; i < faces.size(); i++) {
-		ofMeshFace face = mesh.getFace(faces[i]);
-		ofVec3f v[3];
-		v[0] = face.getVertex(0);
-		v[1] = face.getVertex(1);
-		v[2] = face.getVertex(2);
 		Vector3 p[3];
-		p[0] = Vector3(v[0].x, v[0].y, v[0].z);
-		p[1] = Vector3(v[1].x, v[1].y, v[1].z);
-		p[2] = Vector3(v[2].x, v[2].y, v[2].z);
+		getFaceVertices(mesh, faces[i], p);
 		if (box.inside(p,3)) {
 			count++;
 			facesRtn.push_back(faces[i]);
@@ -94,6 +91,127 @@ int Octree::getMeshFacesInBox(const ofMesh & mesh, const vector<int>& faces,
 	return count;
 }
 
+// sortFacesIntoChildren:  a face goes to the child box that contains it (see
+//   getMeshFacesInBox()).  A face that straddles a split plane is handed to
+//   every child its bounds overlap as long as it is no bigger than a child,
+//   otherwise it stays with the node.  Without this the split plane through
+//   the middle of a flat terrain leaves thousands of faces at the root that
+//   every ray would have to test.
+//
+void Octree::sortFacesIntoChildren(const ofMesh & mesh, TreeNode & node, vector<Box> & subBoxes,
+	vector<int> childFaces[8], ThreadPool * pool)
+{
+	for (int i = 0; i < subBoxes.size(); i++) {
+		if (pool) pool->run([this, &mesh, &node, &subBoxes, childFaces, i] {
+			getMeshFacesInBox(mesh, node.points, subBoxes[i], childFaces[i]);
+		});
+		else getMeshFacesInBox(mesh, node.points, subBoxes[i], childFaces[i]);
+	}
+	if (pool) pool->wait();
+
+	// faces not contained in any child (node.points is sorted)
+	//
+	vector<int> contained;
+	int containedCount[8];
+	for (int i = 0; i < subBoxes.size(); i++) {
+		contained.insert(contained.end(), childFaces[i].begin(), childFaces[i].end());
+		containedCount[i] = (int)childFaces[i].size();
+	}
+	sort(contained.begin(), contained.end());
+	vector<int> straddling;
+	set_difference(node.points.begin(), node.points.end(), contained.begin(), contained.end(),
+		back_inserter(straddling));
+
+	Vector3 childSize = subBoxes[0].parameters[1] - subBoxes[0].parameters[0];
+	vector<int> own;
+	for (int f = 0; f < straddling.size(); f++) {
+		Vector3 p[3];
+		getFaceVertices(mesh, straddling[f], p);
+		Vector3 lo(fmin(p[0].x(), fmin(p[1].x(), p[2].x())), fmin(p[0].y(), fmin(p[1].y(), p[2].y())), fmin(p[0].z(), fmin(p[1].z(), p[2].z())));
+		Vector3 hi(fmax(p[0].x(), fmax(p[1].x(), p[2].x())), fmax(p[0].y(), fmax(p[1].y(), p[2].y())), fmax(p[0].z(), fmax(p[1].z(), p[2].z())));
+		Vector3 size = hi - lo;
+		if (size.x() > childSize.x() || size.y() > childSize.y() || size.z() > childSize.z()) {
+			own.push_back(straddling[f]);
+			continue;
+		}
+		Box bounds(lo, hi);
+		for (int i = 0; i < subBoxes.size(); i++) {
+			if (subBoxes[i].overlap(bounds)) childFaces[i].push_back(straddling[f]);
+		}
+	}
+
+	// keep every child's list sorted for the next level down
+	//
+	for (int i = 0; i < subBoxes.size(); i++)
+		inplace_merge(childFaces[i].begin(), childFaces[i].begin() + containedCount[i], childFaces[i].end());
+	node.points.swap(own);
+}
+
+// number of triangles in a mesh, indexed or not
+//
+int Octree::meshFaceCount(const ofMesh & mesh) {
+	if (mesh.getNumIndices() > 0) return (int)mesh.getNumIndices() / 3;
+	return (int)mesh.getNumVertices() / 3;
+}
+
+// the three corners of a triangle, same face numbering as ofMesh::getFace()
+//
+void Octree::getFaceVertices(const ofMesh & mesh, int face, Vector3 p[3]) {
+	bool indexed = mesh.getNumIndices() > 0;
+	for (int k = 0; k < 3; k++) {
+		int i = indexed ? mesh.getIndex(3 * face + k) : 3 * face + k;
+		glm::vec3 v = mesh.getVertex(i);
+		p[k] = Vector3(v.x, v.y, v.z);
+	}
+}
+
+// Moller-Trumbore ray/triangle test, t is the distance along the ray
+//
+bool Octree::rayIntersectTriangle(const Ray & ray, const Vector3 p[3], float & t) {
+	const float eps = 1e-7;
+	Vector3 e1 = p[1] - p[0];
+	Vector3 e2 = p[2] - p[0];
+	Vector3 pv = ray.direction ^ e2;
+	float det = e1 * pv;
+	if (fabs(det) < eps) return false;
+	float invDet = 1 / det;
+	Vector3 tv = ray.origin - p[0];
+	float u = (tv * pv) * invDet;
+	if (u < 0 || u > 1) return false;
+	Vector3 qv = tv ^ e1;
+	float v = (ray.direction * qv) * invDet;
+	if (v < 0 || u + v > 1) return false;
+	t = (e2 * qv) * invDet;
+	return t >= 0;
+}
+
+// by the centers, the corners of a child can be a rounding step off the
+// parent's (see subDivideBox8())
+//
+int Octree::childOctant(const Box & parent, const Box & child) {
+	Vector3 p = parent.parameters[0] + parent.parameters[1];
+	Vector3 c = child.parameters[0] + child.parameters[1];
+	return (c.x() > p.x() ? 1 : 0) | (c.y() > p.y() ? 2 : 0) | (c.z() > p.z() ? 4 : 0);
+}
+
+int Octree::rayOrder(const Ray & ray, int mask, const int octants[8], int order[8]) {
+	int signMask = ray.sign[0] | (ray.sign[1] << 1) | (ray.sign[2] << 2);
+	int key[8];
+	int count = 0;
+	for (int i = 0; i < 8; i++) {
+		if (!(mask & (1 << i))) continue;
+		int k = octants[i] ^ signMask;
+		int j = count++;
+		for (; j > 0 && key[j - 1] > k; j--) {
+			key[j] = key[j - 1];
+			order[j] = order[j - 1];
+		}
+		key[j] = k;
+		order[j] = i;
+	}
+	return count;
+}
+
 //  Subdivide a Box into eight(8) equal size boxes, return them in boxList;
 //
 void Octree::subDivideBox8(const Box &box, vector<Box> & boxList) {
@@ -133,25 +251,69 @@ void Octree::create(const ofMesh & geo, int numLevels) {
 	float startTime = ofGetElapsedTimeMillis();
 	mesh = geo;
 	int level = 0;
+	builtLevels = numLevels;
+	version++;
+	vertexFaceStart.clear();
+	vertexFaces.clear();
+	root = TreeNode();
+	items.clear();
 	root.box = meshBounds(mesh);
-	if (!bUseFaces) {
+	if (boundsMargin > 0) {
+		Vector3 margin(boundsMargin, boundsMargin, boundsMargin);
+		root.box = Box(root.box.parameters[0] - margin, root.box.parameters[1] + margin);
+	}
+	bool partition = buildType == PartitionBuild && !bUseFaces;
+	if (partition) {
+		items.resize(mesh.getNumVertices());
+		for (int i = 0; i < items.size(); i++) items[i] = i;
+		root.end = (int)items.size();
+	}
+	else if (!bUseFaces) {
 		for (int i = 0; i < mesh.getNumVertices(); i++) {
 			root.points.push_back(i);
 		}
 	}
 	else {
-		// need to load face vertices here
-		//
+		int numFaces = meshFaceCount(mesh);
+		for (int i = 0; i < numFaces; i++) {
+			root.points.push_back(i);
+		}
 	}
 
 	// recursively buid octree
 	//
 	//level++;
-    subdivide(mesh, root, numLevels, level);
+	if (buildType == MortonBuild && !bUseFaces) {
+		createMorton(numLevels);
+	}
+	else if (numThreads > 1) {
+		ThreadPool pool(numThreads);
+		vector<pair<TreeNode *, int>> subtrees;
+		if (partition) subdividePartition(mesh, root, numLevels, level, &subtrees);
+		else subdivideParallel(mesh, root, numLevels, level, pool, subtrees);
+
+		// hand each remaining subtree to a worker
+		//
+		for (int i = 0; i < subtrees.size(); i++) {
+			TreeNode * node = subtrees[i].first;
+			int nodeLevel = subtrees[i].second;
+			if (partition)
+				pool.run([this, node, numLevels, nodeLevel] { subdividePartition(mesh, *node, numLevels, nodeLevel); });
+			else
+				pool.run([this, node, numLevels, nodeLevel] { subdivide(mesh, *node, numLevels, nodeLevel); });
+		}
+		pool.wait();
+	}
+	else if (partition) {
+		subdividePartition(mesh, root, numLevels, level);
+	}
+	else subdivide(mesh, root, numLevels, level);
 	
 	float totalTime = ofGetElapsedTimeMillis() - startTime;
 
-	cout << "Time to build octree: " << totalTime << " ms" << endl;
+	cout << "Time to build octree: " << totalTime << " ms";
+	if (numThreads > 1) cout << " (" << numThreads << " threads)";
+	cout << endl;
 }
 
 
@@ -178,12 +340,23 @@ void Octree::subdivide(const ofMesh & mesh, TreeNode & node, int numLevels, int
 	vector<Box> subBoxes;
 	subDivideBox8(node.box, subBoxes);
 	level++;
+
+	// with faces, sort them all up front (straddling faces can go to several children)
+	//
+	vector<int> childFaces[8];
+	if (bUseFaces) sortFacesIntoChildren(mesh, node, subBoxes, childFaces, NULL);
+
 	for (int i = 0; i < subBoxes.size(); i++) {
 		TreeNode bChild;
 		
-		// sort point data into bChild.points
+		// sort point (or face) data into bChild.points
 		//
-		int pCount = getMeshPointsInBox(mesh, node.points, subBoxes[i], bChild.points);
+		int pCount;
+		if (bUseFaces) {
+			bChild.points.swap(childFaces[i]);
+			pCount = (int)bChild.points.size();
+		}
+		else pCount = getMeshPointsInBox(mesh, node.points, subBoxes[i], bChild.points);
 		//cout << pCount << endl;
 
 		// if child contains at least one point
@@ -207,14 +380,582 @@ void Octree::subdivide(const ofMesh & mesh, TreeNode & node, int numLevels, int
 	}
 }
 
-// Implement functions below for Homework project
 //
+// subdivideParallel:  same split as subdivide(), but the points of the eight
+//   children are sorted concurrently on the pool and, once a child is at
+//   parallelDepth, it is returned in "subtrees" to be built by a worker
+//   instead of recursing.  All children are added to the node before any
+//   of them is handed out, so the pointers stay valid.
+//
+void Octree::subdivideParallel(const ofMesh & mesh, TreeNode & node, int numLevels, int level,
+	ThreadPool & pool, vector<pair<TreeNode *, int>> & subtrees) {
+	if (level > numLevels) return;
 
-bool Octree::intersect(const Ray &ray, const TreeNode & node, TreeNode & nodeRtn) {
-	// if ray does not intersect box, return
+	vector<Box> subBoxes;
+	subDivideBox8(node.box, subBoxes);
+	level++;
+
+	TreeNode bChild[8];
+	if (bUseFaces) {
+		vector<int> childFaces[8];
+		sortFacesIntoChildren(mesh, node, subBoxes, childFaces, &pool);
+		for (int i = 0; i < subBoxes.size(); i++)
+			bChild[i].points.swap(childFaces[i]);
+	}
+	else {
+		for (int i = 0; i < subBoxes.size(); i++) {
+			pool.run([this, &mesh, &node, &subBoxes, &bChild, i] {
+				getMeshPointsInBox(mesh, node.points, subBoxes[i], bChild[i].points);
+			});
+		}
+		pool.wait();
+	}
+
+	for (int i = 0; i < subBoxes.size(); i++) {
+		if (bChild[i].points.size() > 0) {
+			node.children.push_back(TreeNode());
+			node.children.back().box = subBoxes[i];
+			node.children.back().points.swap(bChild[i].points);
+		}
+	}
+
+	for (int i = 0; i < node.children.size(); i++) {
+		TreeNode & child = node.children[i];
+		if (child.points.size() > 1) {
+			if (level < parallelDepth)
+				subdivideParallel(mesh, child, numLevels, level, pool, subtrees);
+			else
+				subtrees.push_back(make_pair(&child, level));
+		}
+	}
+}
+
+// sort 64 bit keys (and the values that go with them) with an LSD radix
+// sort, 8 bits per pass, only as many passes as there are key bits
+//
+static void radixSort(vector<uint64_t> & keys, vector<int> & values, int keyBits) {
+	int n = (int)keys.size();
+	vector<uint64_t> keysTmp(n);
+	vector<int> valuesTmp(n);
+	for (int shift = 0; shift < keyBits; shift += 8) {
+		int count[257] = { 0 };
+		for (int i = 0; i < n; i++)
+			count[((keys[i] >> shift) & 0xff) + 1]++;
+		for (int d = 0; d < 256; d++)
+			count[d + 1] += count[d];
+		for (int i = 0; i < n; i++) {
+			int dst = count[(keys[i] >> shift) & 0xff]++;
+			keysTmp[dst] = keys[i];
+			valuesTmp[dst] = values[i];
+		}
+		keys.swap(keysTmp);
+		values.swap(valuesTmp);
+	}
+}
+
+//
+// createMorton:  bottom up build.  Every vertex gets a Morton code relative to
+//   the root box, the codes are radix sorted once and each node is then just a
+//   range of the sorted list.  The children of a node are the sub ranges that
+//   share the next 3 bits, found by binary search.  Needs numLevels + 1 bits per
+//   axis, so up to 9 levels fit in a 30 bit code and up to 20 in a 63 bit one.
+//
+//   Each point lands in exactly one octant, where the recursive build puts
+//   points lying on a split plane into every box that touches it.
+//
+void Octree::createMorton(int numLevels) {
+	int bits = numLevels + 1;
+	if (bits > 21) {
+		cout << "Morton build supports at most 20 levels, using recursive build" << endl;
+		subdivide(mesh, root, numLevels, 0);
+		return;
+	}
+
+	Vector3 min = root.box.parameters[0];
+	Vector3 size = root.box.parameters[1] - min;
+	float cells = (float)(1 << bits);
+	uint32_t maxCell = (1u << bits) - 1;
+	float scale[3];
+	for (int a = 0; a < 3; a++)
+		scale[a] = size[a] > 0 ? cells / size[a] : 0;
+
+	int n = (int)mesh.getNumVertices();
+	vector<uint64_t> keys(n);
+	vector<int> order(n);
+	for (int i = 0; i < n; i++) {
+		ofVec3f v = mesh.getVertex(i);
+		uint32_t q[3];
+		for (int a = 0; a < 3; a++) {
+			float c = (v[a] - min[a]) * scale[a];
+			q[a] = c <= 0 ? 0 : (c >= maxCell ? maxCell : (uint32_t)c);
+		}
+		if (bits <= 10) keys[i] = mortonEncode30(q[0], q[1], q[2]);
+		else keys[i] = mortonEncode63(q[0], q[1], q[2]);
+		order[i] = i;
+	}
+	radixSort(keys, order, 3 * bits);
+
+	subdivideMorton(root, keys, order, 0, n, numLevels, 0, bits);
+}
+
+// subdivideMorton:  same rules as subdivide(), but the points of a child are
+//   the sub range of [begin, end) whose Morton digit matches its octant.
+//
+void Octree::subdivideMorton(TreeNode & node, const vector<uint64_t> & keys, const vector<int> & order,
+	int begin, int end, int numLevels, int level, int bits) {
+	if (level > numLevels) return;
+
+	// Morton digit (x << 2 | y << 1 | z) of each subDivideBox8() slot
 	//
-	if (!node.box.intersect(ray, 0, FLT_MAX)) return false;
+	static const int slotDigit[8] = { 0, 4, 5, 1, 2, 6, 7, 3 };
+
+	vector<Box> subBoxes;
+	subDivideBox8(node.box, subBoxes);
+	level++;
+	int shift = 3 * (bits - level);
+	vector<uint64_t>::const_iterator first = keys.begin() + begin;
+	vector<uint64_t>::const_iterator last = keys.begin() + end;
+
+	for (int i = 0; i < subBoxes.size(); i++) {
+		uint64_t digit = slotDigit[i];
+		vector<uint64_t>::const_iterator lo = partition_point(first, last,
+			[=](uint64_t k) { return ((k >> shift) & 7) < digit; });
+		vector<uint64_t>::const_iterator hi = partition_point(lo, last,
+			[=](uint64_t k) { return ((k >> shift) & 7) == digit; });
+		int childBegin = (int)(lo - keys.begin());
+		int childEnd = (int)(hi - keys.begin());
+		int pCount = childEnd - childBegin;
+
+		if (pCount > 0) {
+			TreeNode bChild;
+			bChild.box = subBoxes[i];
+			bChild.points.assign(order.begin() + childBegin, order.begin() + childEnd);
+			node.children.push_back(bChild);
+
+			if (pCount > 1) {
+				subdivideMorton(node.children.back(), keys, order, childBegin, childEnd, numLevels, level, bits);
+			}
+		}
+	}
+}
+
+//
+// subdividePartition:  same rules as subdivide(), but the points are never
+//   copied.  The node's range of items is partitioned in place, first on y
+//   (ground floor / second story of subDivideBox8()), then each half on z and
+//   each quarter on x, and every child gets its sub range.  A point goes to
+//   the upper side of a split plane when it is on or above it, so it lands in
+//   exactly one octant.  The children vector is sized exactly, the nodes
+//   are most of the memory of a partitioned tree.
+//
+//   With subtrees, children at parallelDepth are returned there instead of
+//   being split, to be built by workers (their ranges don't overlap).
+//
+void Octree::subdividePartition(const ofMesh & mesh, TreeNode & node, int numLevels, int level,
+	vector<pair<TreeNode *, int>> * subtrees) {
+	if (level > numLevels) return;
+
+	vector<Box> subBoxes;
+	subDivideBox8(node.box, subBoxes);
+	level++;
+	Vector3 center = subBoxes[0].parameters[1];
+
+	// split the range on one axis, points below the plane first
+	//
+	auto split = [&](int begin, int end, int axis) {
+		vector<int>::iterator mid = partition(items.begin() + begin, items.begin() + end,
+			[&](int i) { return mesh.getVertex(i)[axis] < center[axis]; });
+		return (int)(mid - items.begin());
+	};
+
+	// bounds[i], bounds[i + 1] is the range of subBoxes slot i: x low / high
+	// with z low, then x high / low with z high, on each floor
+	//
+	int bounds[9];
+	bounds[0] = node.begin;
+	bounds[8] = node.end;
+	bounds[4] = split(node.begin, node.end, 1);
+	for (int floor = 0; floor < 8; floor += 4) {
+		int begin = bounds[floor], end = bounds[floor + 4];
+		bounds[floor + 2] = split(begin, end, 2);
+		bounds[floor + 1] = split(begin, bounds[floor + 2], 0);
+		int xHigh = split(bounds[floor + 2], end, 0);
+
+		// slot 2 is x high and slot 3 x low, so swap the two halves
+		//
+		rotate(items.begin() + bounds[floor + 2], items.begin() + xHigh, items.begin() + end);
+		bounds[floor + 3] = bounds[floor + 2] + (end - xHigh);
+	}
+
+	int numChildren = 0;
+	for (int i = 0; i < subBoxes.size(); i++) {
+		if (bounds[i + 1] > bounds[i]) numChildren++;
+	}
+	node.children.reserve(numChildren);
+	for (int i = 0; i < subBoxes.size(); i++) {
+		int pCount = bounds[i + 1] - bounds[i];
+		if (pCount > 0) {
+			node.children.push_back(TreeNode());
+			TreeNode & child = node.children.back();
+			child.box = subBoxes[i];
+			child.begin = bounds[i];
+			child.end = bounds[i + 1];
+		}
+	}
+	for (int i = 0; i < node.children.size(); i++) {
+		TreeNode & child = node.children[i];
+		if (child.end - child.begin <= 1) continue;
+		if (subtrees && level >= parallelDepth) subtrees->push_back(make_pair(&child, level));
+		else subdividePartition(mesh, child, numLevels, level, subtrees);
+	}
+}
+
+// the points (faces) held by a node and their count.  For a point tree an
+// interior node holds all the points of its subtree.
+//
+int Octree::getItems(const TreeNode & node, const int *& itemsRtn) const {
+	if (node.points.empty() && node.end > node.begin) {
+		itemsRtn = items.data() + node.begin;
+		return node.end - node.begin;
+	}
+	itemsRtn = node.points.data();
+	return (int)node.points.size();
+}
+
+// walk the tree once, level by level
+//
+OctreeStats Octree::stats() const {
+	OctreeStats stats;
+	int childSlots = 0, children = 0;
+	stats.memoryBytes = sizeof(Octree) + items.capacity() * sizeof(int);
+
+	vector<const TreeNode *> level(1, &root);
+	for (int depth = 0; !level.empty(); depth++) {
+		vector<const TreeNode *> next;
+		stats.nodesPerLevel.push_back((int)level.size());
+		for (int i = 0; i < level.size(); i++) {
+			const TreeNode & node = *level[i];
+			stats.numNodes++;
+			stats.memoryBytes += node.points.capacity() * sizeof(int) + node.children.capacity() * sizeof(TreeNode);
+			if (node.children.empty()) {
+				const int * leafItems;
+				int count = getItems(node, leafItems);
+				int bucket = 0;
+				while ((1 << bucket) < count) bucket++;
+				if (stats.leafOccupancy.size() <= bucket) stats.leafOccupancy.resize(bucket + 1, 0);
+				stats.leafOccupancy[bucket]++;
+				stats.numLeaves++;
+				stats.maxDepth = depth;
+				continue;
+			}
+			childSlots += 8;
+			children += (int)node.children.size();
+			for (int c = 0; c < node.children.size(); c++) next.push_back(&node.children[c]);
+		}
+		level.swap(next);
+	}
+	stats.emptyChildRatio = childSlots > 0 ? 1 - (float)children / childSlots : 0;
+	return stats;
+}
+
+// compare two trees node by node (boxes, points and shape)
+//
+bool Octree::sameTree(const TreeNode & a, const TreeNode & b) {
+	if (a.box.parameters[0] != b.box.parameters[0] || a.box.parameters[1] != b.box.parameters[1]) return false;
+	if (a.points != b.points || a.children.size() != b.children.size()) return false;
+	if (a.begin != b.begin || a.end != b.end) return false;
+	for (int i = 0; i < a.children.size(); i++) {
+		if (!sameTree(a.children[i], b.children[i])) return false;
+	}
+	return true;
+}
+
+// which children of a node (bits of subBoxes slots) an edited point or face
+// is handed to, with the same rules as subdivide() and sortFacesIntoChildren(),
+// or subdividePartition() for a partitioned point tree (one octant, the upper
+// side of a split plane).  keep is set if the node holds on to the face itself.
+//
+int Octree::routeEdit(const Vector3 p[3], vector<Box> & subBoxes, bool & keep) const {
+	int mask = 0;
+	keep = false;
+	if (!bUseFaces && buildType == PartitionBuild) {
+		Vector3 center = subBoxes[0].parameters[1];
+		for (int i = 0; i < subBoxes.size(); i++) {
+			bool in = true;
+			for (int a = 0; a < 3; a++)
+				in = in && ((p[0][a] < center[a]) == (subBoxes[i].parameters[0][a] < center[a]));
+			if (in) return 1 << i;
+		}
+		return 0;
+	}
+	int corners = bUseFaces ? 3 : 1;
+	for (int i = 0; i < subBoxes.size(); i++) {
+		if (subBoxes[i].inside((Vector3 *)p, corners)) mask |= 1 << i;
+	}
+	if (mask || !bUseFaces) return mask;
+
+	// straddling face
+	//
+	Vector3 childSize = subBoxes[0].parameters[1] - subBoxes[0].parameters[0];
+	Vector3 lo(fmin(p[0].x(), fmin(p[1].x(), p[2].x())), fmin(p[0].y(), fmin(p[1].y(), p[2].y())), fmin(p[0].z(), fmin(p[1].z(), p[2].z())));
+	Vector3 hi(fmax(p[0].x(), fmax(p[1].x(), p[2].x())), fmax(p[0].y(), fmax(p[1].y(), p[2].y())), fmax(p[0].z(), fmax(p[1].z(), p[2].z())));
+	Vector3 size = hi - lo;
+	if (size.x() > childSize.x() || size.y() > childSize.y() || size.z() > childSize.z()) {
+		keep = true;
+		return 0;
+	}
+	Box bounds(lo, hi);
+	for (int i = 0; i < subBoxes.size(); i++) {
+		if (subBoxes[i].overlap(bounds)) mask |= 1 << i;
+	}
+	return mask;
+}
+
+// counting sort of the face corners by vertex
+//
+void Octree::vertexFaceTable(const ofMesh & mesh, vector<int> & startRtn, vector<int> & facesRtn) {
+	int numFaces = meshFaceCount(mesh);
+	bool indexed = mesh.getNumIndices() > 0;
+	startRtn.assign(mesh.getNumVertices() + 1, 0);
+	for (int f = 0; f < 3 * numFaces; f++)
+		startRtn[(indexed ? mesh.getIndex(f) : f) + 1]++;
+	for (int v = 0; v < mesh.getNumVertices(); v++)
+		startRtn[v + 1] += startRtn[v];
+	facesRtn.resize(3 * numFaces);
+	vector<int> fill(startRtn.begin(), startRtn.end() - 1);
+	for (int f = 0; f < 3 * numFaces; f++)
+		facesRtn[fill[indexed ? mesh.getIndex(f) : f]++] = f / 3;
+}
+
+// take the edited items in "removed" out of a list and put the ones in
+// "added" in, keeping the list sorted if it was
+//
+static void editList(vector<int> & list, vector<int> & removed, vector<int> & added) {
+	sort(removed.begin(), removed.end());
+	sort(added.begin(), added.end());
+	added.erase(unique(added.begin(), added.end()), added.end());
+
+	// same items leaving as coming back (edits that stayed inside the node)
+	//
+	if (removed == added) return;
+	bool sorted = is_sorted(list.begin(), list.end());
+	list.erase(remove_if(list.begin(), list.end(),
+		[&](int item) { return binary_search(removed.begin(), removed.end(), item); }), list.end());
+	int count = (int)list.size();
+	list.insert(list.end(), added.begin(), added.end());
+	if (sorted) inplace_merge(list.begin(), list.begin() + count, list.end());
+}
+
+// up to two distinct items handed to a node (its own plus its subtree's),
+// enough to tell whether it should now be a leaf
+//
+static void firstItems(const TreeNode & node, vector<int> & itemsRtn) {
+	for (int i = 0; i < node.points.size() && itemsRtn.size() < 2; i++) {
+		if (find(itemsRtn.begin(), itemsRtn.end(), node.points[i]) == itemsRtn.end())
+			itemsRtn.push_back(node.points[i]);
+	}
+	for (int i = 0; i < node.children.size() && itemsRtn.size() < 2; i++)
+		firstItems(node.children[i], itemsRtn);
+}
+
+int Octree::update(const vector<int> & vertices, const vector<glm::vec3> & positions) {
+	float startTime = ofGetElapsedTimeMillis();
+
+	// the ranges of a partitioned tree can't grow in place
+	//
+	if (buildType == PartitionBuild && !bUseFaces) {
+		for (int i = 0; i < vertices.size(); i++)
+			mesh.setVertex(vertices[i], positions[i]);
+		ofMesh geo = mesh;
+		create(geo, builtLevels);
+		return -1;
+	}
+
+	// the edited items: the vertices themselves, or every face using one
+	//
+	vector<int> items;
+	if (!bUseFaces) items = vertices;
+	else {
+		if (vertexFaceStart.empty()) vertexFaceTable(mesh, vertexFaceStart, vertexFaces);
+		for (int i = 0; i < vertices.size(); i++) {
+			int v = vertices[i];
+			items.insert(items.end(), vertexFaces.begin() + vertexFaceStart[v], vertexFaces.begin() + vertexFaceStart[v + 1]);
+		}
+	}
+	sort(items.begin(), items.end());
+	items.erase(unique(items.begin(), items.end()), items.end());
+
+	vector<OctreeEdit> edits(items.size());
+	for (int i = 0; i < items.size(); i++) {
+		edits[i].item = items[i];
+		if (bUseFaces) getFaceVertices(mesh, items[i], edits[i].before);
+		else edits[i].before[0] = Vector3(mesh.getVertex(items[i]).x, mesh.getVertex(items[i]).y, mesh.getVertex(items[i]).z);
+	}
+	for (int i = 0; i < vertices.size(); i++)
+		mesh.setVertex(vertices[i], positions[i]);
+
+	bool outside = false;
+	for (int i = 0; i < edits.size(); i++) {
+		if (bUseFaces) getFaceVertices(mesh, items[i], edits[i].after);
+		else edits[i].after[0] = Vector3(mesh.getVertex(items[i]).x, mesh.getVertex(items[i]).y, mesh.getVertex(items[i]).z);
+		if (!root.box.inside(edits[i].after, bUseFaces ? 3 : 1)) outside = true;
+	}
+	if (outside) {
+		ofMesh geo = mesh;
+		create(geo, builtLevels);
+		return -1;
+	}
+
+	vector<int> all(edits.size());
+	for (int i = 0; i < all.size(); i++) all[i] = i;
+	int touched = 0;
+	version++;
+	updateNode(root, 0, edits, all, all, touched);
+
+	if (bTimingInfo)
+		cout << "Time to update octree: " << ofGetElapsedTimeMillis() - startTime << " ms (" << touched << " nodes)" << endl;
+	return touched;
+}
 
+// before / after index the edits that were handed to this node before the
+// edit and are handed to it now.  Everything else in the node stays where
+// it is, so only children receiving an edit on either side are visited.
+//
+void Octree::updateNode(TreeNode & node, int level, const vector<OctreeEdit> & edits,
+	const vector<int> & before, const vector<int> & after, int & touched) {
+	touched++;
+
+	// a leaf owns everything handed to it, and may now need splitting
+	//
+	if (node.children.empty()) {
+		vector<int> removed, added;
+		for (int i = 0; i < before.size(); i++) removed.push_back(edits[before[i]].item);
+		for (int i = 0; i < after.size(); i++) added.push_back(edits[after[i]].item);
+		editList(node.points, removed, added);
+		if (node.points.size() > 1) subdivide(mesh, node, builtLevels, level);
+		return;
+	}
+
+	vector<Box> subBoxes;
+	subDivideBox8(node.box, subBoxes);
+	vector<int> childBefore[8], childAfter[8];
+	vector<int> removed, added;
+	for (int i = 0; i < before.size(); i++) {
+		bool keep;
+		int mask = routeEdit(edits[before[i]].before, subBoxes, keep);
+		if (keep || !bUseFaces) removed.push_back(edits[before[i]].item);
+		for (int c = 0; c < 8; c++) if (mask & (1 << c)) childBefore[c].push_back(before[i]);
+	}
+	for (int i = 0; i < after.size(); i++) {
+		bool keep;
+		int mask = routeEdit(edits[after[i]].after, subBoxes, keep);
+		if (keep || !bUseFaces) added.push_back(edits[after[i]].item);
+		for (int c = 0; c < 8; c++) if (mask & (1 << c)) childAfter[c].push_back(after[i]);
+	}
+
+	// point trees keep every point at interior nodes too
+	//
+	editList(node.points, removed, added);
+
+	// children stay in subBoxes order, as the build adds them
+	//
+	vector<TreeNode> children;
+	children.reserve(8);     // so filled children are never copied on growth
+	int next = 0;
+	for (int c = 0; c < 8; c++) {
+		bool exists = next < node.children.size() &&
+			node.children[next].box.parameters[0] == subBoxes[c].parameters[0] &&
+			node.children[next].box.parameters[1] == subBoxes[c].parameters[1];
+		if (exists) {
+			TreeNode & child = node.children[next++];
+			if (!childBefore[c].empty() || !childAfter[c].empty())
+				updateNode(child, level + 1, edits, childBefore[c], childAfter[c], touched);
+			if (!child.points.empty() || !child.children.empty()) {
+				children.push_back(TreeNode());
+				children.back().box = child.box;
+				children.back().points.swap(child.points);
+				children.back().children.swap(child.children);
+			}
+		}
+		else if (!childAfter[c].empty()) {
+			touched++;
+			children.push_back(TreeNode());
+			TreeNode & child = children.back();
+			child.box = subBoxes[c];
+			for (int i = 0; i < childAfter[c].size(); i++) child.points.push_back(edits[childAfter[c][i]].item);
+			sort(child.points.begin(), child.points.end());
+			if (child.points.size() > 1) subdivide(mesh, child, builtLevels, level + 1);
+		}
+	}
+	node.children.swap(children);
+
+	// a node that lost items may be down to one, which makes it a leaf
+	//
+	if (!before.empty() && level > 0) {
+		vector<int> items;
+		firstItems(node, items);
+		if (items.size() <= 1) {
+			node.children.clear();
+			node.points = items;
+		}
+	}
+}
+
+// points within the crater radius, pushed down into a bowl
+//
+void Octree::craterEdit(const ofVec3f & center, float radius, float depth,
+	vector<int> & verticesRtn, vector<glm::vec3> & positionsRtn) const {
+	verticesRtn.clear();
+	positionsRtn.clear();
+	Box region(Vector3(center.x - radius, root.box.parameters[0].y(), center.z - radius),
+		Vector3(center.x + radius, root.box.parameters[1].y(), center.z + radius));
+	if (!root.box.overlap(region)) return;
+
+	visitLeaves(region, root, [&](const TreeNode & leaf) {
+		const int * points;
+		int count = getItems(leaf, points);
+		for (int i = 0; i < count; i++) {
+			glm::vec3 v = mesh.getVertex(points[i]);
+			float dx = v.x - center.x;
+			float dz = v.z - center.z;
+			float d2 = (dx * dx + dz * dz) / (radius * radius);
+			if (d2 >= 1) continue;
+			verticesRtn.push_back(points[i]);
+			positionsRtn.push_back(glm::vec3(v.x, v.y - depth * (1 - d2), v.z));
+		}
+	});
+
+	// a point on a split plane is in more than one leaf
+	//
+	vector<int> order(verticesRtn.size());
+	for (int i = 0; i < order.size(); i++) order[i] = i;
+	sort(order.begin(), order.end(), [&](int a, int b) { return verticesRtn[a] < verticesRtn[b]; });
+	vector<int> vertices;
+	vector<glm::vec3> positions;
+	for (int i = 0; i < order.size(); i++) {
+		if (i > 0 && verticesRtn[order[i]] == verticesRtn[order[i - 1]]) continue;
+		vertices.push_back(verticesRtn[order[i]]);
+		positions.push_back(positionsRtn[order[i]]);
+	}
+	verticesRtn.swap(vertices);
+	positionsRtn.swap(positions);
+}
+
+// Implement functions below for Homework project
+//
+
+// gather the boxes of a node's children for the 8-wide tests
+//
+static void loadChildBoxes(const TreeNode & node, Box8 & boxes) {
+	boxes.count = (int)node.children.size();
+	for (int i = 0; i < boxes.count; i++)
+		boxes.set(i, node.children[i].box);
+}
+
+// test all children of a node in one go, then descend into the ones the
+// ray hits in child order
+//
+static bool firstLeaf(const Ray &ray, const TreeNode & node, TreeNode & nodeRtn) {
 	// if leaf node, return it
 	//
 	if (node.children.empty()) {
@@ -224,37 +965,527 @@ bool Octree::intersect(const Ray &ray, const TreeNode & node, TreeNode & nodeRtn
 
 	// if not leaf node, recursive call for a leaf node
 	//
-	for (int i = 0; i < node.children.size(); i++) {
-		if (intersect(ray, node.children[i], nodeRtn)) {
+	Box8 boxes;
+	float tNear[8];
+	loadChildBoxes(node, boxes);
+	int mask = rayIntersectBox8(boxes, ray, 0, FLT_MAX, tNear);
+	for (int i = 0; i < boxes.count; i++) {
+		if ((mask & (1 << i)) && firstLeaf(ray, node.children[i], nodeRtn)) {
 			return true;
 		}
 	}
+	return false;
+}
+
+// returns the first leaf the ray hits, in child order
+//
+bool Octree::intersect(const Ray &ray, const TreeNode & node, TreeNode & nodeRtn) {
+	// if ray does not intersect box, return
+	//
+	if (!node.box.intersect(ray, 0, FLT_MAX)) return false;
+
+	return firstLeaf(ray, node, nodeRtn);
+}
+
+// nearest hit along the ray.  With bUseFaces this is the closest triangle;
+// for a point tree it is the vertex of the first leaf the ray enters that
+// lies closest to the ray.
+//
+bool Octree::intersect(const Ray &ray, RayHit & hitRtn) const {
+	QueryCounters counters;
+	hitRtn = RayHit();
+	counters.boxesTested = 1;
+	if (root.box.intersect(ray, 0, FLT_MAX)) nearestHit(ray, root, hitRtn, queryStats ? &counters : nullptr);
+	if (queryStats) queryStats->add(RayQuery, counters);
+	return hitRtn.index >= 0;
+}
+
+// front to back descent.  All children are tested against the ray at once
+// and visited in rayOrder(); a child that starts beyond the best hit so far
+// is skipped.  Returns true once a point tree has found its leaf.
+//
+bool Octree::nearestHit(const Ray &ray, const TreeNode & node, RayHit & hitRtn, QueryCounters * counters) const {
+	if (counters) {
+		counters->nodesVisited++;
+		if (node.children.empty()) counters->leavesReturned++;
+	}
+	if (bUseFaces) {
+		for (int i = 0; i < node.points.size(); i++) {
+			Vector3 p[3];
+			float t;
+			getFaceVertices(mesh, node.points[i], p);
+			if (rayIntersectTriangle(ray, p, t) && t < hitRtn.t) {
+				Vector3 hit = ray.origin + ray.direction * t;
+				hitRtn.t = t;
+				hitRtn.index = node.points[i];
+				hitRtn.point = ofVec3f(hit.x(), hit.y(), hit.z());
+			}
+		}
+	}
+	else if (node.children.empty()) {
+		float best = FLT_MAX;
+		const int * points;
+		int count = getItems(node, points);
+		for (int i = 0; i < count; i++) {
+			ofVec3f v = mesh.getVertex(points[i]);
+			Vector3 d = Vector3(v.x, v.y, v.z) - ray.origin;
+			float dirLen2 = ray.direction * ray.direction;
+			float t = (d * ray.direction) / dirLen2;
+			float dist2 = d * d - t * t * dirLen2;     // squared distance to the ray
+			if (dist2 < best) {
+				best = dist2;
+				hitRtn.t = t;
+				hitRtn.index = points[i];
+				hitRtn.point = v;
+			}
+		}
+		return true;
+	}
 
+	// children that the ray enters before the best hit, front to back
+	//
+	Box8 boxes;
+	float tNear[8];
+	int octants[8];
+	int order[8];
+	loadChildBoxes(node, boxes);
+	for (int i = 0; i < boxes.count; i++) octants[i] = childOctant(node.box, node.children[i].box);
+	if (counters) counters->boxesTested += boxes.count;
+	int count = rayOrder(ray, rayIntersectBox8(boxes, ray, 0, hitRtn.t, tNear), octants, order);
+	for (int j = 0; j < count; j++) {
+		if (tNear[order[j]] >= hitRtn.t) continue;
+		if (nearestHit(ray, node.children[order[j]], hitRtn, counters)) return true;
+	}
 	return false;
 }
 
-bool Octree::intersect(const Box &box, TreeNode & node, vector<Box> & boxListRtn) {
+bool Octree::intersect(const Box &box, const TreeNode & node, vector<Box> & boxListRtn) const {
 	// if boxes do not intersect, return
 	//
 	if (!node.box.overlap(box)) return false;
 
-	// if not leaf node, recursive call for a leaf node
+	// add each overlapping leaf to colliding box list
 	//
-	if (node.children.size() > 0) {
+	QueryCounters counters;
+	counters.boxesTested = 1;
+	visitLeaves(box, node, [&](const TreeNode & leaf) { boxListRtn.push_back(leaf.box); },
+		queryStats ? &counters : nullptr);
+	if (queryStats) queryStats->add(BoxQuery, counters);
+	return true;
+}
+
+int Octree::intersect(const Box &box, const TreeNode * leavesRtn[], int maxLeaves) const {
+	QueryCounters counters;
+	counters.boxesTested = 1;
+	int count = 0;
+	if (root.box.overlap(box)) {
+		visitLeaves(box, root, [&](const TreeNode & leaf) {
+			if (count < maxLeaves) leavesRtn[count] = &leaf;
+			count++;
+		}, queryStats ? &counters : nullptr);
+	}
+	if (queryStats) queryStats->add(BoxQuery, counters);
+	return count;
+}
+
+// closest point to p on triangle abc (Ericson, Real-Time Collision
+// Detection 5.1.5), by the Voronoi region of the triangle p falls in
+//
+static glm::vec3 closestOnTriangle(const glm::vec3 & p, const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c) {
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0 && d2 <= 0) return a;
+
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0 && d4 <= d3) return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0 && d5 <= d6) return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1 / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// the face normal follows the winding, unless the mesh has vertex normals
+// to say which side is out
+//
+void Octree::itemDistance(const ofMesh & mesh, bool bUseFaces, int item, const glm::vec3 & p, NearestPoint & nearestRtn) {
+	nearestRtn.index = item;
+	if (!bUseFaces) {
+		glm::vec3 v = mesh.getVertex(item);
+		nearestRtn.point = v;
+		nearestRtn.distance = glm::distance(p, v);
+		nearestRtn.normal = item < mesh.getNumNormals() ? ofVec3f(mesh.getNormal(item)) : ofVec3f(0, 0, 0);
+		return;
+	}
+
+	bool indexed = mesh.getNumIndices() > 0;
+	int corner[3];
+	glm::vec3 v[3];
+	for (int k = 0; k < 3; k++) {
+		corner[k] = indexed ? mesh.getIndex(3 * item + k) : 3 * item + k;
+		v[k] = mesh.getVertex(corner[k]);
+	}
+	glm::vec3 q = closestOnTriangle(p, v[0], v[1], v[2]);
+	glm::vec3 n = glm::cross(v[1] - v[0], v[2] - v[0]);
+	float len = glm::length(n);
+	if (len > 0) n /= len;
+	if (mesh.getNumNormals() == mesh.getNumVertices()) {
+		glm::vec3 out = mesh.getNormal(corner[0]) + mesh.getNormal(corner[1]) + mesh.getNormal(corner[2]);
+		if (glm::dot(n, out) < 0) n = -n;
+	}
+	nearestRtn.point = q;
+	nearestRtn.normal = n;
+	nearestRtn.distance = glm::distance(p, q);
+}
+
+void Octree::keepNearest(vector<NearestPoint> & nearest, int k, const NearestPoint & candidate) {
+	if (nearest.size() == k && candidate.distance >= nearest.back().distance) return;
+	for (int i = 0; i < nearest.size(); i++) {
+		if (nearest[i].index == candidate.index) return;
+	}
+	vector<NearestPoint>::iterator at = upper_bound(nearest.begin(), nearest.end(), candidate,
+		[](const NearestPoint & a, const NearestPoint & b) { return a.distance < b.distance; });
+	nearest.insert(at, candidate);
+	if (nearest.size() > k) nearest.pop_back();
+}
+
+// distance from p to the box, 0 inside
+//
+float Octree::boxDistance(const Box & box, const glm::vec3 & p) {
+	float d2 = 0;
+	for (int a = 0; a < 3; a++) {
+		float lo = box.parameters[0][a], hi = box.parameters[1][a];
+		float d = p[a] < lo ? lo - p[a] : (p[a] > hi ? p[a] - hi : 0);
+		d2 += d * d;
+	}
+	return sqrt(d2);
+}
+
+bool Octree::closestPoint(const ofVec3f & p, NearestPoint & nearestRtn, float maxDistance) const {
+	vector<NearestPoint> nearestList;
+	nearestRtn = NearestPoint();
+	if (nearest(p, 1, nearestList, maxDistance) == 0) return false;
+	nearestRtn = nearestList[0];
+	return true;
+}
+
+int Octree::nearest(const ofVec3f & p, int k, vector<NearestPoint> & nearestRtn, float maxDistance) const {
+	nearestRtn.clear();
+	if (k <= 0 || (root.points.empty() && root.children.empty() && root.end == root.begin)) return 0;
+
+	// the k-th closest so far, or maxDistance until there are k
+	//
+	glm::vec3 q = p;
+	auto bound = [&]() { return nearestRtn.size() == k ? std::min(nearestRtn.back().distance, maxDistance) : maxDistance; };
+
+	typedef pair<float, const TreeNode *> Entry;
+	priority_queue<Entry, vector<Entry>, greater<Entry>> queue;
+	queue.push(Entry(boxDistance(root.box, q), &root));
+	while (!queue.empty()) {
+		Entry entry = queue.top();
+		queue.pop();
+		if (entry.first > bound()) break;
+		const TreeNode & node = *entry.second;
+
+		// a face tree's interior nodes own faces too, a point tree's only
+		// hold their subtree's points
+		//
+		if (node.children.empty() || bUseFaces) {
+			const int * nodeItems;
+			int count = getItems(node, nodeItems);
+			for (int i = 0; i < count; i++) {
+				NearestPoint candidate;
+				itemDistance(mesh, bUseFaces, nodeItems[i], q, candidate);
+				if (candidate.distance <= maxDistance) keepNearest(nearestRtn, k, candidate);
+			}
+		}
 		for (int i = 0; i < node.children.size(); i++) {
-			intersect(box, node.children[i], boxListRtn);
+			float d = boxDistance(node.children[i].box, q);
+			if (d <= bound()) queue.push(Entry(d, &node.children[i]));
 		}
 	}
+	return (int)nearestRtn.size();
+}
 
-	// if leaf node, add to colliding box list
+// narrow the time interval [tEnter, tExit] to when the box interval,
+// moving at speed v, overlaps the item interval.  False once it is empty.
+//
+static bool sweepAxis(float boxMin, float boxMax, float v, float itemMin, float itemMax, float & tEnter, float & tExit) {
+	if (v == 0) return boxMax >= itemMin && boxMin <= itemMax;
+	float t0 = (itemMin - boxMax) / v;
+	float t1 = (itemMax - boxMin) / v;
+	if (t0 > t1) swap(t0, t1);
+	tEnter = std::max(tEnter, t0);
+	tExit = std::min(tExit, t1);
+	return tEnter <= tExit;
+}
+
+// a vertex is hit when the moving box first contains it.  A face is hit
+// when no separating axis remains: the three box axes, the face normal
+// and the nine edge x axis cross products.  Contacts after tMax (the best
+// so far) are rejected as soon as an axis shows it.
+//
+bool Octree::sweepItem(const ofMesh & mesh, bool bUseFaces, int item, const Box & box, const glm::vec3 & motion,
+	float tMax, float & tRtn) {
+	glm::vec3 lo(box.parameters[0].x(), box.parameters[0].y(), box.parameters[0].z());
+	glm::vec3 hi(box.parameters[1].x(), box.parameters[1].y(), box.parameters[1].z());
+	float tEnter = 0, tExit = std::min(tMax, 1.0f);
+
+	if (!bUseFaces) {
+		glm::vec3 v = mesh.getVertex(item);
+		for (int a = 0; a < 3; a++) {
+			if (!sweepAxis(lo[a], hi[a], motion[a], v[a], v[a], tEnter, tExit)) return false;
+		}
+		tRtn = tEnter;
+		return true;
+	}
+
+	Vector3 corners[3];
+	getFaceVertices(mesh, item, corners);
+	glm::vec3 p[3];
+	for (int k = 0; k < 3; k++) p[k] = glm::vec3(corners[k].x(), corners[k].y(), corners[k].z());
+
+	// the box axes first, they reject most faces
 	//
-	if (node.children.empty()) {
-		boxListRtn.push_back(node.box);
+	for (int a = 0; a < 3; a++) {
+		float itemMin = std::min(p[0][a], std::min(p[1][a], p[2][a]));
+		float itemMax = std::max(p[0][a], std::max(p[1][a], p[2][a]));
+		if (!sweepAxis(lo[a], hi[a], motion[a], itemMin, itemMax, tEnter, tExit)) return false;
 	}
 
+	glm::vec3 center = (lo + hi) * 0.5f;
+	glm::vec3 half = (hi - lo) * 0.5f;
+	glm::vec3 edges[3] = { p[1] - p[0], p[2] - p[1], p[0] - p[2] };
+	glm::vec3 axes[10];
+	axes[0] = glm::cross(edges[0], edges[1]);
+	for (int e = 0; e < 3; e++) {
+		axes[1 + 3 * e] = glm::vec3(0, -edges[e].z, edges[e].y);      // edge x (1, 0, 0)
+		axes[2 + 3 * e] = glm::vec3(edges[e].z, 0, -edges[e].x);      // edge x (0, 1, 0)
+		axes[3 + 3 * e] = glm::vec3(-edges[e].y, edges[e].x, 0);      // edge x (0, 0, 1)
+	}
+
+	for (int i = 0; i < 10; i++) {
+		glm::vec3 axis = axes[i];
+		if (glm::dot(axis, axis) < 1e-12f) continue;     // parallel edge and axis
+		float c = glm::dot(center, axis);
+		float r = half.x * fabs(axis.x) + half.y * fabs(axis.y) + half.z * fabs(axis.z);
+		float d0 = glm::dot(p[0], axis), d1 = glm::dot(p[1], axis), d2 = glm::dot(p[2], axis);
+		float itemMin = std::min(d0, std::min(d1, d2));
+		float itemMax = std::max(d0, std::max(d1, d2));
+		if (!sweepAxis(c - r, c + r, glm::dot(motion, axis), itemMin, itemMax, tEnter, tExit)) return false;
+	}
+	tRtn = tEnter;
 	return true;
 }
 
+// grow the boxes by the half size of box, so the swept box becomes a ray
+// from its center
+//
+void Octree::growBox8(Box8 & boxes, const Box & box) {
+	Vector3 half = (box.parameters[1] - box.parameters[0]) / 2;
+	for (int i = 0; i < boxes.count; i++) {
+		boxes.minX[i] -= half.x();
+		boxes.minY[i] -= half.y();
+		boxes.minZ[i] -= half.z();
+		boxes.maxX[i] += half.x();
+		boxes.maxY[i] += half.y();
+		boxes.maxZ[i] += half.z();
+	}
+}
+
+bool Octree::sweep(const Box & box, const ofVec3f & motion, SweepHit & hitRtn) const {
+	hitRtn = SweepHit();
+	Box8 rootBox;
+	rootBox.count = 1;
+	rootBox.set(0, root.box);
+	growBox8(rootBox, box);
+	Vector3 center = (box.parameters[0] + box.parameters[1]) / 2;
+	Ray ray(center, Vector3(motion.x, motion.y, motion.z));
+	float tNear[8];
+	if (!rayIntersectBox8(rootBox, ray, 0, 1, tNear)) return false;
+	sweepNode(ray, box, root, hitRtn);
+	return hitRtn.index >= 0;
+}
+
+void Octree::sweepNode(const Ray & ray, const Box & box, const TreeNode & node, SweepHit & hitRtn) const {
+	if (node.children.empty() || bUseFaces) {
+		const int * nodeItems;
+		int count = getItems(node, nodeItems);
+		glm::vec3 motion(ray.direction.x(), ray.direction.y(), ray.direction.z());
+		for (int i = 0; i < count; i++) {
+			float t;
+			if (sweepItem(mesh, bUseFaces, nodeItems[i], box, motion, hitRtn.t, t) && t < hitRtn.t) {
+				hitRtn.t = t;
+				hitRtn.index = nodeItems[i];
+				hitRtn.leafBox = node.box;
+			}
+		}
+	}
+	if (node.children.empty()) return;
+
+	Box8 boxes;
+	float tNear[8];
+	int order[8];
+	loadChildBoxes(node, boxes);
+	growBox8(boxes, box);
+	int count = sortHitsBox8(rayIntersectBox8(boxes, ray, 0, std::min(hitRtn.t, 1.0f), tNear), tNear, order);
+	for (int j = 0; j < count; j++) {
+		if (tNear[order[j]] > hitRtn.t) break;
+		sweepNode(ray, box, node.children[order[j]], hitRtn);
+	}
+}
+
+// rays traced as a packet: each node's child boxes are loaded once and
+// tested against every ray still active in the packet, and each face a
+// node owns is fetched once for all of them.  Only face trees are walked
+// as packets; a point tree answers with the first leaf each ray enters,
+// which differs from ray to ray, so its rays are walked one at a time.
+//
+void Octree::packetHit(const Ray * rays, RayHit * hitsRtn, int count) const {
+	unsigned active = 0;
+	for (int i = 0; i < count; i++) {
+		hitsRtn[i] = RayHit();
+		if (root.box.intersect(rays[i], 0, FLT_MAX)) active |= 1u << i;
+	}
+	if (!bUseFaces) {
+		for (int i = 0; i < count; i++) {
+			if (active & (1u << i)) nearestHit(rays[i], root, hitsRtn[i]);
+		}
+		return;
+	}
+	if (active) packetHit(rays, hitsRtn, active, root);
+}
+
+void Octree::packetHit(const Ray * rays, RayHit * hitsRtn, unsigned active, const TreeNode & node) const {
+	for (int i = 0; i < node.points.size(); i++) {
+		Vector3 p[3];
+		getFaceVertices(mesh, node.points[i], p);
+		for (int r = 0; r < PACKET_SIZE; r++) {
+			float t;
+			if (!(active & (1u << r))) continue;
+			if (rayIntersectTriangle(rays[r], p, t) && t < hitsRtn[r].t) {
+				Vector3 hit = rays[r].origin + rays[r].direction * t;
+				hitsRtn[r].t = t;
+				hitsRtn[r].index = node.points[i];
+				hitsRtn[r].point = ofVec3f(hit.x(), hit.y(), hit.z());
+			}
+		}
+	}
+	if (node.children.empty()) return;
+
+	// which rays enter each child before their best hit, and the nearest
+	// entry of any of them to order the children front to back
+	//
+	Box8 boxes;
+	float tNear[PACKET_SIZE][8];
+	float packetNear[8];
+	unsigned childRays[8] = { 0 };
+	int childMask = 0;
+	loadChildBoxes(node, boxes);
+	for (int c = 0; c < 8; c++) packetNear[c] = FLT_MAX;
+	for (int r = 0; r < PACKET_SIZE; r++) {
+		if (!(active & (1u << r))) continue;
+		int mask = rayIntersectBox8(boxes, rays[r], 0, hitsRtn[r].t, tNear[r]);
+		childMask |= mask;
+		for (int c = 0; c < boxes.count; c++) {
+			if (!(mask & (1 << c))) continue;
+			childRays[c] |= 1u << r;
+			if (tNear[r][c] < packetNear[c]) packetNear[c] = tNear[r][c];
+		}
+	}
+
+	int order[8];
+	int count = sortHitsBox8(childMask, packetNear, order);
+	for (int j = 0; j < count; j++) {
+		int c = order[j];
+
+		// drop the rays that found a closer hit in an earlier child
+		//
+		unsigned childActive = 0;
+		for (int r = 0; r < PACKET_SIZE; r++) {
+			if ((childRays[c] & (1u << r)) && tNear[r][c] < hitsRtn[r].t) childActive |= 1u << r;
+		}
+		if (childActive) packetHit(rays, hitsRtn, childActive, node.children[c]);
+	}
+}
+
+void Octree::packetOverlap(const Box * boxes, vector<Box> * boxListsRtn, unsigned active, const TreeNode & node) const {
+	if (node.children.empty()) {
+		for (int b = 0; b < PACKET_SIZE; b++) {
+			if (active & (1u << b)) boxListsRtn[b].push_back(node.box);
+		}
+		return;
+	}
+	Box8 childBoxes;
+	unsigned childQueries[8] = { 0 };
+	loadChildBoxes(node, childBoxes);
+	for (int b = 0; b < PACKET_SIZE; b++) {
+		if (!(active & (1u << b))) continue;
+		int mask = boxOverlapBox8(childBoxes, boxes[b]);
+		for (int c = 0; c < childBoxes.count; c++) {
+			if (mask & (1 << c)) childQueries[c] |= 1u << b;
+		}
+	}
+	for (int c = 0; c < childBoxes.count; c++) {
+		if (childQueries[c]) packetOverlap(boxes, boxListsRtn, childQueries[c], node.children[c]);
+	}
+}
+
+int Octree::intersect(const vector<Ray> & rays, vector<RayHit> & hitsRtn, ThreadPool * pool) const {
+	int numRays = (int)rays.size();
+	int numPackets = (numRays + PACKET_SIZE - 1) / PACKET_SIZE;
+	hitsRtn.resize(numRays);
+
+	auto trace = [&](int begin, int end) {
+		for (int p = begin; p < end; p++) {
+			int first = p * PACKET_SIZE;
+			packetHit(&rays[first], &hitsRtn[first], std::min(PACKET_SIZE, numRays - first));
+		}
+	};
+	if (pool && pool->size() > 1 && numPackets > 1) pool->parallelFor(numPackets, trace);
+	else trace(0, numPackets);
+
+	int hits = 0;
+	for (int i = 0; i < numRays; i++) {
+		if (hitsRtn[i].index >= 0) hits++;
+	}
+	return hits;
+}
+
+void Octree::intersect(const vector<Box> & boxes, vector<vector<Box>> & boxListsRtn, ThreadPool * pool) const {
+	int numBoxes = (int)boxes.size();
+	int numPackets = (numBoxes + PACKET_SIZE - 1) / PACKET_SIZE;
+	boxListsRtn.resize(numBoxes);
+
+	auto trace = [&](int begin, int end) {
+		for (int p = begin; p < end; p++) {
+			int first = p * PACKET_SIZE;
+			int count = std::min(PACKET_SIZE, numBoxes - first);
+			unsigned active = 0;
+			for (int b = 0; b < count; b++) {
+				boxListsRtn[first + b].clear();
+				if (root.box.overlap(boxes[first + b])) active |= 1u << b;
+			}
+			if (active) packetOverlap(&boxes[first], &boxListsRtn[first], active, root);
+		}
+	};
+	if (pool && pool->size() > 1 && numPackets > 1) pool->parallelFor(numPackets, trace);
+	else trace(0, numPackets);
+}
+
 void Octree::draw(TreeNode & node, int numLevels, int level) {
 	if (level > numLevels) return;
 
@@ -269,6 +1500,58 @@ void Octree::draw(TreeNode & node, int numLevels, int level) {
 	}
 }
 
+void Octree::draw(int numLevels, int level) {
+	if (!lines.matches(version, level, numLevels, false)) {
+		buildLineMesh(lines.mesh, level, numLevels, false);
+		lines.setKey(version, level, numLevels, false);
+	}
+	lines.mesh.draw();
+}
+
+void Octree::drawLeafNodes() {
+	if (!leafLines.matches(version, 0, INT_MAX, true)) {
+		buildLineMesh(leafLines.mesh, 0, INT_MAX, true);
+		leafLines.setKey(version, 0, INT_MAX, true);
+	}
+	leafLines.mesh.draw();
+}
+
+// corners in subDivideBox8() order (bottom then top, going around in x z),
+// the 4 bottom edges, 4 top edges and 4 uprights
+//
+void OctreeLineMesh::addBox(ofMesh & mesh, const Box & box, const ofColor & color) {
+	static const int edges[24] = { 0, 1, 1, 2, 2, 3, 3, 0, 4, 5, 5, 6, 6, 7, 7, 4, 0, 4, 1, 5, 2, 6, 3, 7 };
+	Vector3 lo = box.parameters[0];
+	Vector3 hi = box.parameters[1];
+	int first = (int)mesh.getNumVertices();
+	for (int y = 0; y < 2; y++) {
+		float py = y ? hi.y() : lo.y();
+		mesh.addVertex(glm::vec3(lo.x(), py, lo.z()));
+		mesh.addVertex(glm::vec3(hi.x(), py, lo.z()));
+		mesh.addVertex(glm::vec3(hi.x(), py, hi.z()));
+		mesh.addVertex(glm::vec3(lo.x(), py, hi.z()));
+	}
+	for (int i = 0; i < 8; i++) mesh.addColor(color);
+	for (int i = 0; i < 24; i++) mesh.addIndex(first + edges[i]);
+}
+
+void Octree::buildLineMesh(ofMesh & meshRtn, int minLevel, int maxLevel, bool leavesOnly) const {
+	meshRtn.clear();
+	meshRtn.setMode(OF_PRIMITIVE_LINES);
+	addLines(meshRtn, root, 0, minLevel, maxLevel, leavesOnly);
+}
+
+// leaves take the last color, as drawLeafNodes() always has
+//
+void Octree::addLines(ofMesh & meshRtn, const TreeNode & node, int level, int minLevel, int maxLevel, bool leavesOnly) const {
+	if (level > maxLevel) return;
+	bool leaf = node.children.empty();
+	if (level >= minLevel && (!leavesOnly || leaf))
+		OctreeLineMesh::addBox(meshRtn, node.box, leavesOnly ? colors.back() : colors[level % colors.size()]);
+	for (int i = 0; i < node.children.size(); i++)
+		addLines(meshRtn, node.children[i], level + 1, minLevel, maxLevel, leavesOnly);
+}
+
 // Optional
 //
 void Octree::drawLeafNodes(TreeNode & node) {
@@ -12,14 +12,102 @@
 #include "ofMain.h"
 #include "box.h"
 #include "ray.h"
+#include "SimdBox.h"
+#include "OctreeStats.h"
+#include <climits>
 
+class ThreadPool;
 
+// how Octree::create() sorts points into the tree
+//
+//   RecursiveBuild - split each node and test every point against the 8 child boxes
+//   MortonBuild    - sort the points once by Morton code and cut the sorted list
+//   PartitionBuild - partition one index array in place by octant; nodes only
+//                    keep their [begin, end) range of it (see Octree::items)
+//
+typedef enum { RecursiveBuild, MortonBuild, PartitionBuild } OctreeBuildType;
 
+// a mesh vertex (or with bUseFaces a face) moved by Octree::update(),
+// with its corners before and after the edit
+//
+class OctreeEdit {
+public:
+	int item;
+	Vector3 before[3];
+	Vector3 after[3];
+};
+
+// nearest hit returned by the ray queries
+//
+class RayHit {
+public:
+	ofVec3f point;
+	float t = FLT_MAX;      // distance along the ray (in units of ray direction)
+	int index = -1;         // face index (bUseFaces) or mesh vertex index
+};
+
+// result of the closest point / k nearest queries
+//
+class NearestPoint {
+public:
+	ofVec3f point;          // closest point on the face, or the vertex
+	ofVec3f normal;         // face normal, or the mesh normal of the vertex (if it has normals)
+	float distance = FLT_MAX;
+	int index = -1;         // face index (bUseFaces) or mesh vertex index
+};
+
+// first contact of a box moved along a displacement, returned by sweep()
+//
+class SweepHit {
+public:
+	float t = FLT_MAX;      // fraction of the displacement (0 - 1) before contact
+	int index = -1;         // face index (bUseFaces) or mesh vertex index
+	Box leafBox;            // box of the node the face or vertex was found in
+};
+
+
+//  points holds mesh vertex indices, or with bUseFaces the faces owned by
+//  the node: a leaf owns all of its faces, an interior node only the faces
+//  too big to hand down to its children (see sortFacesIntoChildren()).
+//  A PartitionBuild tree leaves points empty and gives every node the range
+//  [begin, end) of Octree::items under it instead; use Octree::getItems().
+//
 class TreeNode {
 public:
 	Box box;
 	vector<int> points;
 	vector<TreeNode> children;
+	int begin = 0;
+	int end = 0;
+};
+
+// the boxes of an octree as one indexed line mesh (8 vertices and 12
+// lines per box) for debug drawing.  The tree keeps the last one built
+// with the tree version and levels it was built for (one for levels and
+// one for leaves), and only builds a new one when either changes.
+//
+class OctreeLineMesh {
+public:
+	bool matches(int treeVersion, int minLevel, int maxLevel, bool leavesOnly) const {
+		return treeVersion == version && minLevel == first && maxLevel == last && leavesOnly == leaves;
+	}
+	void setKey(int treeVersion, int minLevel, int maxLevel, bool leavesOnly) {
+		version = treeVersion;
+		first = minLevel;
+		last = maxLevel;
+		leaves = leavesOnly;
+		builds++;
+	}
+	static void addBox(ofMesh & mesh, const Box & box, const ofColor & color);
+
+	ofVboMesh mesh;
+	int builds = 0;         // number of times the mesh was built (for checks)
+
+private:
+	int version = -1;
+	int first = 0;
+	int last = 0;
+	bool leaves = false;
 };
 
 class Octree {
@@ -27,26 +115,186 @@ public:
 	
 	void create(const ofMesh & mesh, int numLevels);
 	void subdivide(const ofMesh & mesh, TreeNode & node, int numLevels, int level);
+	void subdivideParallel(const ofMesh & mesh, TreeNode & node, int numLevels, int level,
+		ThreadPool & pool, vector<pair<TreeNode *, int>> & subtrees);
+	void createMorton(int numLevels);
+	void subdivideMorton(TreeNode & node, const vector<uint64_t> & keys, const vector<int> & order,
+		int begin, int end, int numLevels, int level, int bits);
+	void subdividePartition(const ofMesh & mesh, TreeNode & node, int numLevels, int level,
+		vector<pair<TreeNode *, int>> * subtrees = nullptr);
 	bool intersect(const Ray &, const TreeNode & node, TreeNode & nodeRtn);
-	bool intersect(const Box &, TreeNode & node, vector<Box> & boxListRtn);
+	bool intersect(const Ray &, RayHit & hitRtn) const;
+	bool nearestHit(const Ray &, const TreeNode & node, RayHit & hitRtn, QueryCounters * counters = nullptr) const;
+	bool intersect(const Box &, const TreeNode & node, vector<Box> & boxListRtn) const;
+
+	// allocation free box queries: call visit(leaf) for every leaf under
+	// node that overlaps the box, or store up to maxLeaves of them in a
+	// caller owned buffer.  The buffer form returns the total number of
+	// overlapping leaves, which can be more than maxLeaves.
+	//
+	template <typename Visitor> void visitLeaves(const Box &, const TreeNode & node, Visitor && visit,
+		QueryCounters * counters = nullptr) const;
+	int intersect(const Box &, const TreeNode * leavesRtn[], int maxLeaves) const;
+
+	// batch queries: hitsRtn[i] / boxListsRtn[i] answer rays[i] / boxes[i].
+	// Neighbouring queries are traced together in packets of PACKET_SIZE that
+	// share node visits, so pass coherent rays (a sensor fan, a scan line)
+	// next to each other.  With a pool the packets are split across its
+	// threads.  Returns the number of rays that hit.
+	//
+	static constexpr int PACKET_SIZE = 16;
+	int intersect(const vector<Ray> & rays, vector<RayHit> & hitsRtn, ThreadPool * pool = nullptr) const;
+	void intersect(const vector<Box> & boxes, vector<vector<Box>> & boxListsRtn, ThreadPool * pool = nullptr) const;
+	void packetHit(const Ray * rays, RayHit * hitsRtn, int count) const;
+	void packetHit(const Ray * rays, RayHit * hitsRtn, unsigned active, const TreeNode & node) const;
+	void packetOverlap(const Box * boxes, vector<Box> * boxListsRtn, unsigned active, const TreeNode & node) const;
+
+	// closest face (or vertex) to p, and the k closest sorted nearest first,
+	// within maxDistance.  Best first branch and bound: nodes come off a
+	// priority queue by the distance from p to their box, and the search
+	// ends when the next box is farther than the k-th closest item so far.
+	// nearest() returns the number found.
+	//
+	bool closestPoint(const ofVec3f & p, NearestPoint & nearestRtn, float maxDistance = FLT_MAX) const;
+	int nearest(const ofVec3f & p, int k, vector<NearestPoint> & nearestRtn, float maxDistance = FLT_MAX) const;
+
+	// helpers shared with LinearOctree: the distance from p to one item, and
+	// adding a candidate to a sorted list of the k nearest (an item reached
+	// through more than one node is only kept once)
+	//
+	static void itemDistance(const ofMesh &, bool bUseFaces, int item, const glm::vec3 & p, NearestPoint & nearestRtn);
+	static void keepNearest(vector<NearestPoint> & nearest, int k, const NearestPoint & candidate);
+	static float boxDistance(const Box &, const glm::vec3 & p);
+
+	// continuous collision: move box along motion and find the first face
+	// (or vertex) it touches.  Nodes are visited front to back by when the
+	// moving box enters them (a ray from the box center against the node
+	// boxes grown by its half size), and each face is tested exactly with
+	// a separating axis test in time.  Contact at t = 0 means the box
+	// already touches the terrain.
+	//
+	bool sweep(const Box & box, const ofVec3f & motion, SweepHit & hitRtn) const;
+	void sweepNode(const Ray & ray, const Box & box, const TreeNode & node, SweepHit & hitRtn) const;
+	static bool sweepItem(const ofMesh &, bool bUseFaces, int item, const Box & box, const glm::vec3 & motion,
+		float tMax, float & tRtn);
+	static void growBox8(Box8 & boxes, const Box & box);
 	void draw(TreeNode & node, int numLevels, int level);
-	void draw(int numLevels, int level) {
-		draw(root, numLevels, level);
-	}
 	void drawLeafNodes(TreeNode & node);
+
+	// cached line mesh drawing: the boxes of levels level to numLevels
+	// (the root is level 0) colored by level, or all leaves
+	//
+	void draw(int numLevels, int level);
+	void drawLeafNodes();
+	void buildLineMesh(ofMesh & meshRtn, int minLevel, int maxLevel, bool leavesOnly) const;
+	void addLines(ofMesh & meshRtn, const TreeNode & node, int level, int minLevel, int maxLevel, bool leavesOnly) const;
+	OctreeLineMesh lines, leafLines;
 	static void drawBox(const Box &box);
 	static Box meshBounds(const ofMesh &);
 	int getMeshPointsInBox(const ofMesh &mesh, const vector<int> & points, Box & box, vector<int> & pointsRtn);
 	int getMeshFacesInBox(const ofMesh &mesh, const vector<int> & faces, Box & box, vector<int> & facesRtn);
+	void sortFacesIntoChildren(const ofMesh &mesh, TreeNode & node, vector<Box> & subBoxes,
+		vector<int> childFaces[8], ThreadPool * pool);
+	static int meshFaceCount(const ofMesh &);
+	static void getFaceVertices(const ofMesh &, int face, Vector3 p[3]);
+	static bool rayIntersectTriangle(const Ray &, const Vector3 p[3], float & t);
+
+	// octant of a child box as bits (1 = upper x, 2 = upper y, 4 = upper z),
+	// and the children in mask put in the order a ray passes through their
+	// octants: octant order flipped by the ray's direction signs, which never
+	// visits a child before one that is in front of it.  Returns the count.
+	//
+	static int childOctant(const Box & parent, const Box & child);
+	static int rayOrder(const Ray &, int mask, const int octants[8], int order[8]);
 	void subDivideBox8(const Box &b, vector<Box> & boxList);
 
 	ofMesh mesh;
 	TreeNode root;
 	bool bUseFaces = false;
+
+	// the mesh vertex indices of a PartitionBuild tree, permuted so that
+	// the points of every node are contiguous.  getItems() returns the
+	// points (or faces) of a node with either kind of build.
+	//
+	vector<int> items;
+	int getItems(const TreeNode & node, const int *& itemsRtn) const;
+
+	// parallel build: nodes above parallelDepth are split on the calling
+	// thread (their eight point sorts run on the pool), every subtree
+	// below it is built serially by one worker.  Produces the same tree
+	// as the serial build.  A PartitionBuild hands out the subtrees the
+	// same way, each worker partitioning its own range of items.
+	//
+	int numThreads = 1;
+	int parallelDepth = 2;
+
+	OctreeBuildType buildType = RecursiveBuild;
+
+	static bool sameTree(const TreeNode & a, const TreeNode & b);
+
+	// shape of the tree (node counts per level, leaf occupancy, ...)
+	//
+	OctreeStats stats() const;
+
+	// while set, the single ray (RayHit) and box queries add their
+	// counters to it.  Costs a branch per node when not set.
+	//
+	QueryStats * queryStats = nullptr;
+
+	// incremental update for local terrain edits: move mesh vertices to new
+	// positions and fix up only the nodes the moved points (or the faces
+	// using them) were in or move into, giving the same tree as rebuilding
+	// with create().  Returns the number of nodes visited, or -1 if a vertex
+	// left the root box and the tree had to be rebuilt with create().  A
+	// PartitionBuild tree is always rebuilt (its ranges can't grow in place).
+	//
+	int update(const vector<int> & vertices, const vector<glm::vec3> & positions);
+	void updateNode(TreeNode & node, int level, const vector<OctreeEdit> & edits,
+		const vector<int> & before, const vector<int> & after, int & touched);
+	int routeEdit(const Vector3 p[3], vector<Box> & subBoxes, bool & keep) const;
+
+	// the faces using each vertex: faces[start[v]] to faces[start[v + 1]]
+	//
+	static void vertexFaceTable(const ofMesh &, vector<int> & startRtn, vector<int> & facesRtn);
+
+	// vertices of a point tree within radius (in x and z) of center, pushed
+	// down into a bowl up to depth deep.  Pass the result to update() on
+	// every tree built from the same mesh.
+	//
+	void craterEdit(const ofVec3f & center, float radius, float depth,
+		vector<int> & verticesRtn, vector<glm::vec3> & positionsRtn) const;
+
+	// extra room around the mesh bounds for the root box, so terrain edits
+	// (craters) can move vertices down without forcing a rebuild
+	//
+	float boundsMargin = 0;
+
+	int builtLevels = 0;
+	int version = 0;                 // bumped by create() and update()
+	bool bTimingInfo = false;        // print how long each update() took
+	vector<int> vertexFaceStart;     // faces using each vertex (face trees, built on first update)
+	vector<int> vertexFaces;
 	vector<ofColor> colors{ ofColor::red, ofColor::orange, ofColor::yellow, ofColor::green, ofColor::blue, ofColor::purple };
+};
+
+template <typename Visitor>
+void Octree::visitLeaves(const Box & box, const TreeNode & node, Visitor && visit, QueryCounters * counters) const {
+	if (counters) counters->nodesVisited++;
+	if (node.children.empty()) {
+		if (counters) counters->leavesReturned++;
+		visit(node);
+		return;
+	}
 
-	// debug;
+	// test all children against the box in one go
 	//
-	int strayVerts= 0;
-	int numLeaf = 0;
-};
\ No newline at end of file
+	Box8 boxes;
+	boxes.count = (int)node.children.size();
+	for (int i = 0; i < boxes.count; i++)
+		boxes.set(i, node.children[i].box);
+	int mask = boxOverlapBox8(boxes, box);
+	if (counters) counters->boxesTested += boxes.count;
+	for (int i = 0; i < boxes.count; i++) {
+		if (mask & (1 << i)) visitLeaves(box, node.children[i], visit, counters);
+	}
+}
\ No newline at end of file
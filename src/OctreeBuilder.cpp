@@ -0,0 +1,105 @@
+//--------------------------------------------------------------
+//
+//  Background octree build - see OctreeBuilder.h
+//
+
+#include "OctreeBuilder.h"
+
+OctreeBuilder::~OctreeBuilder() {
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		stopping = true;
+		generation++;
+	}
+	requested.notify_one();
+	if (worker.joinable()) worker.join();
+}
+
+// the worker thread is started by the first build and waits for the
+// next one after that
+//
+void OctreeBuilder::start(const ofMesh & mesh, int numLevels, bool bUseFaces, int numThreads, const string & cachePath) {
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		request.mesh = mesh;
+		request.numLevels = numLevels;
+		request.bUseFaces = bUseFaces;
+		request.numThreads = numThreads;
+		request.boundsMargin = boundsMargin;
+		request.cachePath = cachePath;
+		hasRequest = true;
+		generation++;
+		pending = true;
+		std::atomic_store(&ready, std::shared_ptr<Stage>());
+	}
+	if (!worker.joinable()) worker = std::thread(&OctreeBuilder::buildLoop, this);
+	requested.notify_one();
+}
+
+int OctreeBuilder::take(LinearOctree & treeRtn) {
+	std::shared_ptr<Stage> stage = std::atomic_exchange(&ready, std::shared_ptr<Stage>());
+	if (!stage) return 0;
+	treeRtn.swap(stage->tree);
+	if (stage->last) pending = false;
+	return stage->numLevels;
+}
+
+// a stage of an old build is dropped.  The check and the store are done
+// under the lock so start() can not slip in between them.
+//
+bool OctreeBuilder::publish(const std::shared_ptr<Stage> & stage, int gen) {
+	std::unique_lock<std::mutex> guard(lock);
+	if (gen != generation) return false;
+	std::atomic_store(&ready, stage);
+	return true;
+}
+
+void OctreeBuilder::buildLoop() {
+	while (true) {
+		Request job;
+		int gen;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			requested.wait(guard, [this] { return stopping || hasRequest; });
+			if (stopping) return;
+			job = request;
+			gen = generation;
+			hasRequest = false;
+		}
+
+		float startTime = ofGetElapsedTimeMillis();
+		uint64_t key = job.cachePath.empty() ? 0 : LinearOctree::cacheKey(job.mesh, job.numLevels, job.bUseFaces, job.boundsMargin);
+		std::shared_ptr<Stage> stage = std::make_shared<Stage>();
+		stage->tree.bUseFaces = job.bUseFaces;
+		stage->tree.numThreads = job.numThreads;
+		stage->tree.boundsMargin = job.boundsMargin;
+		if (!job.cachePath.empty() && stage->tree.load(job.cachePath, key, job.mesh)) {
+			stage->numLevels = job.numLevels;
+			stage->last = true;
+			publish(stage, gen);
+			continue;
+		}
+
+		int levels = std::min(std::max(levelStep, 1), job.numLevels);
+		while (true) {
+			stage->numLevels = levels;
+			stage->last = levels == job.numLevels;
+			stage->tree.create(job.mesh, levels);
+			if (stage->last && !job.cachePath.empty() && !stage->tree.save(job.cachePath, key))
+				cout << "Could not write octree cache " << job.cachePath << endl;
+			if (!publish(stage, gen)) break;
+			if (stage->last) {
+				cout << "Background octree build (" << job.numLevels << " levels) done in "
+					<< ofGetElapsedTimeMillis() - startTime << " ms" << endl;
+				break;
+			}
+
+			std::shared_ptr<Stage> next = std::make_shared<Stage>();
+			next->tree.bUseFaces = job.bUseFaces;
+			next->tree.numThreads = job.numThreads;
+			next->tree.boundsMargin = job.boundsMargin;
+			stage = next;
+			levels = std::min(levels + std::max(levelStep, 1), job.numLevels);
+		}
+	}
+}
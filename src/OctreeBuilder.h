@@ -0,0 +1,84 @@
+//--------------------------------------------------------------
+//
+//  Background octree build.
+//
+//  OctreeBuilder builds a LinearOctree on its own thread so neither
+//  startup nor a change of the level count stalls a frame.  The tree is
+//  built progressively: first levelStep levels, then levelStep more and
+//  so on up to the level count asked for, and every stage is published
+//  as soon as it is done, so coarse queries work long before the full
+//  tree is ready.
+//
+//  A finished stage is handed over through an atomically exchanged
+//  pointer.  take() never waits: it swaps a newly published tree into
+//  the caller's tree (no copy), so the caller only ever sees complete
+//  trees and can call it once a frame from the thread that uses the
+//  tree.
+//
+#pragma once
+#include "ofMain.h"
+#include "LinearOctree.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+class OctreeBuilder {
+public:
+	OctreeBuilder() {}
+	~OctreeBuilder();
+	OctreeBuilder(const OctreeBuilder &) = delete;
+	OctreeBuilder & operator=(const OctreeBuilder &) = delete;
+
+	// build mesh to numLevels, replacing any build still in progress (its
+	// current stage finishes but is thrown away).  With a cache path the
+	// full tree is loaded from the cache if it matches, without stages,
+	// and the cache is rewritten once the full tree is built.
+	//
+	void start(const ofMesh & mesh, int numLevels, bool bUseFaces, int numThreads, const string & cachePath = "");
+
+	// swap the newest published tree into treeRtn and return its level
+	// count, or return 0 if nothing new is ready
+	//
+	int take(LinearOctree & treeRtn);
+
+	// a build was started and its full tree has not been taken yet
+	//
+	bool isBuilding() const { return pending; }
+
+	int levelStep = 3;
+	float boundsMargin = 0;          // LinearOctree::boundsMargin of the trees built by start()
+
+private:
+	struct Request {
+		ofMesh mesh;
+		int numLevels = 0;
+		bool bUseFaces = false;
+		int numThreads = 1;
+		float boundsMargin = 0;
+		string cachePath;
+	};
+
+	// a published stage
+	//
+	struct Stage {
+		LinearOctree tree;
+		int numLevels = 0;
+		bool last = false;
+	};
+
+	void buildLoop();
+	bool publish(const std::shared_ptr<Stage> & stage, int generation);
+
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable requested;
+	Request request;
+	int generation = 0;              // bumped by start(), stages of older builds are dropped
+	bool hasRequest = false;
+	bool stopping = false;
+
+	std::shared_ptr<Stage> ready;    // only accessed with std::atomic_load/store/exchange
+	std::atomic<bool> pending{ false };
+};
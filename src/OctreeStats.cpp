@@ -0,0 +1,90 @@
+//--------------------------------------------------------------
+//
+//  Octree instrumentation.
+//
+//  See OctreeStats.h
+//
+#include "OctreeStats.h"
+
+static void jsonArray(ostringstream & out, const vector<int> & values) {
+	out << "[";
+	for (int i = 0; i < values.size(); i++)
+		out << (i > 0 ? ", " : "") << values[i];
+	out << "]";
+}
+
+string OctreeStats::toJson() const {
+	ostringstream out;
+	out << "{\"numNodes\": " << numNodes << ", \"numLeaves\": " << numLeaves << ", \"maxDepth\": " << maxDepth
+		<< ", \"nodesPerLevel\": ";
+	jsonArray(out, nodesPerLevel);
+	out << ", \"leafOccupancy\": ";
+	jsonArray(out, leafOccupancy);
+	out << ", \"emptyChildRatio\": " << emptyChildRatio << ", \"memoryBytes\": " << memoryBytes << "}";
+	return out.str();
+}
+
+// once maxSamples queries of a type are recorded, each new one replaces
+// the oldest
+//
+void QueryStats::add(QueryType type, const QueryCounters & counters) {
+	std::lock_guard<std::mutex> guard(lock);
+	vector<QueryCounters> & list = samples[type];
+	if (list.size() < maxSamples) list.push_back(counters);
+	else if (maxSamples > 0) list[total[type] % maxSamples] = counters;
+	total[type]++;
+}
+
+void QueryStats::clear() {
+	std::lock_guard<std::mutex> guard(lock);
+	for (int t = 0; t < NUM_TYPES; t++) {
+		samples[t].clear();
+		total[t] = 0;
+	}
+}
+
+int QueryStats::count(QueryType type) const {
+	std::lock_guard<std::mutex> guard(lock);
+	return total[type];
+}
+
+// nearest rank percentile
+//
+float QueryStats::percentile(QueryType type, int QueryCounters::* counter, float p) const {
+	vector<int> values;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (int i = 0; i < samples[type].size(); i++)
+			values.push_back(samples[type][i].*counter);
+	}
+	if (values.empty()) return 0;
+	int rank = (int)ceil(p / 100 * values.size()) - 1;
+	rank = std::max(0, std::min(rank, (int)values.size() - 1));
+	nth_element(values.begin(), values.begin() + rank, values.end());
+	return values[rank];
+}
+
+string QueryStats::toJson() const {
+	const char * typeNames[] = { "ray", "box", "nearest", "sweep" };
+	const char * counterNames[] = { "nodesVisited", "boxesTested", "leavesReturned" };
+	int QueryCounters::* counters[] = { &QueryCounters::nodesVisited, &QueryCounters::boxesTested, &QueryCounters::leavesReturned };
+	float percentiles[] = { 50, 90, 99, 100 };
+	const char * percentileNames[] = { "p50", "p90", "p99", "max" };
+
+	ostringstream out;
+	out << "{";
+	for (int t = 0; t < NUM_TYPES; t++) {
+		out << (t > 0 ? ", " : "") << "\"" << typeNames[t] << "\": {\"count\": " << count((QueryType)t);
+		for (int c = 0; c < 3; c++) {
+			out << ", \"" << counterNames[c] << "\": {";
+			for (int p = 0; p < 4; p++) {
+				out << (p > 0 ? ", " : "") << "\"" << percentileNames[p] << "\": "
+					<< percentile((QueryType)t, counters[c], percentiles[p]);
+			}
+			out << "}";
+		}
+		out << "}";
+	}
+	out << "}";
+	return out.str();
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------
+//
+//  Octree instrumentation.
+//
+//  OctreeStats describes the shape of a built tree (Octree::stats()).
+//  QueryStats collects per-query cost counters while it is attached to
+//  an Octree or LinearOctree (queryStats) and reduces them to percentiles, so
+//  the effect of numLevels on query cost can be measured on the real
+//  query mix instead of a benchmark.  Both can be read from code or
+//  dumped as JSON.
+//
+#pragma once
+#include "ofMain.h"
+#include <mutex>
+
+class OctreeStats {
+public:
+	int numNodes = 0;
+	int numLeaves = 0;
+	int maxDepth = 0;                // deepest leaf, the root is level 0
+	vector<int> nodesPerLevel;
+
+	// leaves by number of points (faces) held: bucket 0 counts leaves with
+	// 1 item, bucket k leaves with 2^(k-1) + 1 to 2^k items
+	//
+	vector<int> leafOccupancy;
+
+	// unoccupied child slots of interior nodes, out of 8 per node
+	//
+	float emptyChildRatio = 0;
+	size_t memoryBytes = 0;
+
+	string toJson() const;
+};
+
+// cost of one query
+//
+class QueryCounters {
+public:
+	int nodesVisited = 0;
+	int boxesTested = 0;
+	int leavesReturned = 0;
+};
+
+typedef enum { RayQuery, BoxQuery, NearestQuery, SweepQuery } QueryType;
+
+// the counters of the last maxSamples queries of each type.  add() can be
+// called from several threads.
+//
+class QueryStats {
+public:
+	static const int NUM_TYPES = 4;
+
+	QueryStats(int maxSamples = 100000) : maxSamples(maxSamples) {}
+
+	void add(QueryType type, const QueryCounters & counters);
+	void clear();
+
+	// number of queries recorded (including ones no longer sampled)
+	//
+	int count(QueryType type) const;
+
+	// p (0 - 100) percentile of a counter over the sampled queries, e.g.
+	// percentile(RayQuery, &QueryCounters::nodesVisited, 99)
+	//
+	float percentile(QueryType type, int QueryCounters::* counter, float p) const;
+
+	string toJson() const;
+
+private:
+	int maxSamples;
+	vector<QueryCounters> samples[NUM_TYPES];
+	int total[NUM_TYPES] = { 0 };
+	mutable std::mutex lock;
+};
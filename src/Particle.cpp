@@ -10,27 +10,22 @@ Particle::Particle() {
 	position.set(0, 0, 0);
 	forces.set(0, 0, 0);
 	lifespan = 5;
-	birthtime = 0;
+	birthtick = 0;
 	radius = .1;
 	damping = .99;
 	mass = 1;
 	color = ofColor::aquamarine;
 }
 
-void Particle::draw() {
+void Particle::draw(const SimClock & clock) {
 //	ofSetColor(color);
-	ofSetColor(ofMap(age(), 0, lifespan, 255, 10), 0, 0);
+	ofSetColor(ofMap(age(clock), 0, lifespan, 255, 10), 0, 0);
 	ofDrawSphere(position, radius);
 }
 
 // write your own integrator here.. (hint: it's only 3 lines of code)
 //
-void Particle::integrate() {
-
-	
-	// interval for this step
-	//
-	float dt = 1.0 / ofGetFrameRate();
+void Particle::integrate(float dt) {
 
 	// update position based on velocity
 	//
@@ -54,8 +49,8 @@ void Particle::integrate() {
 
 //  return age in seconds
 //
-float Particle::age() {
-	return (ofGetElapsedTimeMillis() - birthtime)/1000.0;
+float Particle::age(const SimClock & clock) {
+	return clock.secondsSince(birthtick);
 }
 
 
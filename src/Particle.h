@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ofMain.h"
+#include "SimClock.h"
 
 class ParticleForceField;
 
@@ -16,10 +17,10 @@ public:
 	float   mass;
 	float   lifespan;
 	float   radius;
-	float   birthtime;
-	void    integrate();
-	void    draw();
-	float   age();        // sec
+	int64_t birthtick;    // SimClock tick
+	void    integrate(float dt);
+	void    draw(const SimClock & clock);
+	float   age(const SimClock & clock);        // sec
 	ofColor color;
 };
 
@@ -35,11 +35,14 @@ void ParticleEmitter::init() {
 	oneShot = false;
 	fired = false;
 	lastSpawned = 0;
+	lastTick = 0;
 	radius = 1;
 	particleRadius = .1;
 	visible = true;
 	type = DirectionalEmitter;
 	groupSize = 1;
+	capacity = 0;
+	overflowPolicy = PoolRecycle;
 }
 
 
@@ -60,18 +63,26 @@ void ParticleEmitter::draw() {
 	//}
 	sys->draw();  
 }
+int ParticleEmitter::poolCapacity() const {
+	if (capacity > 0) return capacity;
+	if (oneShot) return groupSize;
+	return ((int)ceil(lifespan * rate) + 1) * groupSize;
+}
+
 void ParticleEmitter::start() {
+	sys->setCapacity(poolCapacity(), overflowPolicy);
 	started = true;
-	lastSpawned = ofGetElapsedTimeMillis();
+	lastSpawned = lastTick;
 }
 
 void ParticleEmitter::stop() {
 	started = false;
 	fired = false;
 }
-void ParticleEmitter::update() {
+void ParticleEmitter::update(const SimClock & clock) {
 
-	float time = ofGetElapsedTimeMillis();
+	int64_t time = clock.now();
+	lastTick = time;
 
 	if (oneShot && started) {
 		if (!fired) {
@@ -87,7 +98,7 @@ void ParticleEmitter::update() {
 		stop();
 	}
 
-	else if (((time - lastSpawned) > (1000.0 / rate)) && started) {
+	else if ((clock.secondsSince(lastSpawned) > (1.0 / rate)) && started) {
 
 		// spawn a new particle(s)
 		//
@@ -97,12 +108,12 @@ void ParticleEmitter::update() {
 		lastSpawned = time;
 	}
 
-	sys->update();
+	sys->update(clock);
 }
 
-// spawn a single particle.  time is current time of birth
+// spawn a single particle.  tick is current time of birth
 //
-void ParticleEmitter::spawn(float time) {
+void ParticleEmitter::spawn(int64_t tick) {
 
 	Particle particle;
 
@@ -129,7 +140,7 @@ void ParticleEmitter::spawn(float time) {
 	// other particle attributes
 	//
 	particle.lifespan = lifespan;
-	particle.birthtime = time;
+	particle.birthtick = tick;
 	particle.radius = particleRadius;
 
 	// add to system
@@ -25,8 +25,17 @@ public:
 	void setEmitterType(EmitterType t) { type = t; }
 	void setGroupSize(int s) { groupSize = s; }
 	void setOneShot(bool s) { oneShot = s; }
-	void update();
-	void spawn(float time);
+
+	// particle pool of the system, set up by start().  A capacity of 0
+	// takes the most particles the emitter can have alive: one group for
+	// a one shot emitter, else a group per spawn over a lifespan.
+	//
+	void setCapacity(int c) { capacity = c; }
+	void setOverflowPolicy(PoolPolicy p) { overflowPolicy = p; }
+	int poolCapacity() const;
+	const PoolStats & getPoolStats() const { return sys->poolStats; }
+	void update(const SimClock & clock);
+	void spawn(int64_t tick);
 	void setPosition(const ofVec3f &);
 	ParticleSystem *sys;
 	float rate;         // per sec
@@ -35,11 +44,14 @@ public:
 	ofVec3f velocity;
 	float lifespan;     // sec
 	bool started;
-	float lastSpawned;  // ms
+	int64_t lastSpawned;  // tick
+	int64_t lastTick;     // tick of the last update()
 	float particleRadius;
 	float radius;
 	bool visible;
 	int groupSize;      // number of particles to spawn in a group
+	int capacity;       // particles in the pool, 0 derives it
+	PoolPolicy overflowPolicy;
 	bool createdSys;
 	EmitterType type;
 };
@@ -0,0 +1,240 @@
+//
+//  SIMD kernels for the particle arrays - see ParticleKernels.h
+//
+
+#include "ParticleKernels.h"
+#include "SimdBox.h"
+#include "SimdTarget.h"
+
+// the turbulence kernels draw the random numbers for this many particles
+// at a time, then scale and add them as vectors
+//
+static const int RANDOM_BLOCK = 64;
+
+// raw 24 bit random values for particles [0, n) of a block, in the order
+// TurbulenceForce draws them
+//
+static void drawRandomBlock(ParticleRandom & random, int n, int32_t rx[], int32_t ry[], int32_t rz[]) {
+	for (int j = 0; j < n; j++) {
+		rx[j] = random.next() >> 8;
+		ry[j] = random.next() >> 8;
+		rz[j] = random.next() >> 8;
+	}
+}
+
+//--------------------------------------------------------------
+// scalar reference kernels
+//
+static void integrateScalar(ParticleStore & particles, int begin, int end, float dt) {
+	float * px = particles.px.data(), * py = particles.py.data(), * pz = particles.pz.data();
+	float * vx = particles.vx.data(), * vy = particles.vy.data(), * vz = particles.vz.data();
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	const float * mass = particles.mass.data();
+	const float * damping = particles.damping.data();
+	for (int i = begin; i < end; i++) {
+		px[i] += vx[i] * dt;
+		py[i] += vy[i] * dt;
+		pz[i] += vz[i] * dt;
+		float invMass = 1.0f / mass[i];
+		vx[i] = (vx[i] + fx[i] * invMass * dt) * damping[i];
+		vy[i] = (vy[i] + fy[i] * invMass * dt) * damping[i];
+		vz[i] = (vz[i] + fz[i] * invMass * dt) * damping[i];
+		fx[i] = 0;
+		fy[i] = 0;
+		fz[i] = 0;
+	}
+}
+
+static void gravityScalar(ParticleStore & particles, int begin, int end, const ofVec3f & g) {
+	for (int i = begin; i < end; i++) {
+		particles.fx[i] += g.x * particles.mass[i];
+		particles.fy[i] += g.y * particles.mass[i];
+		particles.fz[i] += g.z * particles.mass[i];
+	}
+}
+
+static void turbulenceScalar(ParticleStore & particles, int begin, int end, const ofVec3f & tmin, const ofVec3f & tmax, ParticleRandom & random) {
+	for (int i = begin; i < end; i++) {
+		particles.fx[i] += random.uniform(tmin.x, tmax.x);
+		particles.fy[i] += random.uniform(tmin.y, tmax.y);
+		particles.fz[i] += random.uniform(tmin.z, tmax.z);
+	}
+}
+
+#ifdef SIMD_X86
+//--------------------------------------------------------------
+// SSE2 kernels, four particles at a time.  The arrays are 32 byte
+// aligned but a range can start anywhere, so loads are unaligned; the
+// last few particles go through the scalar kernel.
+//
+static void integrateSSE(ParticleStore & particles, int begin, int end, float dt) {
+	float * px = particles.px.data(), * py = particles.py.data(), * pz = particles.pz.data();
+	float * vx = particles.vx.data(), * vy = particles.vy.data(), * vz = particles.vz.data();
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	const float * mass = particles.mass.data();
+	const float * damping = particles.damping.data();
+	__m128 t = _mm_set1_ps(dt);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 zero = _mm_setzero_ps();
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(vx + i), y = _mm_loadu_ps(vy + i), z = _mm_loadu_ps(vz + i);
+		_mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(x, t)));
+		_mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(y, t)));
+		_mm_storeu_ps(pz + i, _mm_add_ps(_mm_loadu_ps(pz + i), _mm_mul_ps(z, t)));
+		__m128 invMass = _mm_div_ps(one, _mm_loadu_ps(mass + i));
+		__m128 d = _mm_loadu_ps(damping + i);
+		_mm_storeu_ps(vx + i, _mm_mul_ps(_mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fx + i), invMass), t)), d));
+		_mm_storeu_ps(vy + i, _mm_mul_ps(_mm_add_ps(y, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fy + i), invMass), t)), d));
+		_mm_storeu_ps(vz + i, _mm_mul_ps(_mm_add_ps(z, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fz + i), invMass), t)), d));
+		_mm_storeu_ps(fx + i, zero);
+		_mm_storeu_ps(fy + i, zero);
+		_mm_storeu_ps(fz + i, zero);
+	}
+	integrateScalar(particles, i, end, dt);
+}
+
+static void gravitySSE(ParticleStore & particles, int begin, int end, const ofVec3f & g) {
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	const float * mass = particles.mass.data();
+	__m128 gx = _mm_set1_ps(g.x), gy = _mm_set1_ps(g.y), gz = _mm_set1_ps(g.z);
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 m = _mm_loadu_ps(mass + i);
+		_mm_storeu_ps(fx + i, _mm_add_ps(_mm_loadu_ps(fx + i), _mm_mul_ps(gx, m)));
+		_mm_storeu_ps(fy + i, _mm_add_ps(_mm_loadu_ps(fy + i), _mm_mul_ps(gy, m)));
+		_mm_storeu_ps(fz + i, _mm_add_ps(_mm_loadu_ps(fz + i), _mm_mul_ps(gz, m)));
+	}
+	gravityScalar(particles, i, end, g);
+}
+
+// min + (max - min) * r * 2^-24, as ParticleRandom::uniform()
+//
+static inline __m128 uniformSSE(__m128 lo, __m128 range, const int32_t * r) {
+	__m128 v = _mm_cvtepi32_ps(_mm_load_si128((const __m128i *)r));
+	return _mm_add_ps(lo, _mm_mul_ps(_mm_mul_ps(range, v), _mm_set1_ps(1.0f / 16777216.0f)));
+}
+
+static void turbulenceSSE(ParticleStore & particles, int begin, int end, const ofVec3f & tmin, const ofVec3f & tmax, ParticleRandom & random) {
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	__m128 lx = _mm_set1_ps(tmin.x), ly = _mm_set1_ps(tmin.y), lz = _mm_set1_ps(tmin.z);
+	__m128 sx = _mm_set1_ps(tmax.x - tmin.x), sy = _mm_set1_ps(tmax.y - tmin.y), sz = _mm_set1_ps(tmax.z - tmin.z);
+	alignas(16) int32_t rx[RANDOM_BLOCK], ry[RANDOM_BLOCK], rz[RANDOM_BLOCK];
+	int i = begin;
+	while (end - i >= 4) {
+		int n = std::min(RANDOM_BLOCK, (end - i) & ~3);
+		drawRandomBlock(random, n, rx, ry, rz);
+		for (int j = 0; j < n; j += 4, i += 4) {
+			_mm_storeu_ps(fx + i, _mm_add_ps(_mm_loadu_ps(fx + i), uniformSSE(lx, sx, rx + j)));
+			_mm_storeu_ps(fy + i, _mm_add_ps(_mm_loadu_ps(fy + i), uniformSSE(ly, sy, ry + j)));
+			_mm_storeu_ps(fz + i, _mm_add_ps(_mm_loadu_ps(fz + i), uniformSSE(lz, sz, rz + j)));
+		}
+	}
+	turbulenceScalar(particles, i, end, tmin, tmax, random);
+}
+
+//--------------------------------------------------------------
+// AVX2 kernels, eight particles at a time.  No FMA, so the rounding is
+// the same as the scalar and SSE2 code.
+//
+SIMD_TARGET_AVX2
+static void integrateAVX2(ParticleStore & particles, int begin, int end, float dt) {
+	float * px = particles.px.data(), * py = particles.py.data(), * pz = particles.pz.data();
+	float * vx = particles.vx.data(), * vy = particles.vy.data(), * vz = particles.vz.data();
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	const float * mass = particles.mass.data();
+	const float * damping = particles.damping.data();
+	__m256 t = _mm256_set1_ps(dt);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 zero = _mm256_setzero_ps();
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 x = _mm256_loadu_ps(vx + i), y = _mm256_loadu_ps(vy + i), z = _mm256_loadu_ps(vz + i);
+		_mm256_storeu_ps(px + i, _mm256_add_ps(_mm256_loadu_ps(px + i), _mm256_mul_ps(x, t)));
+		_mm256_storeu_ps(py + i, _mm256_add_ps(_mm256_loadu_ps(py + i), _mm256_mul_ps(y, t)));
+		_mm256_storeu_ps(pz + i, _mm256_add_ps(_mm256_loadu_ps(pz + i), _mm256_mul_ps(z, t)));
+		__m256 invMass = _mm256_div_ps(one, _mm256_loadu_ps(mass + i));
+		__m256 d = _mm256_loadu_ps(damping + i);
+		_mm256_storeu_ps(vx + i, _mm256_mul_ps(_mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fx + i), invMass), t)), d));
+		_mm256_storeu_ps(vy + i, _mm256_mul_ps(_mm256_add_ps(y, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fy + i), invMass), t)), d));
+		_mm256_storeu_ps(vz + i, _mm256_mul_ps(_mm256_add_ps(z, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fz + i), invMass), t)), d));
+		_mm256_storeu_ps(fx + i, zero);
+		_mm256_storeu_ps(fy + i, zero);
+		_mm256_storeu_ps(fz + i, zero);
+	}
+	integrateScalar(particles, i, end, dt);
+}
+
+SIMD_TARGET_AVX2
+static void gravityAVX2(ParticleStore & particles, int begin, int end, const ofVec3f & g) {
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	const float * mass = particles.mass.data();
+	__m256 gx = _mm256_set1_ps(g.x), gy = _mm256_set1_ps(g.y), gz = _mm256_set1_ps(g.z);
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 m = _mm256_loadu_ps(mass + i);
+		_mm256_storeu_ps(fx + i, _mm256_add_ps(_mm256_loadu_ps(fx + i), _mm256_mul_ps(gx, m)));
+		_mm256_storeu_ps(fy + i, _mm256_add_ps(_mm256_loadu_ps(fy + i), _mm256_mul_ps(gy, m)));
+		_mm256_storeu_ps(fz + i, _mm256_add_ps(_mm256_loadu_ps(fz + i), _mm256_mul_ps(gz, m)));
+	}
+	gravityScalar(particles, i, end, g);
+}
+
+SIMD_TARGET_AVX2
+static inline __m256 uniformAVX2(__m256 lo, __m256 range, const int32_t * r) {
+	__m256 v = _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i *)r));
+	return _mm256_add_ps(lo, _mm256_mul_ps(_mm256_mul_ps(range, v), _mm256_set1_ps(1.0f / 16777216.0f)));
+}
+
+SIMD_TARGET_AVX2
+static void turbulenceAVX2(ParticleStore & particles, int begin, int end, const ofVec3f & tmin, const ofVec3f & tmax, ParticleRandom & random) {
+	float * fx = particles.fx.data(), * fy = particles.fy.data(), * fz = particles.fz.data();
+	__m256 lx = _mm256_set1_ps(tmin.x), ly = _mm256_set1_ps(tmin.y), lz = _mm256_set1_ps(tmin.z);
+	__m256 sx = _mm256_set1_ps(tmax.x - tmin.x), sy = _mm256_set1_ps(tmax.y - tmin.y), sz = _mm256_set1_ps(tmax.z - tmin.z);
+	alignas(32) int32_t rx[RANDOM_BLOCK], ry[RANDOM_BLOCK], rz[RANDOM_BLOCK];
+	int i = begin;
+	while (end - i >= 8) {
+		int n = std::min(RANDOM_BLOCK, (end - i) & ~7);
+		drawRandomBlock(random, n, rx, ry, rz);
+		for (int j = 0; j < n; j += 8, i += 8) {
+			_mm256_storeu_ps(fx + i, _mm256_add_ps(_mm256_loadu_ps(fx + i), uniformAVX2(lx, sx, rx + j)));
+			_mm256_storeu_ps(fy + i, _mm256_add_ps(_mm256_loadu_ps(fy + i), uniformAVX2(ly, sy, ry + j)));
+			_mm256_storeu_ps(fz + i, _mm256_add_ps(_mm256_loadu_ps(fz + i), uniformAVX2(lz, sz, rz + j)));
+		}
+	}
+	turbulenceScalar(particles, i, end, tmin, tmax, random);
+}
+#endif
+
+//--------------------------------------------------------------
+// runtime dispatch, on the level chosen in SimdBox.cpp
+//
+void integrateParticles(ParticleStore & particles, int begin, int end, float dt) {
+	switch (getSimdLevel()) {
+#ifdef SIMD_X86
+	case SimdAVX2: integrateAVX2(particles, begin, end, dt); break;
+	case SimdSSE: integrateSSE(particles, begin, end, dt); break;
+#endif
+	default: integrateScalar(particles, begin, end, dt); break;
+	}
+}
+
+void addGravityForce(ParticleStore & particles, int begin, int end, const ofVec3f & gravity) {
+	switch (getSimdLevel()) {
+#ifdef SIMD_X86
+	case SimdAVX2: gravityAVX2(particles, begin, end, gravity); break;
+	case SimdSSE: gravitySSE(particles, begin, end, gravity); break;
+#endif
+	default: gravityScalar(particles, begin, end, gravity); break;
+	}
+}
+
+void addTurbulenceForce(ParticleStore & particles, int begin, int end, const ofVec3f & tmin, const ofVec3f & tmax, ParticleRandom & random) {
+	switch (getSimdLevel()) {
+#ifdef SIMD_X86
+	case SimdAVX2: turbulenceAVX2(particles, begin, end, tmin, tmax, random); break;
+	case SimdSSE: turbulenceSSE(particles, begin, end, tmin, tmax, random); break;
+#endif
+	default: turbulenceScalar(particles, begin, end, tmin, tmax, random); break;
+	}
+}
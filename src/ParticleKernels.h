@@ -0,0 +1,29 @@
+#pragma once
+//
+//  SIMD kernels for the particle arrays.
+//
+//  The integrator and the gravity and turbulence forces run 4 (SSE2) or
+//  8 (AVX2) particles per instruction, picked with the same run time
+//  level as the octree box tests (getSimdLevel() / setSimdLevel() in
+//  SimdBox.h).  Every kernel does the same float operations in the same
+//  order as the scalar code, so all levels give bit for bit the same
+//  result; the scalar versions are kept for other CPUs and to check
+//  the others against.
+//
+
+#include "ofMain.h"
+#include "ParticleStore.h"
+#include "ParticleRandom.h"
+
+// pos += v dt, v = (v + f / m dt) * damping, f = 0, for particles begin to end
+//
+void integrateParticles(ParticleStore & particles, int begin, int end, float dt);
+
+// f += m g
+//
+void addGravityForce(ParticleStore & particles, int begin, int end, const ofVec3f & gravity);
+
+// f += random in [tmin, tmax), drawn from random in the same order as
+// TurbulenceForce (x, y, z of each particle in turn)
+//
+void addTurbulenceForce(ParticleStore & particles, int begin, int end, const ofVec3f & tmin, const ofVec3f & tmax, ParticleRandom & random);
@@ -0,0 +1,65 @@
+#pragma once
+//
+//  Counter based random numbers for the particle forces.
+//
+//  Each value is a hash of (key, counter), where the key is made from a
+//  seed and a stream id and the counter just counts the values drawn.
+//  A stream needs no shared state, so every chunk of particles updated
+//  on its own thread gets its own stream, and the numbers a particle
+//  sees depend only on the seed, the step, the force and the chunk it
+//  is in -- not on the number of threads or the order they run in.
+//
+
+#include <cstdint>
+
+class ParticleRandom {
+public:
+	ParticleRandom(uint64_t seed, uint64_t stream) : key(mix(seed ^ mix(stream + 0x9e3779b97f4a7c15ULL))) {}
+
+	// stream id of a chunk of particles for one force in one step
+	//
+	static uint64_t streamId(uint64_t step, int force, int chunk) {
+		return mix(mix(step) ^ ((uint64_t)force << 32 | (uint32_t)chunk));
+	}
+
+	uint32_t next() { return (uint32_t)(mix(key + 0x9e3779b97f4a7c15ULL * ++counter) >> 32); }
+
+	// uniform in [min, max), like ofRandom(min, max)
+	//
+	float uniform(float min, float max) { return min + (max - min) * (next() >> 8) * (1.0f / 16777216.0f); }
+
+	// splitmix64 finalizer
+	//
+	static uint64_t mix(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+private:
+	uint64_t key;
+	uint64_t counter = 0;
+};
+
+// raw 24 bit values (next() >> 8) for a block of particles, value d of
+// particle j at r[d][j], drawn particle by particle as the forces draw
+// them.  Drawing them up front keeps the generator out of the loops that
+// use them.
+//
+class ParticleRandomBlock {
+public:
+	static constexpr int SIZE = 64;
+	static constexpr int MAX_DRAWS = 3;
+
+	void draw(ParticleRandom & random, int n, int draws) {
+		for (int j = 0; j < n; j++) {
+			for (int d = 0; d < draws; d++) r[d][j] = (int32_t)(random.next() >> 8);
+		}
+	}
+
+	// same value as ParticleRandom::uniform() would have returned
+	//
+	float uniform(int d, int j, float min, float max) const { return min + (max - min) * r[d][j] * (1.0f / 16777216.0f); }
+
+	alignas(32) int32_t r[MAX_DRAWS][SIZE];
+};
@@ -0,0 +1,86 @@
+//
+//  Structure of arrays particle storage - see ParticleStore.h
+//
+
+#include "ParticleStore.h"
+
+void ParticleStore::arrays(FloatArray * arraysRtn[NUM_ARRAYS]) {
+	FloatArray * all[NUM_ARRAYS] = { &px, &py, &pz, &vx, &vy, &vz, &fx, &fy, &fz,
+		&mass, &damping, &radius, &lifespan };
+	for (int a = 0; a < NUM_ARRAYS; a++) arraysRtn[a] = all[a];
+}
+
+void ParticleStore::reserve(int n) {
+	FloatArray * all[NUM_ARRAYS];
+	arrays(all);
+	for (int a = 0; a < NUM_ARRAYS; a++) all[a]->reserve(n);
+	birthtick.reserve(n);
+}
+
+void ParticleStore::clear() {
+	FloatArray * all[NUM_ARRAYS];
+	arrays(all);
+	for (int a = 0; a < NUM_ARRAYS; a++) all[a]->clear();
+	birthtick.clear();
+	count = 0;
+}
+
+void ParticleStore::add(const Particle & p) {
+	px.push_back(p.position.x);
+	py.push_back(p.position.y);
+	pz.push_back(p.position.z);
+	vx.push_back(p.velocity.x);
+	vy.push_back(p.velocity.y);
+	vz.push_back(p.velocity.z);
+	fx.push_back(p.forces.x);
+	fy.push_back(p.forces.y);
+	fz.push_back(p.forces.z);
+	mass.push_back(p.mass);
+	damping.push_back(p.damping);
+	radius.push_back(p.radius);
+	lifespan.push_back(p.lifespan);
+	birthtick.push_back(p.birthtick);
+	count++;
+}
+
+void ParticleStore::remove(int i) {
+	FloatArray * all[NUM_ARRAYS];
+	arrays(all);
+	for (int a = 0; a < NUM_ARRAYS; a++) {
+		(*all[a])[i] = all[a]->back();
+		all[a]->pop_back();
+	}
+	birthtick[i] = birthtick.back();
+	birthtick.pop_back();
+	count--;
+}
+
+Particle ParticleStore::get(int i) const {
+	Particle p;
+	p.position.set(px[i], py[i], pz[i]);
+	p.velocity.set(vx[i], vy[i], vz[i]);
+	p.forces.set(fx[i], fy[i], fz[i]);
+	p.mass = mass[i];
+	p.damping = damping[i];
+	p.radius = radius[i];
+	p.lifespan = lifespan[i];
+	p.birthtick = birthtick[i];
+	return p;
+}
+
+void ParticleStore::set(int i, const Particle & p) {
+	px[i] = p.position.x;
+	py[i] = p.position.y;
+	pz[i] = p.position.z;
+	vx[i] = p.velocity.x;
+	vy[i] = p.velocity.y;
+	vz[i] = p.velocity.z;
+	fx[i] = p.forces.x;
+	fy[i] = p.forces.y;
+	fz[i] = p.forces.z;
+	mass[i] = p.mass;
+	damping[i] = p.damping;
+	radius[i] = p.radius;
+	lifespan[i] = p.lifespan;
+	birthtick[i] = p.birthtick;
+}
@@ -0,0 +1,82 @@
+#pragma once
+//
+//  Structure of arrays particle storage.
+//
+//  The particles of a ParticleSystem are kept one field per array, so
+//  the force and integration loops only pull the fields they use
+//  through the cache, and each loop runs over plain float arrays that
+//  the compiler (or a SIMD kernel) can process several particles at a
+//  time.  Every array starts on a 32 byte boundary.
+//
+//  Particle is still the record used to spawn a particle and to hand a
+//  single particle to a ParticleForce; get() and set() convert.
+//
+
+#include "ofMain.h"
+#include "Particle.h"
+#include <new>
+
+// std::allocator with the start of every block aligned to Align bytes
+//
+template <typename T, size_t Align = 32>
+class AlignedAllocator {
+public:
+	typedef T value_type;
+	template <typename U> struct rebind { typedef AlignedAllocator<U, Align> other; };
+
+	AlignedAllocator() {}
+	template <typename U> AlignedAllocator(const AlignedAllocator<U, Align> &) {}
+
+	T * allocate(size_t n) { return (T *)::operator new(n * sizeof(T), std::align_val_t(Align)); }
+	void deallocate(T * p, size_t) { ::operator delete(p, std::align_val_t(Align)); }
+
+	template <typename U> bool operator==(const AlignedAllocator<U, Align> &) const { return true; }
+	template <typename U> bool operator!=(const AlignedAllocator<U, Align> &) const { return false; }
+};
+
+typedef vector<float, AlignedAllocator<float>> FloatArray;
+typedef vector<int64_t, AlignedAllocator<int64_t>> TickArray;
+
+class ParticleStore {
+public:
+	int size() const { return count; }
+	bool empty() const { return count == 0; }
+	int capacity() const { return (int)px.capacity(); }
+	void reserve(int n);
+	void clear();
+
+	void add(const Particle &);
+
+	// the last particle is moved into slot i, so a removal never shifts
+	// the particles behind it (the order of the particles is not kept)
+	//
+	void remove(int i);
+
+	// particle i as a Particle record, and back.  acceleration and color
+	// are not stored (acceleration is always zero).
+	//
+	Particle get(int i) const;
+	void set(int i, const Particle &);
+
+	ofVec3f position(int i) const { return ofVec3f(px[i], py[i], pz[i]); }
+	ofVec3f velocity(int i) const { return ofVec3f(vx[i], vy[i], vz[i]); }
+
+	// age in seconds
+	//
+	float age(int i, const SimClock & clock) const { return clock.secondsSince(birthtick[i]); }
+
+	FloatArray px, py, pz;           // position
+	FloatArray vx, vy, vz;           // velocity
+	FloatArray fx, fy, fz;           // forces accumulated this step
+	FloatArray mass;
+	FloatArray damping;
+	FloatArray radius;
+	FloatArray lifespan;             // sec, -1 lives forever
+	TickArray birthtick;             // SimClock tick
+
+private:
+	static const int NUM_ARRAYS = 13;      // the float arrays
+	void arrays(FloatArray * arraysRtn[NUM_ARRAYS]);
+
+	int count = 0;
+};
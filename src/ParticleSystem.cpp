@@ -2,9 +2,60 @@
 // Kevin M.Smith - CS 134 SJSU
 
 #include "ParticleSystem.h"
+#include "ThreadPool.h"
+#include "ParticleKernels.h"
 
-void ParticleSystem::add(const Particle &p) {
-	particles.push_back(p);
+void ParticleSystem::setCapacity(int capacity, PoolPolicy policy) {
+	poolStats.capacity = capacity;
+	poolPolicy = policy;
+	if (capacity > particles.capacity()) particles.reserve(capacity);
+}
+
+bool ParticleSystem::add(const Particle &p) {
+	if (poolStats.capacity > 0 && particles.size() >= poolStats.capacity) {
+		switch (poolPolicy) {
+		case PoolDrop:
+			poolStats.dropped++;
+			return false;
+		case PoolRecycle:
+			particles.set(oldest(), p);
+			poolStats.recycled++;
+			return true;
+		case PoolGrow:
+			poolStats.capacity *= 2;
+			poolStats.grown++;
+			particles.reserve(poolStats.capacity);
+			cout << "warning: particle pool full, grown to " << poolStats.capacity << " particles" << endl;
+			break;
+		}
+	}
+	particles.add(p);
+	poolStats.highWater = std::max(poolStats.highWater, particles.size());
+	return true;
+}
+
+// earliest birth time (lowest slot among equals), only searched when a
+// full pool recycles.  The oldest eighth of the pool is picked out at once
+// and handed out one per call until it runs out or goes stale.
+//
+int ParticleSystem::oldest() {
+	while (!recycleOrder.empty()) {
+		pair<int64_t, int> next = recycleOrder.back();
+		recycleOrder.pop_back();
+		if (next.second < particles.size() && particles.birthtick[next.second] == next.first) return next.second;
+		recycleOrder.clear();
+	}
+
+	int n = particles.size();
+	int group = std::min(n, std::max(64, n / 8));
+	recycleOrder.resize(n);
+	for (int i = 0; i < n; i++) recycleOrder[i] = make_pair(particles.birthtick[i], i);
+	nth_element(recycleOrder.begin(), recycleOrder.begin() + group - 1, recycleOrder.end());
+	recycleOrder.resize(group);
+	sort(recycleOrder.begin(), recycleOrder.end(), greater<pair<int64_t, int>>());
+	int best = recycleOrder.back().second;
+	recycleOrder.pop_back();
+	return best;
 }
 
 void ParticleSystem::addForce(ParticleForce *f) {
@@ -12,12 +63,12 @@ void ParticleSystem::addForce(ParticleForce *f) {
 }
 
 void ParticleSystem::remove(int i) {
-	particles.erase(particles.begin() + i);
+	particles.remove(i);
 }
 
 void ParticleSystem::setLifespan(float l) {
 	for (int i = 0; i < particles.size(); i++) {
-		particles[i].lifespan = l;
+		particles.lifespan[i] = l;
 	}
 }
 
@@ -27,47 +78,76 @@ void ParticleSystem::reset() {
 	}
 }
 
-void ParticleSystem::update() {
+void ParticleSystem::update(const SimClock & simClock) {
+	clock = simClock;
+
 	// check if empty and just return
 	if (particles.size() == 0) return;
 
-	vector<Particle>::iterator p = particles.begin();
-	vector<Particle>::iterator tmp;
-
 	// check which particles have exceed their lifespan and delete
-	// from list.  When deleting multiple objects from a vector while
-	// traversing at the same time, we need to use an iterator.
+	// them from the store.  A removal moves the last particle into the
+	// slot, which is then checked again, so expiry costs one move per
+	// dead particle.
 	//
-	while (p != particles.end()) {
-		if (p->lifespan != -1 && p->age() > p->lifespan) {
-			tmp = particles.erase(p);
-			p = tmp;
-		}
-		else p++;
+	int i = 0;
+	while (i < particles.size()) {
+		if (particles.lifespan[i] != -1 && particles.age(i, clock) > particles.lifespan[i])
+			particles.remove(i);
+		else i++;
 	}
 
-	// update forces on all particles first 
+	// forces that can't run on several threads go over all particles
+	// first, then each chunk gets the rest of the forces (in order) and
+	// is integrated
 	//
-	for (int i = 0; i < particles.size(); i++) {
-		for (int k = 0; k < forces.size(); k++) {
-			if (!forces[k]->applied)
-				forces[k]->updateForce( &particles[i] );
+	for (int k = 0; k < forces.size(); k++) {
+		if (!forces[k]->applied && !forces[k]->threadSafe) {
+			ParticleRandom random(seed, ParticleRandom::streamId(step, k, -1));
+			forces[k]->updateForces(particles, 0, particles.size(), random);
 		}
 	}
 
-	// update all forces only applied once to "applied"
-	// so they are not applied again.
-	//
+	float dt = clock.dt();
+	int numChunks = (particles.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if (threadPool && numChunks > 1) {
+		threadPool->parallelFor(numChunks, [this, dt](int begin, int end) {
+			for (int c = begin; c < end; c++) updateChunk(c, dt);
+		});
+	}
+	else {
+		for (int c = 0; c < numChunks; c++) updateChunk(c, dt);
+	}
+
+	markApplied();
+	step++;
+}
+
+// update all forces only applied once to "applied"
+// so they are not applied again.
+//
+void ParticleSystem::markApplied() {
 	for (int i = 0; i < forces.size(); i++) {
 		if (forces[i]->applyOnce)
 			forces[i]->applied = true;
 	}
+}
 
-	// integrate all the particles in the store
-	//
-	for (int i = 0; i < particles.size(); i++)
-		particles[i].integrate();
+void ParticleSystem::updateChunk(int chunk, float dt) {
+	int begin = chunk * CHUNK_SIZE;
+	int end = std::min(begin + CHUNK_SIZE, particles.size());
+	for (int k = 0; k < forces.size(); k++) {
+		if (!forces[k]->applied && forces[k]->threadSafe) {
+			ParticleRandom random(seed, ParticleRandom::streamId(step, k, chunk));
+			forces[k]->updateForces(particles, begin, end, random);
+		}
+	}
+	integrate(dt, begin, end);
+}
 
+// same steps as Particle::integrate(), over the arrays (see ParticleKernels.h)
+//
+void ParticleSystem::integrate(float dt, int begin, int end) {
+	integrateParticles(particles, begin, end, dt);
 }
 
 // remove all particlies within "dist" of point (not implemented as yet)
@@ -78,7 +158,16 @@ int ParticleSystem::removeNear(const ofVec3f & point, float dist) { return 0; }
 //
 void ParticleSystem::draw() {
 	for (int i = 0; i < particles.size(); i++) {
-		particles[i].draw();
+		ofSetColor(ofMap(particles.age(i, clock), 0, particles.lifespan[i], 255, 10), 0, 0);
+		ofDrawSphere(particles.position(i), particles.radius[i]);
+	}
+}
+
+void ParticleForce::updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random) {
+	for (int i = begin; i < end; i++) {
+		Particle particle = particles.get(i);
+		updateForce(&particle);
+		particles.set(i, particle);
 	}
 }
 
@@ -87,6 +176,7 @@ void ParticleSystem::draw() {
 //
 GravityForce::GravityForce(const ofVec3f &g) {
 	gravity = g;
+	threadSafe = true;
 }
 
 void GravityForce::updateForce(Particle * particle) {
@@ -96,11 +186,16 @@ void GravityForce::updateForce(Particle * particle) {
 	particle->forces += gravity * particle->mass;
 }
 
+void GravityForce::updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random) {
+	addGravityForce(particles, begin, end, gravity);
+}
+
 // Turbulence Force Field 
 //
 TurbulenceForce::TurbulenceForce(const ofVec3f &min, const ofVec3f &max) {
 	tmin = min;
 	tmax = max;
+	threadSafe = true;
 }
 
 void TurbulenceForce::updateForce(Particle * particle) {
@@ -113,12 +208,17 @@ void TurbulenceForce::updateForce(Particle * particle) {
 	particle->forces.z += ofRandom(tmin.z, tmax.z);
 }
 
+void TurbulenceForce::updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random) {
+	addTurbulenceForce(particles, begin, end, tmin, tmax, random);
+}
+
 // Impulse Radial Force - this is a "one shot" force that
 // eminates radially outward in random directions.
 //
 ImpulseRadialForce::ImpulseRadialForce(float magnitude) {
 	this->magnitude = magnitude;
 	applyOnce = true;
+	threadSafe = true;
 }
 
 void ImpulseRadialForce::updateForce(Particle * particle) {
@@ -130,12 +230,25 @@ void ImpulseRadialForce::updateForce(Particle * particle) {
 	particle->forces += dir.getNormalized() * magnitude;
 }
 
+void ImpulseRadialForce::updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random) {
+	for (int i = begin; i < end; i++) {
+		float x = random.uniform(-1, 1);
+		float y = random.uniform(-1, 1);
+		float z = random.uniform(-1, 1);
+		ofVec3f dir = ofVec3f(x, y, z).getNormalized() * magnitude;
+		particles.fx[i] += dir.x;
+		particles.fy[i] += dir.y;
+		particles.fz[i] += dir.z;
+	}
+}
+
 // Ring Force - this is a "one shot" force that
 // eminates radially outward in a ring.
 //
 RingForce::RingForce(float magnitude) {
 	this->magnitude = magnitude;
 	applyOnce = true;
+	threadSafe = true;
 }
 
 void RingForce::updateForce(Particle* particle) {
@@ -147,3 +260,16 @@ void RingForce::updateForce(Particle* particle) {
 	particle->forces += dir.getNormalized() * magnitude;
 	particle->forces.y = ofClamp(particle->forces.y, -magnitude/5, magnitude/5);
 }
+
+void RingForce::updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random) {
+	for (int i = begin; i < end; i++) {
+		float x = random.uniform(-1, 1);
+		float y = random.uniform(-1, 1);
+		float z = random.uniform(-1, 1);
+		ofVec3f dir = ofVec3f(x, y, z).getNormalized() * magnitude;
+		particles.fx[i] += dir.x;
+		particles.fy[i] += dir.y;
+		particles.fz[i] += dir.z;
+		particles.fy[i] = ofClamp(particles.fy[i], -magnitude / 5, magnitude / 5);
+	}
+}
@@ -3,6 +3,10 @@
 
 #include "ofMain.h"
 #include "Particle.h"
+#include "ParticleStore.h"
+#include "ParticleRandom.h"
+
+class ThreadPool;
 
 
 //  Pure Virtual Function Class - must be subclassed to create new forces.
@@ -13,20 +17,87 @@ public:
 	bool applyOnce = false;
 	bool applied = false;
 	virtual void updateForce(Particle *) = 0;
+
+	// apply the force to particles [begin, end) of the store, drawing any
+	// random numbers from random.  By default each particle is copied out
+	// to a Particle for updateForce() and written back; the built in
+	// forces work on the arrays directly.
+	//
+	virtual void updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random);
+
+	// updateForces() only touches its own particles and random, so chunks
+	// of particles can be updated on different threads at once
+	//
+	bool threadSafe = false;
+};
+
+// what ParticleSystem::add() does when the pool is full: drop the new
+// particle, overwrite the oldest one, or double the pool (with a warning)
+//
+typedef enum { PoolDrop, PoolRecycle, PoolGrow } PoolPolicy;
+
+class PoolStats {
+public:
+	int capacity = 0;
+	int highWater = 0;               // most particles alive at once
+	int dropped = 0;
+	int recycled = 0;
+	int grown = 0;
 };
 
 class ParticleSystem {
 public:
-	void add(const Particle &);
+	virtual ~ParticleSystem() {}
+
+	// preallocate the store for capacity particles, so add() makes no heap
+	// allocations until it is full.  Without a capacity (0) the store just
+	// grows as needed.  Returns false if the particle was dropped.
+	//
+	void setCapacity(int capacity, PoolPolicy policy);
+	bool add(const Particle &);
 	void addForce(ParticleForce *);
 	void remove(int);
-	void update();
+	void update(const SimClock & clock);
 	void setLifespan(float);
-	void reset();
+	virtual void reset();
 	int removeNear(const ofVec3f & point, float dist);
 	void draw();
-	vector<Particle> particles;
+	void integrate(float dt) { integrate(dt, 0, particles.size()); }
+	void integrate(float dt, int begin, int end);
+	ParticleStore particles;
 	vector<ParticleForce *> forces;
+	SimClock clock;                  // as of the last update()
+
+	// parallel update: with a thread pool the particles are split into
+	// chunks of CHUNK_SIZE that are updated (thread safe forces and
+	// integration) as separate jobs.  Each chunk draws from its own
+	// random stream, so for a given seed the result is the same for any
+	// number of threads, or none.
+	//
+	static constexpr int CHUNK_SIZE = 4096;
+	ThreadPool * threadPool = nullptr;
+	uint64_t seed = 1;
+	uint64_t step = 0;
+	PoolPolicy poolPolicy = PoolGrow;
+	PoolStats poolStats;
+
+protected:
+
+	// forces and integration of one chunk, and marking the one shot
+	// forces applied once all chunks are done (see FusedParticleSystem)
+	//
+	virtual void updateChunk(int chunk, float dt);
+	virtual void markApplied();
+
+private:
+	int oldest();
+
+	// slots of the oldest particles with their birth ticks, youngest
+	// first, so a full pool recycles a group with one nth_element() and
+	// pops one slot per particle.  A slot whose tick no longer matches
+	// (the particle died or was moved) means the list is stale.
+	//
+	vector<pair<int64_t, int>> recycleOrder;
 };
 
 
@@ -38,6 +109,7 @@ class GravityForce: public ParticleForce {
 public:
 	GravityForce(const ofVec3f & gravity);
 	void updateForce(Particle *);
+	void updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random);
 };
 
 class TurbulenceForce : public ParticleForce {
@@ -45,6 +117,7 @@ class TurbulenceForce : public ParticleForce {
 public:
 	TurbulenceForce(const ofVec3f & min, const ofVec3f &max);
 	void updateForce(Particle *);
+	void updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random);
 };
 
 class ImpulseRadialForce : public ParticleForce {
@@ -52,6 +125,7 @@ class ImpulseRadialForce : public ParticleForce {
 public:
 	ImpulseRadialForce(float magnitude); 
 	void updateForce(Particle *);
+	void updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random);
 };
 
 class RingForce : public ParticleForce {
@@ -59,4 +133,5 @@ class RingForce : public ParticleForce {
 public:
 	RingForce(float magnitude);
 	void updateForce(Particle*);
+	void updateForces(ParticleStore & particles, int begin, int end, ParticleRandom & random);
 };
\ No newline at end of file
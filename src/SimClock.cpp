@@ -0,0 +1,24 @@
+//
+//  Simulation clock - see SimClock.h
+//
+
+#include "SimClock.h"
+
+// negative or not-a-number frame times (the first frame) count as zero
+//
+void SimClock::addFrameTime(double seconds) {
+	if (seconds > 0) accumulator += seconds;
+	stepsThisFrame = 0;
+}
+
+bool SimClock::nextStep() {
+	if (accumulator < stepSeconds) return false;
+	if (stepsThisFrame >= maxStepsPerFrame) {
+		accumulator = 0;
+		return false;
+	}
+	accumulator -= stepSeconds;
+	ticks++;
+	stepsThisFrame++;
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+//
+//  Simulation clock.
+//
+//  Simulation time advances in fixed steps counted as integer ticks, so
+//  physics and particles behave the same at any frame rate and time
+//  stamps keep full resolution however long the game runs.  Each frame
+//  adds its real duration to an accumulator, and nextStep() hands out
+//  the steps that are due:
+//
+//      simClock.addFrameTime(ofGetLastFrameTime());
+//      while (simClock.nextStep()) {
+//          ... update everything by simClock.dt() ...
+//      }
+//
+//  After a long stall at most maxStepsPerFrame steps are run and the
+//  rest of the time is dropped, so the game slows down instead of
+//  falling further and further behind.
+//
+
+#include <cstdint>
+
+class SimClock {
+public:
+	SimClock(int stepsPerSecond = 60) : stepSeconds(1.0 / stepsPerSecond) {}
+
+	void addFrameTime(double seconds);
+	bool nextStep();
+
+	int64_t now() const { return ticks; }
+	float dt() const { return (float)stepSeconds; }
+
+	// seconds from tick to now
+	//
+	float secondsSince(int64_t tick) const { return (float)((ticks - tick) * stepSeconds); }
+
+	// fraction of a step left over in the accumulator, for drawing
+	// between the last two steps
+	//
+	float alpha() const { return (float)(accumulator / stepSeconds); }
+
+	int maxStepsPerFrame = 8;
+
+private:
+	double stepSeconds;
+	double accumulator = 0;
+	int64_t ticks = 0;
+	int stepsThisFrame = 0;
+};
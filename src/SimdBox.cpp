@@ -0,0 +1,231 @@
+//
+//  8-wide box tests for octree traversal - see SimdBox.h
+//
+
+#include "SimdBox.h"
+#include "SimdTarget.h"
+#include <float.h>
+
+void Box8::set(int i, const Box & box) {
+	minX[i] = box.parameters[0].x();
+	minY[i] = box.parameters[0].y();
+	minZ[i] = box.parameters[0].z();
+	maxX[i] = box.parameters[1].x();
+	maxY[i] = box.parameters[1].y();
+	maxZ[i] = box.parameters[1].z();
+}
+
+//--------------------------------------------------------------
+// scalar reference kernels
+//
+static int rayIntersectScalar(const Box8 & b, const Ray & r, float t0, float t1, float tNear[8]) {
+	const float * lo[3] = { b.minX, b.minY, b.minZ };
+	const float * hi[3] = { b.maxX, b.maxY, b.maxZ };
+	int mask = 0;
+	for (int i = 0; i < b.count; i++) {
+		float tmin = -FLT_MAX;
+		float tmax = FLT_MAX;
+		bool hit = true;
+		for (int a = 0; a < 3 && hit; a++) {
+			float tn = ((r.sign[a] ? hi[a][i] : lo[a][i]) - r.origin[a]) * r.inv_direction[a];
+			float tf = ((r.sign[a] ? lo[a][i] : hi[a][i]) - r.origin[a]) * r.inv_direction[a];
+			if (tmin > tf || tn > tmax) hit = false;
+			if (tn > tmin) tmin = tn;
+			if (tf < tmax) tmax = tf;
+		}
+		if (hit && tmin < t1 && tmax > t0) {
+			tNear[i] = tmin;
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+}
+
+static int boxOverlapScalar(const Box8 & b, const Box & q) {
+	int mask = 0;
+	for (int i = 0; i < b.count; i++) {
+		if (b.minX[i] <= q.parameters[1].x() && b.maxX[i] >= q.parameters[0].x() &&
+			b.minY[i] <= q.parameters[1].y() && b.maxY[i] >= q.parameters[0].y() &&
+			b.minZ[i] <= q.parameters[1].z() && b.maxZ[i] >= q.parameters[0].z())
+			mask |= 1 << i;
+	}
+	return mask;
+}
+
+#ifdef SIMD_X86
+//--------------------------------------------------------------
+// SSE2 kernels, two groups of four.  max/min return their second operand
+// when the first is NaN (0 * inf on a slab the ray lies in), which keeps
+// the running interval unchanged just like the scalar code.
+//
+static int rayIntersectSSE(const Box8 & b, const Ray & r, float t0, float t1, float tNear[8]) {
+	const float * lo[3] = { b.minX, b.minY, b.minZ };
+	const float * hi[3] = { b.maxX, b.maxY, b.maxZ };
+	int mask = 0;
+	for (int g = 0; g < b.count; g += 4) {
+		__m128 tmin = _mm_set1_ps(-FLT_MAX);
+		__m128 tmax = _mm_set1_ps(FLT_MAX);
+		__m128 ok = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int a = 0; a < 3; a++) {
+			__m128 o = _mm_set1_ps(r.origin[a]);
+			__m128 inv = _mm_set1_ps(r.inv_direction[a]);
+			__m128 tn = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((r.sign[a] ? hi[a] : lo[a]) + g), o), inv);
+			__m128 tf = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((r.sign[a] ? lo[a] : hi[a]) + g), o), inv);
+			ok = _mm_andnot_ps(_mm_or_ps(_mm_cmpgt_ps(tmin, tf), _mm_cmpgt_ps(tn, tmax)), ok);
+			tmin = _mm_max_ps(tn, tmin);
+			tmax = _mm_min_ps(tf, tmax);
+		}
+		ok = _mm_and_ps(ok, _mm_cmplt_ps(tmin, _mm_set1_ps(t1)));
+		ok = _mm_and_ps(ok, _mm_cmpgt_ps(tmax, _mm_set1_ps(t0)));
+		_mm_storeu_ps(tNear + g, tmin);
+		mask |= _mm_movemask_ps(ok) << g;
+	}
+	return mask & ((1 << b.count) - 1);
+}
+
+static int boxOverlapSSE(const Box8 & b, const Box & q) {
+	const float * lo[3] = { b.minX, b.minY, b.minZ };
+	const float * hi[3] = { b.maxX, b.maxY, b.maxZ };
+	int mask = 0;
+	for (int g = 0; g < b.count; g += 4) {
+		__m128 ok = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int a = 0; a < 3; a++) {
+			ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_load_ps(lo[a] + g), _mm_set1_ps(q.parameters[1][a])));
+			ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_load_ps(hi[a] + g), _mm_set1_ps(q.parameters[0][a])));
+		}
+		mask |= _mm_movemask_ps(ok) << g;
+	}
+	return mask & ((1 << b.count) - 1);
+}
+
+//--------------------------------------------------------------
+// AVX2 kernels, all eight boxes at once
+//
+SIMD_TARGET_AVX2
+static int rayIntersectAVX2(const Box8 & b, const Ray & r, float t0, float t1, float tNear[8]) {
+	const float * lo[3] = { b.minX, b.minY, b.minZ };
+	const float * hi[3] = { b.maxX, b.maxY, b.maxZ };
+	__m256 tmin = _mm256_set1_ps(-FLT_MAX);
+	__m256 tmax = _mm256_set1_ps(FLT_MAX);
+	__m256 ok = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	for (int a = 0; a < 3; a++) {
+		__m256 o = _mm256_set1_ps(r.origin[a]);
+		__m256 inv = _mm256_set1_ps(r.inv_direction[a]);
+		__m256 tn = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(r.sign[a] ? hi[a] : lo[a]), o), inv);
+		__m256 tf = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(r.sign[a] ? lo[a] : hi[a]), o), inv);
+		__m256 bad = _mm256_or_ps(_mm256_cmp_ps(tmin, tf, _CMP_GT_OQ), _mm256_cmp_ps(tn, tmax, _CMP_GT_OQ));
+		ok = _mm256_andnot_ps(bad, ok);
+		tmin = _mm256_max_ps(tn, tmin);
+		tmax = _mm256_min_ps(tf, tmax);
+	}
+	ok = _mm256_and_ps(ok, _mm256_cmp_ps(tmin, _mm256_set1_ps(t1), _CMP_LT_OQ));
+	ok = _mm256_and_ps(ok, _mm256_cmp_ps(tmax, _mm256_set1_ps(t0), _CMP_GT_OQ));
+	_mm256_storeu_ps(tNear, tmin);
+	return _mm256_movemask_ps(ok) & ((1 << b.count) - 1);
+}
+
+SIMD_TARGET_AVX2
+static int boxOverlapAVX2(const Box8 & b, const Box & q) {
+	const float * lo[3] = { b.minX, b.minY, b.minZ };
+	const float * hi[3] = { b.maxX, b.maxY, b.maxZ };
+	__m256 ok = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	for (int a = 0; a < 3; a++) {
+		ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_load_ps(lo[a]), _mm256_set1_ps(q.parameters[1][a]), _CMP_LE_OQ));
+		ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_load_ps(hi[a]), _mm256_set1_ps(q.parameters[0][a]), _CMP_GE_OQ));
+	}
+	return _mm256_movemask_ps(ok) & ((1 << b.count) - 1);
+}
+#endif
+
+//--------------------------------------------------------------
+// runtime dispatch
+//
+typedef int (*RayKernel)(const Box8 &, const Ray &, float, float, float *);
+typedef int (*OverlapKernel)(const Box8 &, const Box &);
+
+static SimdLevel currentLevel = SimdScalar;
+static RayKernel rayKernel = rayIntersectScalar;
+static OverlapKernel overlapKernel = boxOverlapScalar;
+static bool initialized = false;
+
+// pick the best kernels before main() runs, so worker threads never race
+// on the first call
+//
+static SimdLevel detectedLevel = detectSimdLevel();
+static const bool kernelsReady = (setSimdLevel(detectedLevel), true);
+
+SimdLevel detectSimdLevel() {
+#ifdef SIMD_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (avx2 && osxsave && (_xgetbv(0) & 6) == 6) return SimdAVX2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return SimdAVX2;
+#endif
+	return SimdSSE;
+#else
+	return SimdScalar;
+#endif
+}
+
+void setSimdLevel(SimdLevel level) {
+	if (level > detectedLevel) level = detectedLevel;
+	currentLevel = level;
+	initialized = true;
+	switch (level) {
+#ifdef SIMD_X86
+	case SimdAVX2:
+		rayKernel = rayIntersectAVX2;
+		overlapKernel = boxOverlapAVX2;
+		break;
+	case SimdSSE:
+		rayKernel = rayIntersectSSE;
+		overlapKernel = boxOverlapSSE;
+		break;
+#endif
+	default:
+		rayKernel = rayIntersectScalar;
+		overlapKernel = boxOverlapScalar;
+		break;
+	}
+}
+
+SimdLevel getSimdLevel() {
+	if (!initialized) setSimdLevel(detectedLevel);
+	return currentLevel;
+}
+
+const char * simdLevelName(SimdLevel level) {
+	switch (level) {
+	case SimdAVX2: return "AVX2";
+	case SimdSSE: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+int rayIntersectBox8(const Box8 & boxes, const Ray & ray, float t0, float t1, float tNear[8]) {
+	if (!initialized) setSimdLevel(detectedLevel);
+	return rayKernel(boxes, ray, t0, t1, tNear);
+}
+
+int boxOverlapBox8(const Box8 & boxes, const Box & box) {
+	if (!initialized) setSimdLevel(detectedLevel);
+	return overlapKernel(boxes, box);
+}
+
+int sortHitsBox8(int mask, const float tNear[8], int order[8]) {
+	int count = 0;
+	for (int i = 0; i < 8; i++) {
+		if (!(mask & (1 << i))) continue;
+		int j = count++;
+		for (; j > 0 && tNear[order[j - 1]] > tNear[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+	return count;
+}
@@ -0,0 +1,47 @@
+#pragma once
+//
+//  8-wide box tests for octree traversal.
+//
+//  An octree node has at most eight children, so their boxes are gathered
+//  into one Box8 (structure of arrays) and tested against a ray or a box
+//  in a single call.  The kernel is picked at startup from what the CPU
+//  supports: AVX2 (8 lanes), SSE2 (2 x 4 lanes) or plain scalar code.
+//
+
+#include "box.h"
+#include "ray.h"
+
+typedef enum { SimdScalar, SimdSSE, SimdAVX2 } SimdLevel;
+
+struct Box8 {
+	alignas(32) float minX[8];
+	alignas(32) float minY[8];
+	alignas(32) float minZ[8];
+	alignas(32) float maxX[8];
+	alignas(32) float maxY[8];
+	alignas(32) float maxZ[8];
+	int count = 0;
+
+	void set(int i, const Box & box);
+};
+
+// kernel selection.  setSimdLevel() can only lower the level from what
+// was detected (used to compare the kernels against each other).
+//
+SimdLevel detectSimdLevel();
+SimdLevel getSimdLevel();
+void setSimdLevel(SimdLevel level);
+const char * simdLevelName(SimdLevel level);
+
+// test the ray against all boxes, with the same rules as Box::intersect().
+// Returns a bit mask of the boxes hit and their entry distances in tNear.
+//
+int rayIntersectBox8(const Box8 & boxes, const Ray & ray, float t0, float t1, float tNear[8]);
+
+// bit mask of the boxes that overlap "box", same rules as Box::overlap()
+//
+int boxOverlapBox8(const Box8 & boxes, const Box & box);
+
+// indices of the boxes in mask sorted by tNear (nearest first), returns the count
+//
+int sortHitsBox8(int mask, const float tNear[8], int order[8]);
@@ -0,0 +1,21 @@
+#pragma once
+//
+//  Instruction set macros shared by the SIMD kernels.
+//
+//  SIMD_X86 is defined when building for x86, where SSE2 is always there
+//  and AVX2 is checked at run time (see detectSimdLevel() in SimdBox.h).
+//  Functions using AVX2 intrinsics are marked SIMD_TARGET_AVX2 so gcc and
+//  clang compile them for AVX2 without it being on for the whole build;
+//  MSVC needs nothing.
+//
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
@@ -0,0 +1,311 @@
+//--------------------------------------------------------------
+//
+//  Terrain chunks and view frustum culling.
+//
+//  See TerrainChunks.h
+//
+#include "TerrainChunks.h"
+
+// Gribb / Hartmann: each plane is the last row of the matrix plus or
+// minus one of the others
+//
+void Frustum::set(const glm::mat4 & m) {
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++) row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	for (int i = 0; i < 3; i++) {
+		planes[2 * i] = row[3] + row[i];
+		planes[2 * i + 1] = row[3] - row[i];
+	}
+	for (int i = 0; i < 6; i++) {
+		float len = sqrt(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+		if (len > 0) planes[i] = planes[i] * (1 / len);
+	}
+}
+
+// a box is outside if its corner farthest along a plane normal is behind
+// that plane, inside if even the nearest corner is in front of all six
+//
+FrustumTest Frustum::test(const Box & box) const {
+	const Vector3 & lo = box.parameters[0];
+	const Vector3 & hi = box.parameters[1];
+	FrustumTest result = FrustumInside;
+	for (int i = 0; i < 6; i++) {
+		const glm::vec4 & p = planes[i];
+		float farthest = p.x * (p.x >= 0 ? hi.x() : lo.x()) + p.y * (p.y >= 0 ? hi.y() : lo.y()) + p.z * (p.z >= 0 ? hi.z() : lo.z()) + p.w;
+		if (farthest < 0) return FrustumOutside;
+		float nearest = p.x * (p.x >= 0 ? lo.x() : hi.x()) + p.y * (p.y >= 0 ? lo.y() : hi.y()) + p.z * (p.z >= 0 ? lo.z() : hi.z()) + p.w;
+		if (nearest < 0) result = FrustumIntersect;
+	}
+	return result;
+}
+
+void TerrainChunks::clear() {
+	depth = 0;
+	nodes.clear();
+	chunks.clear();
+	chunkFaces.clear();
+	chunkBounds.clear();
+	faceNode.clear();
+	vertexFaceStart.clear();
+	vertexFaces.clear();
+	remap.clear();
+}
+
+void TerrainChunks::create(const LinearOctree & faceOctree, int numLevels) {
+	float startTime = ofGetElapsedTimeMillis();
+	clear();
+	if (faceOctree.numNodes() == 0) return;
+	depth = numLevels;
+	const ofMesh & mesh = faceOctree.mesh;
+
+	// the top of the tree
+	//
+	nodes.resize(1);
+	addNode(faceOctree, 0, 0, 0);
+
+	// hand each face down to the node that holds its centroid
+	//
+	vector<vector<int>> nodeFaces(nodes.size());
+	int numFaces = Octree::meshFaceCount(mesh);
+	for (int f = 0; f < numFaces; f++)
+		nodeFaces[nodeOfFace(mesh, f)].push_back(f);
+	remap.assign(mesh.getNumVertices(), -1);
+	faceNode.assign(numFaces, -1);
+	addChunks(mesh, 0, nodeFaces);
+
+	cout << "Time to build terrain chunks: " << ofGetElapsedTimeMillis() - startTime << " ms (" << numChunks()
+		<< " chunks, depth " << depth << ")" << endl;
+}
+
+// copy octree node treeNode into nodes[node], and its children down to
+// depth.  The children of a node are kept next to each other.
+//
+void TerrainChunks::addNode(const LinearOctree & faceOctree, int treeNode, int node, int level) {
+	nodes[node].box = faceOctree.getBox(treeNode);
+	if (level >= depth || faceOctree.isLeaf(treeNode)) return;
+
+	int count = faceOctree.numChildren(treeNode);
+	int first = (int)nodes.size();
+	nodes.resize(first + count);
+	nodes[node].firstChild = first;
+	nodes[node].numChildren = count;
+	for (int i = 0; i < count; i++)
+		addNode(faceOctree, faceOctree.firstChild[treeNode] + i, first + i, level + 1);
+}
+
+// the deepest node whose box holds the face's centroid
+//
+int TerrainChunks::nodeOfFace(const ofMesh & mesh, int face) const {
+	Vector3 p[3];
+	Octree::getFaceVertices(mesh, face, p);
+	Vector3 centroid = (p[0] + p[1] + p[2]) / 3;
+	int n = 0;
+	while (nodes[n].numChildren > 0) {
+		int next = -1;
+		for (int i = 0; i < nodes[n].numChildren && next < 0; i++) {
+			Box box = nodes[nodes[n].firstChild + i].box;
+			if (box.inside(centroid)) next = nodes[n].firstChild + i;
+		}
+		if (next < 0) break;
+		n = next;
+	}
+	return n;
+}
+
+// number the chunks depth first, so the chunks of a subtree are a range,
+// and build each chunk's mesh
+//
+void TerrainChunks::addChunks(const ofMesh & mesh, int node, vector<vector<int>> & nodeFaces) {
+	nodes[node].chunkBegin = (int)chunks.size();
+	if (!nodeFaces[node].empty()) {
+		int c = (int)chunks.size();
+		nodes[node].chunk = c;
+		chunkFaces.push_back(vector<int>());
+		chunkFaces.back().swap(nodeFaces[node]);
+		chunks.push_back(std::unique_ptr<ofVboMesh>(new ofVboMesh()));
+		chunkBounds.push_back(Box());
+		for (int i = 0; i < chunkFaces[c].size(); i++) faceNode[chunkFaces[c][i]] = node;
+		buildChunk(mesh, c);
+	}
+
+	for (int i = 0; i < nodes[node].numChildren; i++)
+		addChunks(mesh, nodes[node].firstChild + i, nodeFaces);
+	nodes[node].chunkEnd = (int)chunks.size();
+	setBounds(node);
+}
+
+// the chunk's own copy of the vertices its faces use, and its bounds.
+// remap is -1 for every mesh vertex on the way in and out.
+//
+void TerrainChunks::buildChunk(const ofMesh & mesh, int c) {
+	const vector<int> & faces = chunkFaces[c];
+	bool indexed = mesh.getNumIndices() > 0;
+	bool normals = mesh.getNumNormals() == mesh.getNumVertices();
+	bool texCoords = mesh.getNumTexCoords() == mesh.getNumVertices();
+	ofVboMesh & chunk = *chunks[c];
+	chunk.clear();
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (int i = 0; i < faces.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			int v = indexed ? mesh.getIndex(3 * faces[i] + k) : 3 * faces[i] + k;
+			if (remap[v] < 0) {
+				remap[v] = (int)chunk.getNumVertices();
+				glm::vec3 p = mesh.getVertex(v);
+				chunk.addVertex(p);
+				if (normals) chunk.addNormal(mesh.getNormal(v));
+				if (texCoords) chunk.addTexCoord(mesh.getTexCoord(v));
+				lo = glm::vec3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+				hi = glm::vec3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+			}
+			chunk.addIndex(remap[v]);
+		}
+	}
+	for (int i = 0; i < faces.size(); i++) {
+		for (int k = 0; k < 3; k++) remap[indexed ? mesh.getIndex(3 * faces[i] + k) : 3 * faces[i] + k] = -1;
+	}
+	chunkBounds[c] = Box(Vector3(lo.x, lo.y, lo.z), Vector3(hi.x, hi.y, hi.z));
+}
+
+// bounds of everything below a node, the octree box doesn't hold faces
+// that stick out of it
+//
+void TerrainChunks::setBounds(int node) {
+	for (int c = nodes[node].chunkBegin; c < nodes[node].chunkEnd; c++) {
+		const Box & b = chunkBounds[c];
+		if (c == nodes[node].chunkBegin) nodes[node].bounds = b;
+		else {
+			const Box & u = nodes[node].bounds;
+			nodes[node].bounds = Box(
+				Vector3(fmin(u.parameters[0].x(), b.parameters[0].x()), fmin(u.parameters[0].y(), b.parameters[0].y()), fmin(u.parameters[0].z(), b.parameters[0].z())),
+				Vector3(fmax(u.parameters[1].x(), b.parameters[1].x()), fmax(u.parameters[1].y(), b.parameters[1].y()), fmax(u.parameters[1].z(), b.parameters[1].z())));
+		}
+	}
+}
+
+void TerrainChunks::update(const LinearOctree & faceOctree, const vector<int> & vertices) {
+	if (nodes.empty() || vertices.empty()) return;
+	const ofMesh & mesh = faceOctree.mesh;
+	if (vertexFaceStart.empty()) Octree::vertexFaceTable(mesh, vertexFaceStart, vertexFaces);
+
+	// the faces using the vertices, and the nodes they go to now
+	//
+	vector<int> faces;
+	for (int i = 0; i < vertices.size(); i++) {
+		int v = vertices[i];
+		faces.insert(faces.end(), vertexFaces.begin() + vertexFaceStart[v], vertexFaces.begin() + vertexFaceStart[v + 1]);
+	}
+	sort(faces.begin(), faces.end());
+	faces.erase(unique(faces.begin(), faces.end()), faces.end());
+	vector<int> dirtyNodes;
+	vector<pair<int, int>> born;     // node without a chunk, face going to it
+	bool renumbered = false;
+	for (int i = 0; i < faces.size(); i++) {
+		int f = faces[i];
+		int from = faceNode[f];
+		int to = nodeOfFace(mesh, f);
+		dirtyNodes.push_back(from);
+		if (to == from) continue;
+		dirtyNodes.push_back(to);
+		vector<int> & left = chunkFaces[nodes[from].chunk];
+		left.erase(lower_bound(left.begin(), left.end(), f));
+		if (left.empty()) renumbered = true;
+		if (nodes[to].chunk < 0) {
+			born.push_back(make_pair(to, f));
+			renumbered = true;
+		}
+		else {
+			vector<int> & joined = chunkFaces[nodes[to].chunk];
+			joined.insert(lower_bound(joined.begin(), joined.end(), f), f);
+		}
+		faceNode[f] = to;
+	}
+	sort(dirtyNodes.begin(), dirtyNodes.end());
+	dirtyNodes.erase(unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+
+	// number the chunks again if one was added or emptied, moving the
+	// meshes over
+	//
+	vector<int> dirty;
+	if (renumbered) {
+		vector<std::unique_ptr<ofVboMesh>> oldChunks;
+		vector<vector<int>> oldFaces;
+		vector<Box> oldBounds;
+		oldChunks.swap(chunks);
+		oldFaces.swap(chunkFaces);
+		oldBounds.swap(chunkBounds);
+		sort(born.begin(), born.end());
+		renumber(0, oldChunks, oldFaces, oldBounds, born, dirty);
+	}
+	for (int i = 0; i < dirtyNodes.size(); i++) {
+		if (nodes[dirtyNodes[i]].chunk >= 0) dirty.push_back(nodes[dirtyNodes[i]].chunk);
+	}
+	sort(dirty.begin(), dirty.end());
+	dirty.erase(unique(dirty.begin(), dirty.end()), dirty.end());
+
+	for (int d = 0; d < dirty.size(); d++)
+		buildChunk(mesh, dirty[d]);
+	for (int n = 0; n < nodes.size(); n++)
+		setBounds(n);
+}
+
+// addChunks() over the chunks there are: a node keeps its old chunk if it
+// still has faces, and gets a new one (returned in dirty) from born
+//
+void TerrainChunks::renumber(int node, vector<std::unique_ptr<ofVboMesh>> & oldChunks, vector<vector<int>> & oldFaces,
+	vector<Box> & oldBounds, vector<pair<int, int>> & born, vector<int> & dirtyRtn) {
+	ChunkNode & n = nodes[node];
+	n.chunkBegin = (int)chunks.size();
+	int old = n.chunk;
+	n.chunk = -1;
+	if (old >= 0 && !oldFaces[old].empty()) {
+		n.chunk = (int)chunks.size();
+		chunks.push_back(std::move(oldChunks[old]));
+		chunkFaces.push_back(vector<int>());
+		chunkFaces.back().swap(oldFaces[old]);
+		chunkBounds.push_back(oldBounds[old]);
+	}
+	else if (old < 0) {
+		auto first = lower_bound(born.begin(), born.end(), make_pair(node, INT_MIN));
+		auto last = lower_bound(born.begin(), born.end(), make_pair(node + 1, INT_MIN));
+		if (first != last) {
+			n.chunk = (int)chunks.size();
+			chunks.push_back(std::unique_ptr<ofVboMesh>(new ofVboMesh()));
+			chunkFaces.push_back(vector<int>());
+			for (auto b = first; b != last; b++) chunkFaces.back().push_back(b->second);
+			chunkBounds.push_back(Box());
+			dirtyRtn.push_back(n.chunk);
+		}
+	}
+
+	for (int i = 0; i < nodes[node].numChildren; i++)
+		renumber(nodes[node].firstChild + i, oldChunks, oldFaces, oldBounds, born, dirtyRtn);
+	nodes[node].chunkEnd = (int)chunks.size();
+}
+
+int TerrainChunks::visible(const Frustum & frustum, vector<int> & chunksRtn) const {
+	chunksRtn.clear();
+	if (!nodes.empty()) visible(frustum, 0, chunksRtn);
+	return (int)chunksRtn.size();
+}
+
+// a subtree entirely inside the frustum is taken whole, one entirely
+// outside is dropped, only the ones crossing it are split further
+//
+void TerrainChunks::visible(const Frustum & frustum, int node, vector<int> & chunksRtn) const {
+	const ChunkNode & n = nodes[node];
+	if (n.chunkBegin == n.chunkEnd) return;
+	FrustumTest test = frustum.test(n.bounds);
+	if (test == FrustumOutside) return;
+	if (test == FrustumInside) {
+		for (int c = n.chunkBegin; c < n.chunkEnd; c++) chunksRtn.push_back(c);
+		return;
+	}
+	if (n.chunk >= 0 && frustum.test(chunkBounds[n.chunk]) != FrustumOutside) chunksRtn.push_back(n.chunk);
+	for (int i = 0; i < n.numChildren; i++)
+		visible(frustum, n.firstChild + i, chunksRtn);
+}
+
+void TerrainChunks::draw(const vector<int> & visibleChunks) const {
+	for (int i = 0; i < visibleChunks.size(); i++)
+		chunks[visibleChunks[i]]->drawFaces();
+}
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------
+//
+//  Terrain chunks and view frustum culling.
+//
+//  The terrain mesh is cut into chunks that follow the nodes of the
+//  face octree down to a chosen depth: every face goes to the deepest
+//  node (at most that depth) whose box holds its centroid, and each
+//  node holding faces gets one chunk mesh.  The nodes keep the bounds
+//  of all chunks below them, so visible() can walk them from the root,
+//  dropping a whole subtree outside the frustum and taking a whole
+//  subtree inside it without testing its chunks one by one.
+//
+//  Culling only needs a view projection matrix, so it runs (and can be
+//  tested) without a GL context.
+//
+#pragma once
+#include "ofMain.h"
+#include "box.h"
+#include "LinearOctree.h"
+#include <memory>
+
+typedef enum { FrustumOutside, FrustumIntersect, FrustumInside } FrustumTest;
+
+class Frustum {
+public:
+
+	// the six clip planes of an OpenGL style view projection matrix
+	// (for example ofCamera::getModelViewProjectionMatrix())
+	//
+	void set(const glm::mat4 & viewProjection);
+
+	FrustumTest test(const Box & box) const;
+
+	// ax + by + cz + d >= 0 inside, normalized: left right bottom top near far
+	//
+	glm::vec4 planes[6];
+};
+
+class TerrainChunks {
+public:
+	void create(const LinearOctree & faceOctree, int depth);
+	void clear();
+
+	// the mesh vertices moved (up or down, as a crater does) and the face
+	// octree was updated: hand the faces using them down the same nodes
+	// again and rebuild only the chunks they are in, leave or join.  A node
+	// that gains its first face gets a chunk and one that loses its last
+	// face drops it, the other chunks are renumbered but not rebuilt.  The
+	// nodes stay the ones copied by create(), even if the top of the octree
+	// changed since.
+	//
+	void update(const LinearOctree & faceOctree, const vector<int> & vertices);
+	bool isEmpty() const { return chunks.empty(); }
+
+	// indices of the chunks that may be visible, returns the count
+	//
+	int visible(const Frustum & frustum, vector<int> & chunksRtn) const;
+	void draw(const vector<int> & chunks) const;
+
+	int numChunks() const { return (int)chunks.size(); }
+	int numFaces(int chunk) const { return (int)chunkFaces[chunk].size(); }
+	const Box & getBounds(int chunk) const { return chunkBounds[chunk]; }
+
+private:
+	// a copy of the octree's top depth levels.  box is the octree node's
+	// box, chunk is the node's own chunk (-1 if it has no faces),
+	// [chunkBegin, chunkEnd) all the chunks in its subtree and bounds
+	// their union.
+	//
+	struct ChunkNode {
+		Box box;
+		Box bounds;
+		int firstChild = -1;
+		int numChildren = 0;
+		int chunk = -1;
+		int chunkBegin = 0;
+		int chunkEnd = 0;
+	};
+
+	void addNode(const LinearOctree & faceOctree, int treeNode, int node, int level);
+	int nodeOfFace(const ofMesh & mesh, int face) const;
+	void addChunks(const ofMesh & mesh, int node, vector<vector<int>> & nodeFaces);
+	void renumber(int node, vector<std::unique_ptr<ofVboMesh>> & oldChunks, vector<vector<int>> & oldFaces,
+		vector<Box> & oldBounds, vector<pair<int, int>> & born, vector<int> & dirtyRtn);
+	void buildChunk(const ofMesh & mesh, int chunk);
+	void setBounds(int node);
+	void visible(const Frustum & frustum, int node, vector<int> & chunksRtn) const;
+
+	int depth = 0;
+	vector<ChunkNode> nodes;
+	vector<std::unique_ptr<ofVboMesh>> chunks;
+	vector<vector<int>> chunkFaces;
+	vector<Box> chunkBounds;
+
+	// node of each face, the faces using each vertex (for update(), built
+	// on the first one) and a vertex map that is all -1 between chunks
+	//
+	vector<int> faceNode;
+	vector<int> vertexFaceStart;
+	vector<int> vertexFaces;
+	vector<int> remap;
+};
@@ -0,0 +1,44 @@
+#pragma once
+//
+//  Common interface of the spatial indexes the game can use for the
+//  terrain: the flat octree (LinearOctree) and the SAH bounding volume
+//  hierarchy (Bvh).  These are the two queries ofApp runs every frame.
+//
+
+#include "ofMain.h"
+#include "box.h"
+#include "ray.h"
+
+class RayHit;
+
+class TerrainIndex {
+public:
+	virtual ~TerrainIndex() {}
+
+	// nearest hit along the ray (for a triangle index the closest triangle)
+	//
+	virtual bool intersect(const Ray &, RayHit & hitRtn) const = 0;
+
+	// add the box of every leaf that overlaps the query box to boxListRtn
+	//
+	virtual bool intersect(const Box &, vector<Box> & boxListRtn) const = 0;
+
+	// allocation free form of the box query: stores the indices of up to
+	// maxLeaves overlapping leaves in a caller owned buffer and returns
+	// how many leaves overlap in total (which can be more than maxLeaves)
+	//
+	virtual int intersect(const Box &, int * leavesRtn, int maxLeaves) const = 0;
+
+	// bounds of a node, and the mesh points (or faces) it owns
+	//
+	virtual Box getBox(int node) const = 0;
+	virtual void getItems(int node, const int *& itemsRtn, int & countRtn) const = 0;
+
+	// the mesh the items index, and whether they are its faces or vertices
+	//
+	virtual const ofMesh & getMesh() const = 0;
+	virtual bool itemsAreFaces() const = 0;
+
+	virtual size_t memoryBytes() const = 0;
+	virtual const char * name() const = 0;
+};
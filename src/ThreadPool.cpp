@@ -0,0 +1,70 @@
+//
+//  Minimal fixed size thread pool - see ThreadPool.h
+//
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads) {
+	if (numThreads < 1) numThreads = 1;
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		stopping = true;
+	}
+	jobAdded.notify_all();
+	for (int i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+int ThreadPool::hardwareThreads() {
+	int n = (int)std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+void ThreadPool::run(const std::function<void()> & job) {
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		jobs.push_back(job);
+	}
+	jobAdded.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> guard(lock);
+	jobsDone.wait(guard, [this] { return jobs.empty() && busy == 0; });
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)> & job) {
+	if (count <= 0) return;
+	int chunks = size() < count ? size() : count;
+	for (int c = 0; c < chunks; c++) {
+		int begin = (int)((long long)count * c / chunks);
+		int end = (int)((long long)count * (c + 1) / chunks);
+		run([=, &job] { job(begin, end); });
+	}
+	wait();
+}
+
+void ThreadPool::workerLoop() {
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			jobAdded.wait(guard, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) return;
+			job = jobs.front();
+			jobs.pop_front();
+			busy++;
+		}
+		job();
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			busy--;
+			if (jobs.empty() && busy == 0) jobsDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+//
+//  Minimal fixed size thread pool.
+//
+//  Jobs are queued with run() and executed by the worker threads in
+//  the order they were added.  wait() blocks until every queued job
+//  has finished.  Jobs must not call wait() on the pool they run in.
+//
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+
+class ThreadPool {
+public:
+	ThreadPool(int numThreads);
+	~ThreadPool();
+
+	void run(const std::function<void()> & job);
+	void wait();
+
+	// split [0, count) into about one chunk per thread and call
+	// job(begin, end) for each chunk, returns when all are done
+	//
+	void parallelFor(int count, const std::function<void(int, int)> & job);
+
+	int size() const { return (int)workers.size(); }
+	static int hardwareThreads();
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex lock;
+	std::condition_variable jobAdded;
+	std::condition_variable jobsDone;
+	int busy = 0;
+	bool stopping = false;
+};
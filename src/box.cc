@@ -35,3 +35,29 @@ bool Box::intersect(const Ray &r, float t0, float t1) const {
     tmax = tzmax;
   return ( (tmin < t1) && (tmax > t0) );
 }
+
+bool Box::intersect(const Ray &r, float t0, float t1, float &tNear, float &tFar) const {
+  float tmin, tmax, tymin, tymax, tzmin, tzmax;
+
+  tmin = (parameters[r.sign[0]].x() - r.origin.x()) * r.inv_direction.x();
+  tmax = (parameters[1-r.sign[0]].x() - r.origin.x()) * r.inv_direction.x();
+  tymin = (parameters[r.sign[1]].y() - r.origin.y()) * r.inv_direction.y();
+  tymax = (parameters[1-r.sign[1]].y() - r.origin.y()) * r.inv_direction.y();
+  if ( (tmin > tymax) || (tymin > tmax) ) 
+    return false;
+  if (tymin > tmin)
+    tmin = tymin;
+  if (tymax < tmax)
+    tmax = tymax;
+  tzmin = (parameters[r.sign[2]].z() - r.origin.z()) * r.inv_direction.z();
+  tzmax = (parameters[1-r.sign[2]].z() - r.origin.z()) * r.inv_direction.z();
+  if ( (tmin > tzmax) || (tzmin > tmax) ) 
+    return false;
+  if (tzmin > tmin)
+    tmin = tzmin;
+  if (tzmax < tmax)
+    tmax = tzmax;
+  tNear = tmin;
+  tFar = tmax;
+  return ( (tmin < t1) && (tmax > t0) );
+}
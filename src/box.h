@@ -25,6 +25,8 @@ class Box {
     }
     // (t0, t1) is the interval for valid hits
     bool intersect(const Ray &, float t0, float t1) const;
+    // same test, also returning where the ray enters and leaves the box
+    bool intersect(const Ray &, float t0, float t1, float &tNear, float &tFar) const;
 
     // corners
     Vector3 parameters[2];
@@ -37,17 +39,15 @@ class Box {
 			    (p.z() >= parameters[0].z() && p.z() <= parameters[1].z()));
 	}
 	const bool inside(Vector3 *points, int size) {
-		bool allInside = true;
 		for (int i = 0; i < size; i++) {
-			if (!inside(points[i])) allInside = false;
-			break;
+			if (!inside(points[i])) return false;
 		}
-		return allInside;
+		return true;
 	}
 
 	// check if any corners of the bounding boxes overlap
 	//
-	bool overlap(const Box &box) {
+	bool overlap(const Box &box) const {
 		bool overlapX = (this->parameters[0].x() <= box.parameters[1].x()) && (this->parameters[1].x() >= box.parameters[0].x());
 		bool overlapY = (this->parameters[0].y() <= box.parameters[1].y()) && (this->parameters[1].y() >= box.parameters[0].y());
 		bool overlapZ = (this->parameters[0].z() <= box.parameters[1].z()) && (this->parameters[1].z() >= box.parameters[0].z());
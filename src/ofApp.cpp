@@ -12,6 +12,8 @@
 
 #include "ofApp.h"
 #include "Util.h"
+#include "Benchmark.h"
+#include "ThreadPool.h"
 
 
 //--------------------------------------------------------------
@@ -123,8 +125,13 @@ void ofApp::setup(){
 	// create sliders for testing
 	//
 	gui.setup();
-	gui.add(numLevels.setup("Number of Octree Levels", 5, 1, 10));
+	gui.add(numLevels.setup("Number of Octree Levels", 10, 1, 10));
 	gui.add(bTimingInfo.setup("Timing Info", false));
+	gui.add(bUseBvh.setup("BVH Terrain Index", false));
+	gui.add(bHeightFieldAgl.setup("Height Field AGL", true));
+	gui.add(bCullTerrain.setup("Frustum Cull Terrain", true));
+	gui.add(bQueryStats.setup("Query Stats", false));
+	bQueryStats.addListener(this, &ofApp::queryStatsChanged);
 	gui.add(keyArea.setup("Key Area Light", 1, 0, 1));
 	gui.add(keyAmbient.setup("Key Ambient Color", 0.1, 0, 1));
 	gui.add(keyDiffuse.setup("Key Diffuse Color", 1.8, 0, 2));
@@ -145,9 +152,12 @@ void ofApp::setup(){
 
 	// setup emitters and forces
 	//
-	explosionEmitter.sys->addForce(new ImpulseRadialForce(5000));
-	explosionEmitter.sys->addForce(new GravityForce(gravity));
-	explosionEmitter.sys->addForce(new TurbulenceForce(ofVec3f(-1000, -1000, -1000), ofVec3f(1000, 1000, 1000)));
+	particleThreads.reset(new ThreadPool(ThreadPool::hardwareThreads()));
+	explosionEmitter.sys->threadPool = particleThreads.get();
+	landEmitter.sys->threadPool = particleThreads.get();
+	thrustEmitter.sys->threadPool = particleThreads.get();
+	explosionSystem.staticForces = std::make_tuple(StaticImpulseRadialForce(5000), StaticGravityForce(gravity),
+		StaticTurbulenceForce(ofVec3f(-1000, -1000, -1000), ofVec3f(1000, 1000, 1000)));
 	explosionEmitter.setVelocity(ofVec3f(0, 0, 0));
 	explosionEmitter.setOneShot(true);
 	explosionEmitter.setEmitterType(RadialEmitter);
@@ -155,9 +165,8 @@ void ofApp::setup(){
 	explosionEmitter.setParticleRadius(40);
 	explosionEmitter.setLifespan(2.5);
 
-	landEmitter.sys->addForce(new RingForce(500));
-	landEmitter.sys->addForce(new GravityForce(gravity));
-	landEmitter.sys->addForce(new TurbulenceForce(ofVec3f(-10, -10, -10), ofVec3f(10, 10, 10)));
+	landSystem.staticForces = std::make_tuple(StaticRingForce(500), StaticGravityForce(gravity),
+		StaticTurbulenceForce(ofVec3f(-10, -10, -10), ofVec3f(10, 10, 10)));
 	landEmitter.setVelocity(ofVec3f(0, 0, 0));
 	landEmitter.setOneShot(true);
 	landEmitter.setEmitterType(RadialEmitter);
@@ -165,8 +174,8 @@ void ofApp::setup(){
 	landEmitter.setParticleRadius(20);
 	landEmitter.setLifespan(2.5);
 
-	thrustEmitter.sys->addForce(new GravityForce(gravity));
-	thrustEmitter.sys->addForce(new TurbulenceForce(ofVec3f(-50, -100, -50), ofVec3f(50, -50, 50)));
+	thrustSystem.staticForces = std::make_tuple(StaticGravityForce(gravity),
+		StaticTurbulenceForce(ofVec3f(-50, -100, -50), ofVec3f(50, -50, 50)));
 	thrustEmitter.setVelocity(ofVec3f(0, 0, 0));
 	thrustEmitter.setOneShot(false);
 	thrustEmitter.setEmitterType(DirectionalEmitter);
@@ -175,9 +184,29 @@ void ofApp::setup(){
 	thrustEmitter.setLifespan(0.5);
 	thrustEmitter.setRate(25);
 	
-	//  Create Octree for testing.
+	//  Load the terrain octrees from the cache files next to the model,
+	//  on background threads so the first frame does not wait for them.
+	//  They are only rebuilt (and the cache rewritten) when the model or
+	//  the number of levels has changed, shallow levels first.  The
+	//  terrain chunks are cut once the full face octree is in.
 	//
-	octree.create(mars.getMesh(0), 10);
+	//  point octree for selection and the per frame collision queries
+	//
+	int threads = ThreadPool::hardwareThreads();
+	octreeBuilder.boundsMargin = craterDepth;
+	faceOctreeBuilder.boundsMargin = craterDepth;
+	octreeBuilder.start(mars.getMesh(0), numLevels, false, threads, ofToDataPath("geo/moon-houdini.octree"));
+	numLevels.addListener(this, &ofApp::numLevelsChanged);
+
+	// triangle octree for exact altitude (AGL) queries
+	//
+	faceOctreeBuilder.start(mars.getMesh(0), 10, true, threads, ofToDataPath("geo/moon-houdini-faces.octree"));
+
+	heightField.create(mars.getMesh(0), 512);
+
+	bool bvh = bUseBvh;
+	selectTerrainIndex(bvh);
+	bUseBvh.addListener(this, &ofApp::selectTerrainIndex);
 
 	cout << "Number of Verts: " << mars.getMesh(0).getNumVertices() << endl;
 
@@ -191,18 +220,18 @@ void ofApp::setup(){
 void ofApp::loadVbo(ParticleEmitter &emitter, ofVbo &vbo) {
 	if (emitter.sys->particles.size() < 1) return;
 
-	vector<ofVec3f> sizes;
-	vector<ofVec3f> points;
+	vboSizes.clear();
+	vboPoints.clear();
 	for (int i = 0; i < emitter.sys->particles.size(); i++) {
-		points.push_back(emitter.sys->particles[i].position);
-		sizes.push_back(ofVec3f(emitter.particleRadius));
+		vboPoints.push_back(emitter.sys->particles.position(i));
+		vboSizes.push_back(ofVec3f(emitter.particleRadius));
 	}
 	// upload the data to the vbo
 	//
-	int total = (int)points.size();
+	int total = (int)vboPoints.size();
 	vbo.clear();
-	vbo.setVertexData(&points[0], total, GL_STATIC_DRAW);
-	vbo.setNormalData(&sizes[0], total, GL_STATIC_DRAW);
+	vbo.setVertexData(&vboPoints[0], total, GL_STATIC_DRAW);
+	vbo.setNormalData(&vboSizes[0], total, GL_STATIC_DRAW);
 }
 
 //--------------------------------------------------------------
@@ -211,29 +240,42 @@ void ofApp::loadVbo(ParticleEmitter &emitter, ofVbo &vbo) {
 void ofApp::update() {
 
 	setLights();
+	takeOctrees();
 
-	// update emitters
-	//
-	explosionEmitter.update();
-	landEmitter.setPosition(lander.getPosition());
-	landEmitter.update();
+	simClock.addFrameTime(ofGetLastFrameTime());
+	while (simClock.nextStep()) {
 
-	glm::vec3 thrustOffset(0, 1, 0);
-	thrustEmitter.setPosition(lander.getPosition() + thrustOffset);
-	thrustEmitter.update();
+		// update emitters
+		//
+		explosionEmitter.update(simClock);
+		landEmitter.setPosition(lander.getPosition());
+		landEmitter.update(simClock);
 
-	// update fuel amount if thrust activates
-	//
-	if (thrustEmitter.started && landerFuel > 0) {
-		landerFuel -= 1.0 / ofGetFrameRate();
-	}
+		glm::vec3 thrustOffset(0, 1, 0);
+		thrustEmitter.setPosition(lander.getPosition() + thrustOffset);
+		thrustEmitter.update(simClock);
 
-	// stop emitter if no more fuel
-	//
-	if (landerFuel <= 0) {
-		thrustEmitter.stop();
-		landerFuel = 0;
+		// update fuel amount if thrust activates
+		//
+		if (thrustEmitter.started && landerFuel > 0) {
+			landerFuel -= simClock.dt();
+		}
+
+		// stop emitter if no more fuel
+		//
+		if (landerFuel <= 0) {
+			thrustEmitter.stop();
+			landerFuel = 0;
+		}
+
+		// rotate lander according to its angle
+		//
+		lander.setRotation(0, landerAngle, 0, 1, 0);
+
+		checkCollisions();
+		integrate();
 	}
+	finishCraters();
 
 	// update cameras
 	//
@@ -243,13 +285,6 @@ void ofApp::update() {
 	landerCam.setOrientation(ofQuaternion(-90, ofVec3f(1, 0, 0)) *								// set cam to face down
 							 ofQuaternion(lander.getRotationAngle(0) - 90, ofVec3f(0, 1, 0)));	// set cam to rotate with lander
 
-	// rotate lander according to its angle
-	//
-	lander.setRotation(0, landerAngle, 0, 1, 0);
-
-	checkCollisions();
-	integrate();
-
 	checkWon();
 
 	if (aglToggle)
@@ -286,7 +321,8 @@ void ofApp::draw() {
 	}
 	else {
 		ofEnableLighting();              // shaded mode
-		mars.drawFaces();
+		if (bCullTerrain && !terrainChunks.isEmpty()) drawTerrainChunks();
+		else mars.drawFaces();
 		ofMesh mesh;
 		if (bLanderLoaded) {
 			lander.drawFaces();
@@ -315,8 +351,8 @@ void ofApp::draw() {
 				// draw colliding boxes
 				//
 				ofSetColor(ofColor::lightBlue);
-				for (int i = 0; i < colBoxList.size(); i++) {
-					Octree::drawBox(colBoxList[i]);
+				for (int i = 0; i < numColLeaves; i++) {
+					Octree::drawBox(collisionIndex->getBox(colLeaves[i]));
 				}
 			}
 		}
@@ -344,19 +380,18 @@ void ofApp::draw() {
 	//	ofNoFill();
 
 	if (bDisplayLeafNodes) {
-		octree.drawLeafNodes(octree.root);
-		cout << "num leaf: " << octree.numLeaf << endl;
+		linearOctree.drawLeafNodes();
     }
 	else if (bDisplayOctree) {
 		ofNoFill();
 		ofSetColor(ofColor::white);
-		octree.draw(numLevels, 0);
+		linearOctree.draw(numLevels);
 	}
 
 	// if point selected, draw a sphere
 	//
 	if (pointSelected) {
-		ofVec3f p = octree.mesh.getVertex(selectedNode.points[0]);
+		ofVec3f p = linearOctree.mesh.getVertex(linearOctree.points[linearOctree.pointStart[selectedNode]]);
 		ofVec3f d = p - masterCam->getPosition();
 		ofSetColor(ofColor::lightGreen);
 		ofDrawSphere(p, .02 * d.length());
@@ -422,6 +457,23 @@ void ofApp::drawHud() {
 		aglVal = "DISABLED";
 	string aglString = "Altitude (AGL): " + aglVal;
 	ofDrawBitmapString(aglString, 10, 60);
+	if (octreeBuilder.isBuilding() || faceOctreeBuilder.isBuilding()) {
+		string buildString = "Building octrees: " + ofToString(octreeLevels) + " / " + ofToString(faceOctreeLevels) + " levels";
+		ofDrawBitmapString(buildString, 10, 70);
+	}
+
+	// particle pool use, for tuning the emitter capacities
+	//
+	if (bTimingInfo) {
+		ParticleEmitter * emitters[3] = { &thrustEmitter, &landEmitter, &explosionEmitter };
+		const char * names[3] = { "thrust", "land", "explosion" };
+		for (int i = 0; i < 3; i++) {
+			const PoolStats & pool = emitters[i]->getPoolStats();
+			string poolString = string(names[i]) + " pool: " + ofToString(pool.highWater) + " / " + ofToString(pool.capacity) +
+				" peak, " + ofToString(pool.dropped) + " dropped, " + ofToString(pool.recycled) + " recycled, " + ofToString(pool.grown) + " grown";
+			ofDrawBitmapString(poolString, 10, 80 + 10 * i);
+		}
+	}
 
 	if (gameOver && !gameWon) {
 		string gameOverString = "Game Over!";
@@ -520,6 +572,10 @@ void ofApp::keyPressed(int key) {
 	case 'o':
 		bDisplayOctree = !bDisplayOctree;
 		break;
+	case 'P':
+	case 'p':
+		runBenchmarks();
+		break;
 	case 'r':
 		landerFuel = 120;
 		lander.setPosition(0, 1.5, 0);
@@ -707,10 +763,10 @@ bool ofApp::raySelectWithOctree(ofVec3f &pointRet) {
 	Ray ray = Ray(Vector3(rayPoint.x, rayPoint.y, rayPoint.z),
 		Vector3(rayDir.x, rayDir.y, rayDir.z));
 
-	pointSelected = octree.intersect(ray, octree.root, selectedNode);
+	pointSelected = linearOctree.intersect(ray, selectedNode);
 
 	if (pointSelected) {
-		pointRet = octree.mesh.getVertex(selectedNode.points[0]);
+		pointRet = linearOctree.mesh.getVertex(linearOctree.points[linearOctree.pointStart[selectedNode]]);
 	}
 	return pointSelected;
 }
@@ -741,12 +797,12 @@ void ofApp::mouseDragged(int x, int y, int button) {
 
 		Box bounds = Box(Vector3(min.x, min.y, min.z), Vector3(max.x, max.y, max.z));
 
-		colBoxList.clear();
-		octree.intersect(bounds, octree.root, colBoxList);
+		int count = collisionIndex->intersect(bounds, colLeaves, MAX_COLLISION_LEAVES);
+		numColLeaves = std::min(count, MAX_COLLISION_LEAVES);
 
 		// check how many boxes are colliding
 		//
-		//collisionCount = colBoxList.size();
+		//collisionCount = count;
 		////cout << collisionCount << endl;
 		//if (collisionCount > 0) {
 		//	landerCollided = true;
@@ -992,11 +1048,9 @@ void ofApp::spawnLander() {
 }
 
 void ofApp::integrate() {
-	// init current framerate (or you can use ofGetLastFrameTime())
+	// one fixed step of the simulation clock
 	//
-	float framerate = ofGetFrameRate();
-	float dt = 1.0 / framerate;
-	if (glm::isinf(dt)) dt = 0;
+	float dt = simClock.dt();
 
 	// 
 	// 3d motion physics
@@ -1024,10 +1078,35 @@ void ofApp::integrate() {
 	angVel += angAcc * dt;
 	if (glm::isnan(angVel)) angVel = 0;
 
-	// calculate and apply new position to lander
+	// calculate and apply new position to lander, stopping at the first
+	// terrain contact on the way down so a long step (low frame rate, the
+	// explosion impulse) can't carry it through the ground.  The rest of
+	// the step slides along the ground: only the part of it going into the
+	// terrain (along the ground normal, or straight down if there is none)
+	// is taken out, so touching down doesn't stop the lander sideways.
 	//
 	glm::vec3 currPos = lander.getPosition();
-	glm::vec3 newPos = glm::vec3(currPos + landerVel*dt);
+	glm::vec3 motion = landerVel * dt;
+	if (motion.y < 0) {
+		ofVec3f min = lander.getSceneMin() + currPos;
+		ofVec3f max = lander.getSceneMax() + currPos;
+		SweepHit hit;
+		if (linearFaceOctree.sweep(Box(Vector3(min.x, min.y, min.z), Vector3(max.x, max.y, max.z)), motion, hit)) {
+			landerCollided = true;
+			glm::vec3 advance = motion * hit.t;
+			glm::vec3 slide = motion - advance;
+			ofVec3f norm;
+			glm::vec3 bottom((min.x + max.x) / 2, min.y, (min.z + max.z) / 2);
+			if (terrainNormal(bottom + advance, norm)) {
+				glm::vec3 n(norm.x, norm.y, norm.z);
+				float into = glm::dot(slide, n);
+				if (into < 0) slide -= into * n;
+			}
+			else if (slide.y < 0) slide.y = 0;
+			motion = advance + slide;
+		}
+	}
+	glm::vec3 newPos = currPos + motion;
 	lander.setPosition(newPos.x, newPos.y, newPos.z);
 
 	// apply rotation to lander
@@ -1046,6 +1125,11 @@ void ofApp::integrate() {
 }
 
 void ofApp::checkCollisions() {
+	// contact found by the swept test in the last integrate()
+	//
+	bool contact = landerCollided;
+	landerCollided = false;
+
 	// only check when lander is descending
 	//
 	if (landerVel.y >= 0) return;
@@ -1055,19 +1139,21 @@ void ofApp::checkCollisions() {
 
 	Box bounds = Box(Vector3(min.x, min.y, min.z), Vector3(max.x, max.y, max.z));
 
-	colBoxList.clear();
-	octree.intersect(bounds, octree.root, colBoxList);
+	int count = collisionIndex->intersect(bounds, colLeaves, MAX_COLLISION_LEAVES);
+	numColLeaves = std::min(count, MAX_COLLISION_LEAVES);
+	collisionCount = terrainContacts(bounds, numColLeaves);
 
 	// check if lander is still in collision
 	//
-	collisionCount = colBoxList.size();
-	if (collisionCount > 10) {
-		// apply impulse function
+	if (collisionCount > 0 || contact) {
+		// apply impulse function, along the normal of the terrain closest
+		// to the bottom of the lander
 		//
-		ofVec3f norm = ofVec3f(0, 1, 0);  // just use vertical for normal for now
+		ofVec3f norm = ofVec3f(0, 1, 0);
+		terrainNormal(glm::vec3((min.x + max.x) / 2, min.y, (min.z + max.z) / 2), norm);
 		ofVec3f lVel(landerVel.x, landerVel.y, landerVel.z);
 		ofVec3f f = (restitution + 1.0) * (-lVel.dot(norm) * norm);
-		landerForce += ofGetFrameRate() * f;
+		landerForce += f / simClock.dt();
 
 		// if impact force is high enough, trigger explosion
 		//
@@ -1077,6 +1163,7 @@ void ofApp::checkCollisions() {
 			explosionEmitter.setPosition(lander.getPosition() + explosionOffset);
 			explosionEmitter.sys->reset();
 			explosionEmitter.start();
+			blastCrater(glm::vec3((min.x + max.x) / 2, min.y, (min.z + max.z) / 2));
 			landerForce += glm::vec3(ofRandom(-100, 100), 100000, ofRandom(-100, 100));
 			gameOver = true;
 		}
@@ -1088,22 +1175,216 @@ void ofApp::checkCollisions() {
 	}
 }
 
+// number of terrain items in the first numLeaves colLeaves that the box
+// touches: faces it overlaps (exact box / triangle test) or vertices inside
+// it.  Unlike the number of leaves, this doesn't depend on how the index
+// cuts up the terrain.
+//
+int ofApp::terrainContacts(const Box & bounds, int numLeaves) const {
+	int count = 0;
+	for (int i = 0; i < numLeaves; i++) {
+		const int * items;
+		int numItems;
+		collisionIndex->getItems(colLeaves[i], items, numItems);
+		for (int j = 0; j < numItems; j++) {
+			float t;
+			if (Octree::sweepItem(collisionIndex->getMesh(), collisionIndex->itemsAreFaces(), items[j], bounds,
+				glm::vec3(0), 1, t)) count++;
+		}
+	}
+	return count;
+}
+
+// normal of the terrain triangle closest to p (within 10 units), facing up
+//
+bool ofApp::terrainNormal(const glm::vec3 & p, ofVec3f & normalRtn) {
+	NearestPoint nearest;
+	if (!linearFaceOctree.closestPoint(p, nearest, 10)) return false;
+	normalRtn = nearest.normal.y < 0 ? -nearest.normal : nearest.normal;
+	return true;
+}
+
+// draw the terrain chunks the current camera can see, with the model's
+// transform, material and texture as mars.drawFaces() would
+//
+void ofApp::drawTerrainChunks() {
+	glm::mat4 model = mars.getModelMatrix();
+	Frustum frustum;
+	frustum.set(masterCam->getModelViewProjectionMatrix() * model);
+	terrainChunks.visible(frustum, visibleChunks);
+
+	ofMaterial material = mars.getMaterialForMesh(0);
+	ofTexture texture;
+	if (mars.hasTextures()) texture = mars.getTextureForMesh(0);
+	ofPushMatrix();
+	ofMultMatrix(model);
+	material.begin();
+	if (texture.isAllocated()) texture.bind();
+	terrainChunks.draw(visibleChunks);
+	if (texture.isAllocated()) texture.unbind();
+	material.end();
+	ofPopMatrix();
+}
+
+// swap in octree stages finished by the background builds.  Node
+// indices into the old point tree are dropped with it.
+//
+void ofApp::takeOctrees() {
+	linearOctree.bTimingInfo = bTimingInfo;
+	linearFaceOctree.bTimingInfo = bTimingInfo;
+	int levels = octreeBuilder.take(linearOctree);
+	if (levels > 0) {
+		octreeLevels = levels;
+		selectedNode = -1;
+		pointSelected = false;
+		numColLeaves = 0;
+	}
+	levels = faceOctreeBuilder.take(linearFaceOctree);
+	if (levels > 0) {
+		faceOctreeLevels = levels;
+		if (!faceOctreeBuilder.isBuilding()) terrainChunks.create(linearFaceOctree, 3);
+	}
+}
+
+// the slider sets the depth of the point octree, which is rebuilt in
+// the background (uncached, the cache file holds the startup tree)
+//
+void ofApp::numLevelsChanged(int & levels) {
+	if (levels == octreeLevels && !octreeBuilder.isBuilding()) return;
+	finishCraters();
+	octreeBuilder.start(terrainMesh(), levels, false, ThreadPool::hardwareThreads());
+}
+
+// attach the query counters to the live octrees (they stay attached
+// when the builders swap in new stages), and dump them when done
+//
+void ofApp::queryStatsChanged(bool & bOn) {
+	if (bOn) {
+		pointQueryStats.clear();
+		faceQueryStats.clear();
+		linearOctree.queryStats = &pointQueryStats;
+		linearFaceOctree.queryStats = &faceQueryStats;
+		return;
+	}
+	linearOctree.queryStats = nullptr;
+	linearFaceOctree.queryStats = nullptr;
+	cout << "{\"pointOctree\": {\"levels\": " << linearOctree.numLevels() << ", \"queries\": " << pointQueryStats.toJson()
+		<< "}, \"faceOctree\": {\"levels\": " << linearFaceOctree.numLevels() << ", \"queries\": " << faceQueryStats.toJson()
+		<< "}}" << endl;
+}
+
+// the terrain as the collision queries see it, with the craters in it
+//
+const ofMesh & ofApp::terrainMesh() const {
+	if (linearFaceOctree.numNodes() > 0) return linearFaceOctree.mesh;
+	return mars.getMesh(0);
+}
+
+// push the ground under a crash down into a bowl and update every
+// terrain index with the moved vertices.  Skipped while the octrees are
+// still being built, the builder would swap the old terrain back in.
+// Only the chunk meshes show the crater, the model is drawn as loaded.
+//
+// This runs inside a simulation step, so a tree is only patched in place
+// there (LinearOctree::patch()); one that has to be laid out again gets
+// the crater from finishCraters() after the frame's steps, and so do
+// craters blasted before then.
+//
+void ofApp::blastCrater(const glm::vec3 & center) {
+	if (octreeBuilder.isBuilding() || faceOctreeBuilder.isBuilding()) return;
+	if (linearOctree.numNodes() == 0 || linearFaceOctree.numNodes() == 0) return;
+	if (bCraterPointsPending || bCraterFacesPending || !pendingCraters.empty()) {
+		pendingCraters.push_back(center);
+		return;
+	}
+	digCrater(center, true);
+}
+
+// the crater's edit for every terrain index.  The bvh, height field and
+// chunks only touch the moved vertices; the height field and chunks
+// follow the face tree's mesh, so they wait for it.
+//
+void ofApp::digCrater(const glm::vec3 & center, bool inStep) {
+	linearOctree.craterEdit(center, craterRadius, craterDepth, craterVertices, craterPositions);
+	if (craterVertices.empty()) return;
+	if (inStep) {
+		bCraterPointsPending = !linearOctree.patch(craterVertices, craterPositions);
+		bCraterFacesPending = !linearFaceOctree.patch(craterVertices, craterPositions);
+	}
+	else {
+		linearOctree.update(craterVertices, craterPositions);
+		linearFaceOctree.update(craterVertices, craterPositions);
+		craterLaidOut();
+	}
+	if (terrainBvh.numNodes() > 0) terrainBvh.refit(craterVertices, craterPositions);
+	if (!bCraterFacesPending) craterFacesDone();
+}
+
+// the trees' nodes were laid out again, node indices into them are stale
+//
+void ofApp::craterLaidOut() {
+	selectedNode = -1;
+	pointSelected = false;
+	numColLeaves = 0;
+}
+
+void ofApp::craterFacesDone() {
+	heightField.update(linearFaceOctree.mesh, craterVertices);
+	if (!terrainChunks.isEmpty()) terrainChunks.update(linearFaceOctree, craterVertices);
+}
+
+// the tree updates blastCrater() left for after the simulation steps, and
+// the craters blasted while they were pending
+//
+void ofApp::finishCraters() {
+	if (bCraterPointsPending) linearOctree.update(craterVertices, craterPositions);
+	if (bCraterFacesPending) {
+		linearFaceOctree.update(craterVertices, craterPositions);
+		craterFacesDone();
+	}
+	if (bCraterPointsPending || bCraterFacesPending) craterLaidOut();
+	bCraterPointsPending = bCraterFacesPending = false;
+	for (int i = 0; i < pendingCraters.size(); i++)
+		digCrater(pendingCraters[i], false);
+	pendingCraters.clear();
+}
+
+// switch the AGL and collision queries between the octrees and the bvh,
+// the bvh is built the first time it is picked.  The collision leaves
+// are node indices into the old index, so they are dropped.
+//
+void ofApp::selectTerrainIndex(bool & bvh) {
+	numColLeaves = 0;
+	if (bvh) {
+		if (terrainBvh.numNodes() == 0) terrainBvh.create(terrainMesh());
+		aglIndex = &terrainBvh;
+		collisionIndex = &terrainBvh;
+	}
+	else {
+		aglIndex = &linearFaceOctree;
+		collisionIndex = &linearOctree;
+	}
+}
+
 float ofApp::calculateAGL() {
 	// construct ray shooting down starting from lander
 	//
 	Vector3 landerPos(lander.getPosition().x, lander.getPosition().y, lander.getPosition().z);
 	Ray landerRay(Vector3(landerPos), Vector3(0, -1, 0));
 
-	TreeNode selected;
-
-	// store intersected node in selected
+	// the height field answers straight down queries with one lookup
 	//
-	octree.intersect(landerRay, octree.root, selected);
+	float agl;
+	if (bHeightFieldAgl && heightField.agl(lander.getPosition(), agl)) {
+		return agl;
+	}
+
+	RayHit hit;
 
-	// fetch intersected point from mesh and calculate distance from lander
+	// nearest terrain triangle straight below the lander
 	//
-	for (int i = 0; i < selected.points.size(); i++) {
-		return glm::distance(lander.getPosition(), mars.getMesh(0).getVertex(selected.points[i]));
+	if (aglIndex->intersect(landerRay, hit)) {
+		return hit.t;
 	}
 
 	// if no intersection, return -1
@@ -1121,6 +1402,55 @@ void ofApp::checkWon() {
 	//
 	if (landerVel.x > -1 && landerVel.y > -1 && landerVel.z > -1 &&
 		landerVel.x < 1 && landerVel.y < 1 && landerVel.z < 1 && dist < 5 && !gameOver) {
-		gameWon = true;
+
+		// and the ground under it is found and level enough (no win while
+		// the face octree is still loading)
+		//
+		ofVec3f norm;
+		if (terrainNormal(lander.getPosition(), norm) && norm.y >= cos(ofDegToRad(maxLandingSlope)))
+			gameWon = true;
+	}
+}
+
+// run the benchmarks, results are printed to the console
+//
+void ofApp::runBenchmarks() {
+
+	// the game itself runs on the cached flat trees, the pointer based
+	// trees are only built for comparison
+	//
+	if (octree.root.children.empty()) {
+		octree.numThreads = ThreadPool::hardwareThreads();
+		octree.create(mars.getMesh(0), 10);
+		faceOctree.bUseFaces = true;
+		faceOctree.numThreads = octree.numThreads;
+		faceOctree.create(mars.getMesh(0), 10);
+	}
+
+	// the checks print their cases, a failure is also logged so it is not
+	// lost in the benchmark output
+	//
+	if (!checkTerrainChunks()) ofLogError("ofApp") << "checkTerrainChunks() failed";
+	if (!checkOctreeLineMeshes()) ofLogError("ofApp") << "checkOctreeLineMeshes() failed";
+	if (!checkOctreeUpdate()) ofLogError("ofApp") << "checkOctreeUpdate() failed";
+	benchmarkOctreeLayouts(octree, linearOctree, 10000);
+	benchmarkSimdTraversal(octree, faceOctree, linearOctree, 10000);
+	benchmarkBatchQueries(faceOctree, 100000);
+	benchmarkHeightField(linearFaceOctree, heightField, 100000);
+	benchmarkNearestQueries(faceOctree, linearFaceOctree, 10000);
+	benchmarkSweepQueries(linearOctree, linearFaceOctree, 100000);
+	benchmarkParticleLayouts({ 10000, 100000, 1000000 });
+	benchmarkParticleThreads({ 100000, 1000000 }, ThreadPool::hardwareThreads());
+	benchmarkParticleFusion({ 10000, 100000, 1000000 });
+	benchmarkParticleKernels({ 10000, 100000, 1000000 });
+
+	// the build benchmarks take a while, only run them when timing is on
+	//
+	if (bTimingInfo) {
+		benchmarkOctreeBuild(mars.getMesh(0), 10);
+		benchmarkOctreeStrategies(10);
+		benchmarkTerrainIndexes(mars.getMesh(0), 10, 10000);
+		benchmarkOctreeUpdate(400, 10);
+		benchmarkOctreeLevels(mars.getMesh(0), 10000);
 	}
 }
@@ -4,8 +4,16 @@
 #include "ofxGui.h"
 #include  "ofxAssimpModelLoader.h"
 #include "Octree.h"
+#include "LinearOctree.h"
+#include "Bvh.h"
+#include "HeightField.h"
+#include "TerrainChunks.h"
+#include "OctreeBuilder.h"
+#include "ThreadPool.h"
 #include <glm/gtx/intersect.hpp>
 #include "ParticleEmitter.h"
+#include "FusedParticleSystem.h"
+#include "SimClock.h"
 #include "Particle.h"
 
 
@@ -51,14 +59,73 @@ class ofApp : public ofBaseApp{
 		ofLight light;
 		Box boundingBox, landerBounds;
 		Box testBox;
-		vector<Box> colBoxList;
+
+		// leaves hit by the last collision query, a fixed buffer so the
+		// query never allocates
+		//
+		static constexpr int MAX_COLLISION_LEAVES = 256;
+		int colLeaves[MAX_COLLISION_LEAVES];
+		int numColLeaves = 0;
 		bool bLanderSelected = false;
 		Octree octree;
-		TreeNode selectedNode;
+		Octree faceOctree;
+		LinearOctree linearOctree;
+		LinearOctree linearFaceOctree;
+
+		// index used for the AGL ray and the collision box queries, either
+		// the octrees above or the bvh
+		//
+		Bvh terrainBvh;
+		const TerrainIndex * aglIndex = nullptr;
+		const TerrainIndex * collisionIndex = nullptr;
+		void selectTerrainIndex(bool & bUseBvh);
+
+		// the terrain octrees are built in the background and swapped in
+		// by update() as each stage is done.  The point octree is rebuilt
+		// when the numLevels slider moves.
+		//
+		OctreeBuilder octreeBuilder;
+		OctreeBuilder faceOctreeBuilder;
+		int octreeLevels = 0;
+		int faceOctreeLevels = 0;
+		void takeOctrees();
+		void numLevelsChanged(int & levels);
+
+		// a crash digs a crater: the terrain trees are updated in place
+		// (their boxes leave craterDepth of room below the ground for it).
+		// A tree that needs its nodes laid out again gets the last crater's
+		// edit after the simulation steps, see blastCrater().
+		//
+		float craterRadius = 12;
+		float craterDepth = 4;
+		vector<int> craterVertices;
+		vector<glm::vec3> craterPositions;
+		bool bCraterPointsPending = false;
+		bool bCraterFacesPending = false;
+		vector<glm::vec3> pendingCraters;
+		void blastCrater(const glm::vec3 & center);
+		void digCrater(const glm::vec3 & center, bool inStep);
+		void craterLaidOut();
+		void craterFacesDone();
+		void finishCraters();
+		const ofMesh & terrainMesh() const;
+
+		// the terrain as a height grid, for the AGL query
+		//
+		HeightField heightField;
+
+		// the terrain cut into chunks along the face octree, only the ones
+		// in view of the current camera are drawn
+		//
+		TerrainChunks terrainChunks;
+		vector<int> visibleChunks;
+		void drawTerrainChunks();
+		int selectedNode = -1;
 		glm::vec3 mouseDownPos, mouseLastPos;
 		bool bInDrag = false;
 		bool landerCollided = false;
 		int collisionCount;
+		int terrainContacts(const Box & bounds, int numLeaves) const;
 
 		// lights
 		//
@@ -82,8 +149,10 @@ class ofApp : public ofBaseApp{
 
 		void setLights();
 
-		// lander physics
+		// lander physics, particles and fuel run in fixed steps of the
+		// simulation clock
 		//
+		SimClock simClock;
 		glm::vec3 landerVel = glm::vec3(0, 0, 0);
 		glm::vec3 landerAcc = glm::vec3(0, 0, 0);
 		glm::vec3 landerForce = glm::vec3(0, 0, 0);
@@ -94,26 +163,36 @@ class ofApp : public ofBaseApp{
 		float landerAngle = 0;
 		glm::vec3 gravity = glm::vec3(0, -1.625, 0);
 		float restitution = 0.85;
+		float maxLandingSlope = 15;        // degrees, steepest ground that counts as landed
 		float mass = 1.0;
 		float damping = 0.99f;
 		bool aglToggle = false;
 		void integrate();
 		void checkCollisions();
+		bool terrainNormal(const glm::vec3 & p, ofVec3f & normalRtn);
 		float calculateAGL();
 		float landerFuel = 120; // amount of fuel in seconds
 		float altitude;
 
 		// particle and shaders
 		//
-		ParticleEmitter explosionEmitter;
-		ParticleEmitter landEmitter;
-		ParticleEmitter thrustEmitter;
+		// the emitters' forces are fixed, so each runs a fused system
+		//
+		FusedParticleSystem<StaticImpulseRadialForce, StaticGravityForce, StaticTurbulenceForce> explosionSystem;
+		FusedParticleSystem<StaticRingForce, StaticGravityForce, StaticTurbulenceForce> landSystem;
+		FusedParticleSystem<StaticGravityForce, StaticTurbulenceForce> thrustSystem;
+		ParticleEmitter explosionEmitter{ &explosionSystem };
+		ParticleEmitter landEmitter{ &landSystem };
+		ParticleEmitter thrustEmitter{ &thrustSystem };
+		std::unique_ptr<ThreadPool> particleThreads;     // shared by the emitters' parallel updates
 		ofTexture particleTex;
 		ofVbo vboExplosion;
 		ofVbo vboLand;
 		ofVbo vboThrust;
 		ofShader shader;
 		void loadVbo(ParticleEmitter &e, ofVbo &vbo);
+		vector<ofVec3f> vboPoints;        // reused by loadVbo() so a frame allocates nothing
+		vector<ofVec3f> vboSizes;
 
 		// sounds
 		//
@@ -126,9 +205,22 @@ class ofApp : public ofBaseApp{
 		//
 		Box landingArea;
 
+		void runBenchmarks();
+
 		ofxIntSlider numLevels;
 		ofxToggle bTimingInfo;
+		ofxToggle bUseBvh;
+		ofxToggle bHeightFieldAgl;
+		ofxToggle bCullTerrain;
+		ofxToggle bQueryStats;
 		ofxPanel gui;
+
+		// per query cost of the live octrees, collected while the Query
+		// Stats toggle is on and printed as JSON when it is turned off
+		//
+		QueryStats pointQueryStats;
+		QueryStats faceQueryStats;
+		void queryStatsChanged(bool & bOn);
 		void drawHud();
 
 		bool gameOver;